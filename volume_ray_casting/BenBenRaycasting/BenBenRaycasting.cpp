@@ -122,6 +122,13 @@ nv::GlutUIContext ui;
 char volume_filename[MAX_STR_SIZE] = "data\\nucleon.dat";
 //////////////////////////////////////////////////////////////////////////
 
+/// compute the derived fields per brick for the box the transfer function reads, instead of whole fields
+bool lazy_fields = false;
+/// the box read by the transfer function, the whole volume if its extent is 0
+int roi_origin[3] = {0, 0, 0}, roi_extent[3] = {0, 0, 0};
+/// the fraction of the voxels taken as background (air) before the analysis passes, 0 for none
+float foreground_percentile = 0;
+
 /// record clusters
 char * lable;
 
@@ -650,6 +657,8 @@ void init()
 	volume.readVolFile(volume_filename);
 
 	//do some calculations if necessary
+	if(foreground_percentile > 0)
+		volume.calForegroundMask(foreground_percentile);
 
 	//volume.average_deviation();
 	//volume.calLocalEntropy();
@@ -659,9 +668,23 @@ void init()
 	//	Volume.calEp();
 	//	Volume.NormalDistributionTest();
 	//volume.calGrad();
-	volume.calGrad();
-	//	volume.calGrad_ex();
-	volume.calDf2();
+	if(lazy_fields)
+	{
+		// only the bricks of the box are computed, the rest when they are read
+		if(roi_extent[0] <= 0 || roi_extent[1] <= 0 || roi_extent[2] <= 0)
+		{
+			roi_extent[0] = volume.getX();
+			roi_extent[1] = volume.getY();
+			roi_extent[2] = volume.getZ();
+		}
+		volume.useLazyFields();
+		volume.prefetchLazyFields(roi_origin, roi_extent);
+	}else
+	{
+		volume.calGrad();
+		//	volume.calGrad_ex();
+		volume.calDf2();
+	}
 	//	volume.average_deviation();
 	//	NormalTest();
 	//	Volume.calLH();
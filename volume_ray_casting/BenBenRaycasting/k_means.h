@@ -6,7 +6,9 @@
 #define K_MEANS
 #include <iostream>
 #include <cmath>
+#include <vector>
 #include "Volume.h"
+#include "../my_raycasting/Distance_Kernel.h"
 
 using namespace std;
 
@@ -32,10 +34,6 @@ void k_means(Volume   * v,  char * lable)
 	
 	int dim_x, dim_y, dim_z;
 	int temp_x, temp_y, temp_z;
-	int temp_data, temp_grad, temp_df2, temp_df3;
-	int distance;
-	double min;
-	int j;
 	k_means_grid k_grid[NUM];
 	
 	dim_x = v->getX();
@@ -123,30 +121,33 @@ void k_means(Volume   * v,  char * lable)
 
 			for(i = 0;i < 6; ++ i)
 				std::cout<<k_grid[i].center_x << ",  "<<k_grid[i].center_y <<",   "<<k_grid[i].center_z<<endl;
+			// the centers of (data, gradient, df2, df3) row by row, and a line of voxels along z
+			// component by component, so all centers are compared by Distance_Kernel at once
+			float centers[NUM * 4];
+			for(i = 0; i < NUM; ++i)
+			{
+				centers[i * 4 + 0] = float(k_grid[i].average_data);
+				centers[i * 4 + 1] = float(k_grid[i].average_grad);
+				centers[i * 4 + 2] = float(k_grid[i].average_df2);
+				centers[i * 4 + 3] = float(k_grid[i].average_df3);
+			}
+			std::vector<float> features(4 * dim_z);
+			std::vector<float> best_distance(dim_z);
+			std::vector<int> best_label(dim_z);
 				for(x = 0; x < dim_x; ++x)
 					for(y = 0; y < dim_y; ++y)
+					{
 						for(z = 0; z < dim_z; ++z)
 						{
-							min = 1e10;
-							for(i = 0; i < NUM;++i)
-							{
-								temp_data = v->getData(x, y, z);
-								temp_grad = v->getGrad(x, y, z);
-								temp_df2 = v->getDf2(x, y, z);
-								temp_df3 = v->getDf3(x, y, z);
-								distance = pow(double(temp_data - k_grid[i].average_data), 2.0)
-												+ pow(double(temp_grad - k_grid[i].average_grad), 2.0)
-												+ pow(double(temp_df2 - k_grid[i].average_df2), 2.0)
-												+ pow(double(temp_df3 - k_grid[i].average_df3), 2.0);
-								distance = pow(distance, 0.5);
-								if(distance < min)
-								{
-									min = distance;
-									j = i;
-								}
-							}
-							lable[v->getIndex(x, y , z)] = j;
+							features[z] = float(v->getData(x, y, z));
+							features[dim_z + z] = float(v->getGrad(x, y, z));
+							features[2 * dim_z + z] = float(v->getDf2(x, y, z));
+							features[3 * dim_z + z] = float(v->getDf3(x, y, z));
 						}
+						clustering::Distance_Kernel<>::nearest(&features[0], dim_z, 4, centers, NUM, dim_z, &best_distance[0], &best_label[0]);
+						for(z = 0; z < dim_z; ++z)
+							lable[v->getIndex(x, y , z)] = best_label[z];
+					}
 			for(x = 0; x < dim_x; ++x)
 				for(y = 0; y < dim_y; ++y)
 					for(z = 0; z  < dim_z; ++z)
@@ -8,7 +8,14 @@
 #include <string>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <climits>
 #include "Volume.h"
+#include "../my_raycasting/histogram_utility.h"
+#include "../my_raycasting/lut_utility.h"
+#include "../my_raycasting/gradient_utility.h"
+#include "../my_raycasting/tensor_utility.h"
+#include "../my_raycasting/statistics_utility.h"
 
 using namespace std;
 
@@ -180,59 +187,39 @@ unsigned int Volume::getZ(void)
 /// calculate histogram of a dataset
 void Volume::calHistogram()
 {
-	int i, c, total;
+	int i;
+	histogram_utility::Histogram h;
 
-	max_data = 0;
-	min_data = 10000;
 	ofstream file("s.csv", std::ios::out);
 
 	histogram = (unsigned int * )malloc(range * sizeof(unsigned int));
 	if(histogram == NULL)
 	{
 		fprintf(stderr, "not enough memory for histogram\n");
+		return;
 	}
-	for(i = 0;i < range;++i)
-		histogram[i] = 0;
 	if(strcmp(format, "UCHAR") == 0)
-	{
-		for(i = 0;i < count;++i)
-		{
-			unsigned char * temp = (unsigned char *)data;
-			c = int(temp[i]);
-			histogram[c]++;
-			if(c > max_data)
-				max_data = c;
-			if(c < min_data)
-				min_data = c;
-		}	
-	}
+		h.build((unsigned char *)data, count, 1, range);
 	else if(strcmp(format, "USHORT") == 0)
-	{
-		for(i = 0;i < count;++i)
-		{
-			unsigned short * temp = (unsigned short *)data;
-			int c = int(temp[i]);
-			histogram[c]++;
-			if(c > max_data)
-				max_data =c;
-			if(c < min_data)
-				min_data = c;
-		}	
-	}
+		h.build((unsigned short *)data, count, 1, range);
 	else
+	{
 		printf("Invalid data.\n");
+		return;
+	}
+	memcpy(histogram, h.get_frequencies(), range * sizeof(unsigned int));
+	max_data = h.get_max_bin();
+	min_data = h.get_min_bin();
 
-	acc_distribution = (float * )malloc(sizeof(float) * count);
+	acc_distribution = (float * )malloc(sizeof(float) * range);
 	if(acc_distribution == NULL)
 		cout<<"Not enough space for acc_distribution"<<endl;
-	
-	total = 0;
-	for(i = 0;i < range; ++i)
-	{
-		total += int(histogram[i]);
-		acc_distribution[i] = float(total) / float(count);
-//		cout<<"acc_distribution [ "<<i<<" ]  = "<< acc_distribution[i]<<endl;
-	}
+	else
+		for(i = 0;i < range; ++i)
+		{
+			acc_distribution[i] = float(h.get_accumulation(i)) / float(count);
+	//		cout<<"acc_distribution [ "<<i<<" ]  = "<< acc_distribution[i]<<endl;
+		}
 
 	for(i = 0; i < range-1; ++i)
 	{
@@ -276,10 +263,12 @@ void Volume::calGradient()
 	int x, y, z, index;
 	unsigned int df, i, j, k, df_dx, df_dy, df_dz;
 	
-	gradient = (unsigned int *)malloc(count * sizeof(unsigned int));
-	if(gradient == NULL)
+	// derivatives of the data stay below 8 * range
+	if(!gradient.allocate(count, 8.0f * range))
+	{
 		fprintf(stderr, "not enough memory for grdient");
-	memset(gradient, 0, count * sizeof(unsigned int));
+		return;
+	}
 
 	max_grad = df_dx = df_dy = df_dz = df = 0;
 	for(x = 0;x < length;++x)
@@ -290,7 +279,7 @@ void Volume::calGradient()
 				df = 0;
 				if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height -1)
 				{
-					gradient[index] = 0;
+					gradient.set(index, 0);
 				//	df_dx = 
 				}	
 				else
@@ -306,209 +295,168 @@ void Volume::calGradient()
 						for(j = y - 1;j <= y + 1;++j)
 							for(k = z - 1;k <= z + 1;++k)
 								df += abs((long)(getData(i, j, k) - getData(x, y, z)));*/
- 					gradient[index] = df;
+ 					gradient.set(index, float(df));
 					if(df > max_grad)
 						max_grad= df;
 				}				
 			}
 }
 
+/// gradient magnitudes of 8/16-bit data on the foreground grown by 2 voxels, central differences inside and
+/// one-sided differences at the boundary. The differences are computed on the integers, only the magnitude is computed in float.
+template <class T>
+static void calculate_gradient_magnitude(const T *data, const int length, const int width, const int height, Volume &volume, half_utility::HalfField &gradient)
+{
+	typedef typename gradient_utility::difference<T>::type D;
+	const int slice = length * width;
+	const mask_utility::Span * span, * last;
+	int z;
+
+	// set up the spans once, so the threads only read them
+	volume.getForegroundSpans(0, 0, span, last, 2);
+#pragma omp parallel private(span, last)
+	{
+		std::vector<D> dx(length), dy(length), dz(length);
+		std::vector<float> magnitude(length);
+#pragma omp for
+		for(z = 0; z < height; ++z)
+		{
+			for(int y = 0; y < width; ++y)
+			{
+				const int index = z * slice + y * length;
+				for(volume.getForegroundSpans(y, z, span, last, 2); span != last; ++span)
+				{
+					const int begin = span->begin, end = span->end;
+					if(y == 0 || y == width - 1 || z == 0 || z == height - 1)
+					{
+						for(int x = begin; x < end; ++x)
+						{
+							const T *p = data + index + x;
+							const float df_dx = float(x == length - 1 ? p[0] : p[1]) - float(x == 0 ? p[0] : p[-1]);
+							const float df_dy = float(y == width - 1 ? p[0] : p[length]) - float(y == 0 ? p[0] : p[-length]);
+							const float df_dz = float(z == height - 1 ? p[0] : p[slice]) - float(z == 0 ? p[0] : p[-slice]);
+							magnitude[x] = floor(sqrt(df_dx * df_dx + df_dy * df_dy + df_dz * df_dz));
+						}
+					}
+					else
+					{
+						const T *row = data + index;
+						const int inner_begin = std::max(begin, 1), inner_end = std::min(end, length - 1);
+						if(inner_end > inner_begin)
+							gradient_utility::subtract(row + inner_begin + 1, row + inner_begin - 1, &dx[inner_begin], inner_end - inner_begin);
+						if(begin == 0)
+							dx[0] = D(row[1] - row[0]);
+						if(end == length)
+							dx[length - 1] = D(row[length - 1] - row[length - 2]);
+						gradient_utility::subtract(row + begin + length, row + begin - length, &dy[begin], end - begin);
+						gradient_utility::subtract(row + begin + slice, row + begin - slice, &dz[begin], end - begin);
+						for(int x = begin; x < end; ++x)
+						{
+							const float df_dx = dx[x], df_dy = dy[x], df_dz = dz[x];
+							magnitude[x] = floor(sqrt(df_dx * df_dx + df_dy * df_dy + df_dz * df_dz));
+						}
+					}
+					gradient.set(index + begin, &magnitude[begin], end - begin);
+				}
+			}
+		}
+	}
+}
+
 /// compute gradient magnitude
 void Volume::calGrad(void)
 {
 	int x, y, z, index;
-	unsigned int i, j, k;
-	double df_dx, df_dy, df_dz, df;
+	double df;
+	const mask_utility::Span * span, * last;
 	ofstream file("E:\\bucky.csv", std::ios::out);
 
-	df_dx = df_dy = df_dz = 0.0;
-	gradient = (unsigned int *)malloc(count * sizeof(unsigned int));
-	if(gradient == NULL)
+	// derivatives of the data stay below 8 * range
+	if(!gradient.allocate(count, 8.0f * range))
+	{
 		fprintf(stderr, "not enough memory for grdient");
-	memset(gradient, 0, count * sizeof(unsigned int));
+		return;
+	}
+
+	if(strcmp(format, "UCHAR") == 0)
+		calculate_gradient_magnitude((unsigned char *)data, length, width, height, *this, gradient);
+	else if(strcmp(format, "USHORT") == 0)
+		calculate_gradient_magnitude((unsigned short *)data, length, width, height, *this, gradient);
+	else
+	{
+		printf("Invalid data.\n");
+		return;
+	}
 
 	max_grad = 0;
 	min_grad = 10000;
-	for(x = 0;x < length;++x)
+	for(z = 0;z < height;++z)
 		for(y = 0;y < width;++y)
-			for(z = 0;z < height;++z)
-			{
-				index = getIndex(x, y, z);
-				df = 0;
-
-				if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height -1)
+			for(getForegroundSpans(y, z, span, last); span != last; ++span)
+				for(x = span->begin;x < span->end;++x)
 				{
-					if(x == 0)
-					{
-						df_dx = float(getData(x + 1, y, z)) - float(getData(x, y, z));
-					//	df_dx *= 0.5;
-					}	
-					else if(x == length - 1)
-					{
-						df_dx = float(getData(x, y, z)) - float(getData(x - 1, y, z));
-				//		df_dx *= 0.5;
-					}					
-					else if(y == 0)
-					{
-						df_dy = float(getData(x, y + 1, z)) - float(getData(x, y, z));
-				//		df_dy *= 0.5;
-					}					
-					else if(y == width - 1)
-					{
-						df_dy = float(getData(x, y, z)) - float(getData(x, y - 1, z));
-				//		df_dy *= 0.5;
-					}	
-					else if(z == 0)
-					{
-						df_dz = float(getData(x, y, z + 1)) - float(getData(x, y, z));
-				//		df_dz *= 0.5;
-					}					
-					else 
-					{
-						df_dz = float(getData(x, y, z)) - float(getData(x, y, z - 1));
-				//		df_dz *= 0.5;
-					}
-				}
-				else
-				{
-					df_dx = float(getData(x + 1, y, z)) - float(getData(x - 1, y, z));
-					df_dy = float(getData(x, y + 1, z)) - float(getData(x, y - 1, z));
-					df_dz = float(getData(x, y, z + 1)) - float(getData(x, y, z - 1));
-				//	df_dx *= 0.5;
-				//	df_dy *= 0.5;
-				//	df_dz *= 0.5;				
-				}				
-				df = sqrt(df_dx * df_dx + df_dy * df_dy + df_dz * df_dz);
-				if(df != 0 && getData(x, y, z) != 0)
-					file<<getData(x, y, z)<<", "<<df<<endl;
- 					gradient[index] = int(df);
+					index = getIndex(x, y, z);
+					df = gradient.get(index);
+					if(df != 0 && getData(x, y, z) != 0)
+						file<<getData(x, y, z)<<", "<<df<<endl;
 					if(df > max_grad)
 						max_grad = int(df);
 					if(df < min_grad)
 						min_grad = int (df);
-					
-		//				cout<<"df_dx = "<<df_dx<<"   df_dy = "<<df_dy<<"    df_dz = "<<df_dz<<"    df ="<<gradient[index]<<endl;
-			}
+				}
+}
+
+/// the derivative 0.5 * sqrt(f1 * f2) * log(f2 / f1) of two neighbouring data values, read from tables
+template <class LogTable, class SqrtTable>
+static double exponent_derivative(const unsigned int f1, const unsigned int f2, const LogTable &log_table, const SqrtTable &sqrt_table)
+{
+	return 0.5 * sqrt_table[f1] * sqrt_table[f2] * (log_table[f2] - log_table[f1]);
 }
 
 /// compute gradient magnitude using expoent function
 void Volume::calGrad_ex()
 {
 	int x, y, z, index;
-	unsigned int i, j, k;
 	double df_dx, df_dy, df_dz, df;
-	double f1, f2;
+	const mask_utility::Span * span, * last;
 	ofstream file("E:\\d4_ex.csv", std::ios::out);
 
-	gradient = (unsigned int *)malloc(count * sizeof(unsigned int));
-	if(gradient == NULL)
+	// the exponent derivative stays below range * log(range) along each axis
+	if(!gradient.allocate(count, 2.0f * range * log(float(range))))
+	{
 		fprintf(stderr, "not enough memory for grdient");
-	memset(gradient, 0, count * sizeof(unsigned int));
+		return;
+	}
 
-	max_grad = df_dx = df_dy = df_dz = df = 0;
-	for(x = 0;x < length;++x)
+	// log and sqrt of every data value, a value of 0 is taken as 1e-10
+	const lut_utility::IntegerTable<lut_utility::Logarithm> log_table(lut_utility::Logarithm(1e-10), range);
+	const lut_utility::IntegerTable<lut_utility::SquareRoot> sqrt_table(lut_utility::SquareRoot(1e-10), range);
+
+	max_grad = 0;
+	for(z = 0;z < height;++z)
 		for(y = 0;y < width;++y)
-			for(z = 0;z < height;++z)
-			{
-				index = getIndex(x, y, z);
-				df = 0;
-				if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height -1)
+			for(getForegroundSpans(y, z, span, last, 2); span != last; ++span)
+				for(x = span->begin;x < span->end;++x)
 				{
-					if(x == 0)
-					{
-						f1 =getData(x, y, z);
-						f2 = getData(x + 1,y ,z);
-					}	
-					if(x == length - 1)
-					{
-						f1 = getData(x - 1, y, z);
-						f2 = getData(x, y, z);
-					}
-					if(int(f1) == 0)
-						f1 = 1e-10;
-					if(int(f2) == 0)
-						f2 = 1e-10;
-					df_dx = 0.5 * sqrt(f1 * f2) * log(f2 / f1);
+					index = getIndex(x, y, z);
 
-					if(y == 0)
-					{
-						f1 =getData(x, y, z);
-						f2 = getData(x, y +1,z);
-					}	
-					if(y == width - 1)
-					{
-						f1 = getData(x, y - 1, z);
-						f2 = getData(x, y, z);
-					}
-					if(int(f1) == 0)
-						f1 = 1e-10;
-					if(int(f2) == 0)
-						f2 = 1e-10;
-					df_dy = 0.5 * sqrt(f1 * f2) * log(f2 / f1);					
-
-					if(z == 0)
-					{
-						f1 =getData(x, y, z);
-						f2 = getData(x, y, z + 1);
-					}	
-					if(z == height - 1)
-					{
-						f1 = getData(x, y, z - 1);
-						f2 = getData(x, y, z);
-					}
-					if(int(f1) == 0)
-						f1 = 1e-10;
-					if(int(f2) == 0)
-						f2 = 1e-10;
-					df_dz = 0.5 * sqrt(f1 * f2) * log(f2 / f1);	
+					// central differences inside, one-sided differences at the boundary
+					df_dx = exponent_derivative(getData(x > 0 ? x - 1 : x, y, z), getData(x < length - 1 ? x + 1 : x, y, z), log_table, sqrt_table);
+					df_dy = exponent_derivative(getData(x, y > 0 ? y - 1 : y, z), getData(x, y < width - 1 ? y + 1 : y, z), log_table, sqrt_table);
+					df_dz = exponent_derivative(getData(x, y, z > 0 ? z - 1 : z), getData(x, y, z < height - 1 ? z + 1 : z), log_table, sqrt_table);
 
 					df = sqrt(df_dx * df_dx + df_dy * df_dy + df_dz * df_dz);
-					//		df = pow(2.7182, double(df)) - 1;
 					if(df != 0 && getData(x, y, z) != 0)
 						file<<getData(x, y, z)<<", "<<df<<endl;
-					gradient[index] = int(df);
-				}	
-				else
-				{
-					f1 = getData(x - 1, y, z);
-					f2 = getData(x + 1, y, z);
-					if(int(f1) == 0)
-						f1 = 1e-10;
-					if(int(f2) == 0)
-						f2 = 1e-10;
-					df_dx = 0.5 * sqrt(f1 * f2) * log(f2 / f1);
-		//			df_dx = pow(2.718281828459045, df_dx);
-					
-					f1 = getData(x, y - 1, z);
-					f2 = getData(x, y + 1, z);
-					if(int(f1) == 0)
-						f1 = 1e-10;
-					if(int(f2) == 0)
-						f2 = 1e-10;
-					df_dy = 0.5 * sqrt(f1 * f2) * log(f2 / f1);
-		//			df_dy = pow(2.718281828459045, df_dy);
-
-					f1 = getData(x, y, z - 1);
-					f2 = getData(x, y, z + 1);
-					if(int(f1) == 0)
-						f1 = 1e-10;
-					if(int(f2) == 0)
-						f2 = 1e-10;
-					df_dz = 0.5 * sqrt(f1 * f2) * log(f2 / f1);
-		//			df_dz = pow(2.718281828459045, df_dz);
+					gradient.set(index, float(int(df)));
 
-					df = sqrt(df_dx * df_dx + df_dy * df_dy + df_dz * df_dz);
-			//		df = pow(2.7182, double(df)) - 1;
-					
-					if(df != 0 && getData(x, y, z) != 0)
-						file<<getData(x, y, z)<<", "<<df<<endl;
- 					gradient[index] = int(df);
+					if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height -1)
+						continue;
 					if(df > max_grad)
 						max_grad = int(df);
 					if(df < min_grad)
 						min_grad = int (df);
-				}				
-			}			
+				}
 }
 
 /// calculate second derivative
@@ -516,73 +464,35 @@ void Volume::calDf2(void)
 {
 	int x, y, z, index, i, j, k;
 	double df2_dx, df2_dy, df2_dz, Df2;
+	const mask_utility::Span * span, * last;
 
-	df2 = (unsigned int *)malloc(count * sizeof(unsigned int));
-	if(df2 == NULL)
+	if(!df2.allocate(count, 8.0f * range))
+	{
 		fprintf(stderr, "not enough memory for df2");
-	memset(df2, 0, count * sizeof(unsigned int));
+		return;
+	}
 
 	max_df2 = 0;
 	min_df2 = 10000;
-	df2_dx = df2_dy = df2_dz = Df2 = 0;
-	for(x = 0; x < length; ++x)
+	for(z = 0; z < height; ++z)
 		for(y = 0; y < width; ++y)
-			for(z = 0; z < height; ++z)
-			{
-				index = getIndex(x, y, z);
-				Df2 = 0;
-				if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height - 1)
-				{
-					if(x == 0)
-					{
-						df2_dx = float(getGrad(x + 1, y, z)) - float(getGrad(x, y, z));
-						df2_dx *= 0.5;
-					}
-					else if(x == length - 1)
-					{
-						df2_dx = float(getGrad(x, y, z)) - float(getGrad(x - 1, y, z));
-						df2_dx *= 0.5;
-					}
-					else if(y == 0)
-					{
-						df2_dy = float(getGrad(x, y + 1, z)) - float(getGrad(x, y, z));
-						df2_dy *= 0.5;
-					}
-					else if(y == width - 1)
-					{
-						df2_dy = float(getGrad(x, y, z)) - float(getGrad(x, y - 1, z));
-						df2_dy *= 0.5;
-					}
-					else if(z == 0)
-					{
-						df2_dz = float(getGrad(x, y, z + 1)) - float(getGrad(x, y, z));
-						df2_dz *= 0.5;
-					}
-					else
-					{
-						df2_dz = float(getGrad(x, y, z)) - float(getGrad(x, y, z - 1));
-						df2_dz *= 0.5;
-					}
-				}
-				else
+			for(getForegroundSpans(y, z, span, last, 1); span != last; ++span)
+				for(x = span->begin; x < span->end; ++x)
 				{
-					df2_dx = float(getGrad(x + 1, y, z)) - float(getGrad(x - 1, y, z));
-					df2_dy = float(getGrad(x, y + 1, z)) - float(getGrad(x, y - 1, z));
-					df2_dz = float(getGrad(x, y, z + 1)) - float(getGrad(x, y, z - 1));
-					df2_dx *= 0.5;
-					df2_dy *= 0.5;
-					df2_dz *= 0.5;
-					
-				}
-				Df2 = sqrt(df2_dx * df2_dx + df2_dy * df2_dy + df2_dz * df2_dz);
-						
-					df2[index] = int(Df2);
+					index = getIndex(x, y, z);
+
+					// central differences inside, one-sided differences at the boundary
+					df2_dx = 0.5 * (float(getGrad(x < length - 1 ? x + 1 : x, y, z)) - float(getGrad(x > 0 ? x - 1 : x, y, z)));
+					df2_dy = 0.5 * (float(getGrad(x, y < width - 1 ? y + 1 : y, z)) - float(getGrad(x, y > 0 ? y - 1 : y, z)));
+					df2_dz = 0.5 * (float(getGrad(x, y, z < height - 1 ? z + 1 : z)) - float(getGrad(x, y, z > 0 ? z - 1 : z)));
+					Df2 = sqrt(df2_dx * df2_dx + df2_dy * df2_dy + df2_dz * df2_dz);
+
+					df2.set(index, float(int(Df2)));
 					if(Df2 > max_df2)
 						max_df2 = int(Df2);
 					if(Df2 < min_df2)
 						min_df2 = int(Df2);
-	//			cout<<"df2_dx = "<<df2_dx<<"    df2_dy = "<<df2_dy<<"    df2_dz = "<<df2_dz<<" Df2 = "<<df2[index]<<endl;
-			}
+				}
 }
 
 /// calculate third derivative
@@ -591,72 +501,35 @@ void Volume::calDf3(void)
 	int x, y, z, index, i, j, k; 
 	double	df3_dx, df3_dy, df3_dz;
     int Df3;
+	const mask_utility::Span * span, * last;
 
-	df3 = (unsigned int *)malloc(count * sizeof(unsigned int));
-	if(df3 == NULL)
+	if(!df3.allocate(count, 8.0f * range))
+	{
 		fprintf(stderr, "not enough memory for df3");
-	memset(df3, 0, count * sizeof(unsigned int));
+		return;
+	}
 
 	max_df3 = 0;
-	min_df3 = 10000;	
-	df3_dx = df3_dy = df3_dz = Df3 = 0;
-	for(x = 0; x < length; ++x)
+	min_df3 = 10000;
+	for(z = 0; z < height; ++z)
 		for(y = 0; y < width; ++y)
-			for(z = 0; z < height; ++z)
-			{
-				index = getIndex(x, y, z);
-				Df3 = 0;
-				if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height - 1)
+			for(getForegroundSpans(y, z, span, last); span != last; ++span)
+				for(x = span->begin; x < span->end; ++x)
 				{
-					if(x == 0)
-					{
-						df3_dx = float(getDf2(x + 1, y, z)) - float(getDf2(x, y, z));
-						df3_dx *= 0.5;
-					}
-					else if(x == length - 1)
-					{
-						df3_dx = float(getDf2(x, y, z)) - float(getDf2(x - 1, y, z));
-						df3_dx *= 0.5;
-					}
-					else if(y == 0)
-					{
-						df3_dy = float(getDf2(x, y + 1, z)) - float(getDf2(x, y, z));
-						df3_dy *= 0.5;
-					}
-					else if(y == width - 1)
-					{
-						df3_dy = float(getDf2(x, y, z)) - float(getDf2(x, y - 1, z));
-						df3_dy *= 0.5;
-					}
-					else if(z == 0)
-					{
-						df3_dz = float(getDf2(x, y, z + 1)) - float(getDf2(x, y, z));
-						df3_dz *= 0.5;
-					}
-					else
-					{
-						df3_dz = float(getDf2(x, y, z)) - float(getDf2(x, y, z - 1));
-						df3_dz *= 0.5;
-					}
-				}
-				else
-				{
-					df3_dx = float(getDf2(x + 1, y, z)) - float(getDf2(x - 1, y, z));
-					df3_dy = float(getDf2(x, y + 1, z)) - float(getDf2(x, y - 1, z));
-					df3_dz = float(getDf2(x, y, z + 1)) - float(getDf2(x, y, z - 1));
-					df3_dx *= 0.5;
-					df3_dy *= 0.5;
-					df3_dz *= 0.5;					
-				}
-				Df3 = sqrt(df3_dx * df3_dx + df3_dy * df3_dy + df3_dz * df3_dz);
+					index = getIndex(x, y, z);
 
-					df3[index] = int(Df3);
+					// central differences inside, one-sided differences at the boundary
+					df3_dx = 0.5 * (float(getDf2(x < length - 1 ? x + 1 : x, y, z)) - float(getDf2(x > 0 ? x - 1 : x, y, z)));
+					df3_dy = 0.5 * (float(getDf2(x, y < width - 1 ? y + 1 : y, z)) - float(getDf2(x, y > 0 ? y - 1 : y, z)));
+					df3_dz = 0.5 * (float(getDf2(x, y, z < height - 1 ? z + 1 : z)) - float(getDf2(x, y, z > 0 ? z - 1 : z)));
+					Df3 = sqrt(df3_dx * df3_dx + df3_dy * df3_dy + df3_dz * df3_dz);
+
+					df3.set(index, float(Df3));
 					if(Df3 > max_df3)
 						max_df3 = int(Df3);
 					if(Df3 < min_df3)
 						min_df3 = int(Df3);
-					//			cout<<"df3_dx = "<<df3_dx<<"    df3_dy = "<<df3_dy<<"    df3_dz = "<<df3_dz<<" Df3 = "<<df3[index]<<endl;
-			}
+				}
 }
 
 /// return gradient magnitude at position (x, y, z)
@@ -664,7 +537,9 @@ unsigned int Volume::getGrad(unsigned int x, unsigned int y, unsigned int z)
 {
 	int index = z * width * length + y * length + x;
 	
-	return gradient[index]; 
+	if(gradient.empty() && lazy_gradient)
+		return (unsigned int)(lazy_gradient->get(x, y, z) + 0.5f);
+	return (unsigned int)(gradient.get(index) + 0.5f); 
 }
 
 /// return maximum data
@@ -706,13 +581,129 @@ unsigned int Volume::getMaxDf3(void)
 /// get second derivative at position (x, y, z)
 unsigned int Volume::getDf2(unsigned int x, unsigned int y, unsigned int z)
 {
-	return df2[getIndex(x, y, z)];
+	if(df2.empty() && lazy_df2)
+		return (unsigned int)(lazy_df2->get(x, y, z) + 0.5f);
+	return (unsigned int)(df2.get(getIndex(x, y, z)) + 0.5f);
 }
 
 /// get third derivative at position (x, y, z)
 unsigned int Volume::getDf3(unsigned int x, unsigned int y, unsigned int z)
 {
-	return df3[getIndex(x, y, z)];
+	if(df3.empty() && lazy_df3)
+		return (unsigned int)(lazy_df3->get(x, y, z) + 0.5f);
+	return (unsigned int)(df3.get(getIndex(x, y, z)) + 0.5f);
+}
+
+/// kernels of the lazy fields, truncated to integers like calGrad, calDf2 and calDf3,
+/// so each derivative is taken of the integer field before it. The derivatives of derived fields are halved.
+static const brick_utility::GradientMagnitudeKernel gradient_kernel(1.0f, true);
+static const brick_utility::GradientMagnitudeKernel derivative_kernel(0.5f, true);
+static const brick_utility::LocalEntropyKernel local_entropy_kernel;
+
+/// compute derived fields per brick when they are read
+void Volume::useLazyFields(int brick_size, size_t budget)
+{
+	const int sizes[3] = {int(length), int(width), int(height)};
+
+	releaseLazyFields();
+	if(strcmp(format, "UCHAR") == 0)
+		data_field = new brick_utility::ArrayField<unsigned char>((unsigned char *)data, sizes);
+	else if(strcmp(format, "USHORT") == 0)
+		data_field = new brick_utility::ArrayField<unsigned short>((unsigned short *)data, sizes);
+	else
+	{
+		printf("Invalid data.\n");
+		return;
+	}
+	lazy_gradient = new brick_utility::BrickStore(*data_field, gradient_kernel, brick_size, budget);
+	lazy_df2 = new brick_utility::BrickStore(*lazy_gradient, derivative_kernel, brick_size, budget);
+	lazy_df3 = new brick_utility::BrickStore(*lazy_df2, derivative_kernel, brick_size, budget);
+	lazy_local_entropy = new brick_utility::BrickStore(*data_field, local_entropy_kernel, brick_size, budget);
+
+	// the extremes cover the boxes prefetched so far
+	max_grad = max_df2 = max_df3 = 0;
+	min_grad = min_df2 = min_df3 = 10000;
+	local_entropy_max = 0;
+}
+
+/// compute the lazy fields of a box ahead and update the extremes with it
+void Volume::prefetchLazyFields(const int * origin, const int * extent)
+{
+	int x, y, z, slab, lower[2], upper[2];
+	unsigned int g, d2, d3;
+	float e;
+	const mask_utility::Span * span, * last;
+	const int end[3] = {origin[0] + extent[0], origin[1] + extent[1], origin[2] + extent[2]};
+
+	if(!lazy_df3 || !lazy_local_entropy)
+		return;
+	if(foreground.empty())
+	{
+		lazy_df3->prefetch(origin, extent);
+		lazy_local_entropy->prefetch(origin, extent);
+	}
+	else
+	{
+		// only the foreground of the box is read by the transfer functions,
+		// its bounding box in each slab of bricks is computed and the bricks of the background are left out
+		const int brick_size = lazy_df3->get_brick_size();
+		for(slab = origin[2] / brick_size * brick_size; slab < end[2]; slab += brick_size)
+		{
+			int slab_origin[3], slab_extent[3];
+			slab_origin[2] = std::max(slab, origin[2]);
+			slab_extent[2] = std::min(slab + brick_size, end[2]) - slab_origin[2];
+			lower[0] = lower[1] = INT_MAX;
+			upper[0] = upper[1] = -1;
+			for(z = slab_origin[2]; z < slab_origin[2] + slab_extent[2]; ++z)
+				for(y = origin[1]; y < end[1]; ++y)
+					for(getForegroundSpans(y, z, span, last); span != last; ++span)
+						if(span->begin < end[0] && span->end > origin[0])
+						{
+							lower[0] = std::min(lower[0], std::max(span->begin, origin[0]));
+							upper[0] = std::max(upper[0], std::min(span->end, end[0]));
+							lower[1] = std::min(lower[1], y);
+							upper[1] = std::max(upper[1], y + 1);
+						}
+			if(upper[0] < 0)
+				continue;
+			slab_origin[0] = lower[0];
+			slab_origin[1] = lower[1];
+			slab_extent[0] = upper[0] - lower[0];
+			slab_extent[1] = upper[1] - lower[1];
+			lazy_df3->prefetch(slab_origin, slab_extent);
+			lazy_local_entropy->prefetch(slab_origin, slab_extent);
+		}
+	}
+
+	for(z = origin[2]; z < end[2]; ++z)
+		for(y = origin[1]; y < end[1]; ++y)
+			for(getForegroundSpans(y, z, span, last); span != last; ++span)
+				for(x = std::max(span->begin, origin[0]); x < std::min(span->end, end[0]); ++x)
+				{
+					g = getGrad(x, y, z);
+					d2 = getDf2(x, y, z);
+					d3 = getDf3(x, y, z);
+					e = getLocalEntropy(x, y, z);
+					max_grad = std::max(max_grad, g);
+					min_grad = std::min(min_grad, g);
+					max_df2 = std::max(max_df2, d2);
+					min_df2 = std::min(min_df2, d2);
+					max_df3 = std::max(max_df3, d3);
+					min_df3 = std::min(min_df3, d3);
+					local_entropy_max = std::max(local_entropy_max, e);
+				}
+}
+
+/// free the lazy fields, the stores derived from others first
+void Volume::releaseLazyFields()
+{
+	delete lazy_local_entropy;
+	delete lazy_df3;
+	delete lazy_df2;
+	delete lazy_gradient;
+	delete data_field;
+	data_field = NULL;
+	lazy_gradient = lazy_df2 = lazy_df3 = lazy_local_entropy = NULL;
 }
 
 /// return data's format
@@ -888,26 +879,27 @@ void Volume::cluster()
 /// calculate some statistical information
 void Volume::statistics(void)
 {
-	int x, y, z;
-	int dim_x, dim_y, dim_z;
-	double total, count;
+	int x, y;
+	statistics_utility::Moments moments;
 
-	ex = total = var = 0.0;
-	count = length * width * height;
-	for(x = 0; x < range;++x)
+	// one parallel pass over the data, exact for any number of voxels
+	if(strcmp(format, "UCHAR") == 0)
+		moments = statistics_utility::compute_array((unsigned char *)data, count);
+	else if(strcmp(format, "USHORT") == 0)
+		moments = statistics_utility::compute_array((unsigned short *)data, count);
+	else
 	{
-		total += int(histogram[x]) * x;
-	
-	}	
-	ex = total / count;
-	for(x = 0; x < range;++x)	
-		var += int(histogram[x]) * (x - ex) * (x - ex);
-	var /= count;
-	var = sqrt(var);
+		printf("Invalid data.\n");
+		return;
+	}
+	ex = moments.mean;
+	var = moments.standard_deviation();
 	cv = var / ex;
 	cout<<"E(f) = "<<ex<<endl;
 	cout<<"Var(f) = "<<var<<endl;
 	cout<<"Cv(f) = "<<cv<<endl;
+	cout<<"Skewness(f) = "<<moments.skewness()<<endl;
+	cout<<"Kurtosis(f) = "<<moments.excess_kurtosis()<<endl;
 	cout<<"max_grad = "<<max_grad<<endl;
 
 	for(x = 1; x <= 11; ++x)
@@ -939,27 +931,32 @@ unsigned int Volume::getMaxFrequency(void)
 /// calculate elasitiy
 void Volume::calEp(void)
 {
-	int x, y, z, index;
-	double f, f1, f2, df_dx, df_dy, df_dz, ep_x, ep_y, ep_z;
-
-	ep = (float *)malloc(sizeof(float) * count);
+	int z;
+	const int X = length, Y = width, Z = height;
+	const mask_utility::Span * span, * last;
 
-	if(ep == NULL)
+	// elasticity spans many orders of magnitude, it is stored in float
+	if(!ep.allocate(count, 0))
 	{
 		cout<<"Not enough space for EP"<<endl;
 		return;
 	}
-	max_ep = 0;
-	min_ep = 100;
-	for(x = 0; x < length; ++x)
-		for(y = 0;y < width; ++y)
-			for(z = 0; z < height; ++z)
-			{
-				index = getIndex(x, y, z);
-				if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height - 1)
-					ep[index] = 0;
-				else
-				{				
+	// set up the spans once, so the threads only read them
+	getForegroundSpans(0, 0, span, last);
+	// the elasticity of the inner voxels of each slice, merged in order after the parallel pass
+	std::vector<statistics_utility::Moments> slice_moments(Z);
+#pragma omp parallel for private(span, last)
+	for(z = 1; z < Z - 1; ++z)
+	{
+		int x, y, index;
+		double f, f1, f2, df_dx, df_dy, df_dz, ep_x, ep_y, ep_z;
+		float e;
+		statistics_utility::Moments & moments = slice_moments[z];
+		for(y = 1;y < Y - 1; ++y)
+			for(getForegroundSpans(y, z, span, last); span != last; ++span)
+				for(x = std::max(span->begin, 1); x < std::min(span->end, X - 1); ++x)
+				{
+					index = getIndex(x, y, z);
 					if(getData(x, y, z) == 0)
 						f = 0.01;
 					else
@@ -967,7 +964,7 @@ void Volume::calEp(void)
 					f1 = getData(x - 1, y, z);
 					f2 = getData(x + 1, y, z);
 					df_dx = (f2 - f1) / 2.0;
-					
+				
 					ep_x = df_dx * double(x) / f;
 
 					f1 = getData(x, y - 1, z);
@@ -979,21 +976,23 @@ void Volume::calEp(void)
 					f2 = getData(x, y, z + 1);
 					df_dz = (f2 - f1) / 2.0;
 					ep_z = df_dz * double(y) / f;
-					ep[index] = sqrt(ep_x * ep_x 
-																+ ep_y * ep_y
-																+ ep_z * ep_z);
-					if(ep[index] > max_ep)
-						max_ep = ep[index];
-					if(ep[index] < min_ep)
-						min_ep = ep[index];
+					e = float(sqrt(ep_x * ep_x 
+								 + ep_y * ep_y
+								 + ep_z * ep_z));
+					ep.set(index, e);
+					moments.add(e);
 				}
-			}
+	}
+	// the boundary voxels stay 0 from allocate
+	statistics_utility::Moments moments = statistics_utility::reduce(slice_moments);
+	max_ep = std::max(float(moments.max), 0.0f);
+	min_ep = moments.count > 0 ? std::min(float(moments.min), 100.0f) : 100.0f;
 }
 
 /// return elasticity at position (x, y, z)
 float Volume::getEp(unsigned int x, unsigned int y, unsigned int z)
 {
-	return ep[getIndex(x, y, z)];
+	return ep.get(getIndex(x, y, z));
 }
 
 /// return maximum elasticity 
@@ -1014,121 +1013,150 @@ unsigned int Volume::getCount()
 	return length * width * height;
 }
 
-/// calculate LH histogram
-void Volume::calLH()
+/// find the steepest neighbor of every voxel in its 26-neighborhood,
+/// a voxel points to itself on the boundary, in flat regions (gradient < little_epsilon) and at extrema
+template <class T>
+static void steepest_neighbor_field(const T * data, const half_utility::HalfField & gradient, float little_epsilon, int length, int width, int height, bool ascend, unsigned int * pointer)
 {
-	int x, y, z, index;
-	int i, j, k, H, L;
-	int current_x, current_y, current_z;
-	int current2_x, current2_y, current2_z;
-	int H_x, H_y, H_z;
-	int L_x, L_y, L_z;
-
-	LH * LH_Histogram = (LH *)malloc(sizeof(LH) * length * width * height);
-	if(LH_Histogram == NULL)
-		cout<<"Not enough space for LH Histogram"<<endl;
+	const int slice = length * width;
+	int z;
 
+#pragma omp parallel for schedule(dynamic)
+	for(z = 0; z < height; ++z)
+	{
+		int x, y, i, j, k;
+		unsigned int index, neighbor, best;
 
-	for(x = 0; x < length; ++x)
 		for(y = 0; y < width; ++y)
-			for(z = 0; z < height; ++z)
+			for(x = 0; x < length; ++x)
 			{
-				index = getIndex(x, y, z);
+				index = z * slice + y * length + x;
+				pointer[index] = index;
 				if(x == 0 || x == length - 1 || y == 0 || y == width - 1 || z == 0 || z == height - 1)
-					LH_Histogram[index].FH = LH_Histogram[index].FL = getData(x, y, z);
-				else if(getGrad(x, y, z) < little_epsilon)
-					LH_Histogram[index].FH = LH_Histogram[index].FL = getData(x, y, z);
-				else
-				{
-				//	cout<<"OK"<<endl;
-					current_x = x;
-					current_y = y;
-					current_z = z;
-					do
-					{
-						H = getData(current_x, current_y, current_z);
-				//		cout<<"H = "<<H<<endl;
-						for(i = current_x - 1;i <= current_x + 1; ++i)
+					continue;
+				if(!gradient.empty() && gradient.get(index) < little_epsilon)
+					continue;
+
+				// only strictly higher (lower) neighbors are taken, so the field has no cycles
+				best = index;
+				for(k = -1; k <= 1; ++k)
+					for(j = -1; j <= 1; ++j)
+						for(i = -1; i <= 1; ++i)
 						{
-							for(j = current_y - 1; j <= current_y +1; ++j)
-							{
-								for(k = current_z - 1; k <= current_z + 1; ++k)
-								{
-									if(i < 0 || i > length - 1 || j < 0 || j > width - 1 || z < 0 || z > height - 1)
-									{
-						//				cout<<"Not ok"<<endl;;
-										goto tag1;
-									}
-									if(getData(i, j, k) >= H)
-									{
-						//				cout<<"Higher"<<endl;
-										H = getData(i, j, k);
-										H_x = i;
-										H_y = j;
-										H_z = k;
-					//					cout<<i<<", "<<j<<", "<<k<<endl;
-									}
-								}
-							}
-					 }
-								current_x = H_x;
-								current_y = H_y;
-								current_z = H_z;
-								if(current_x < 0 || current_y > length -1 || current_y < 0 || current_y > width - 1 || current_z < 0 || current_z > height -1)
-									goto tag1;
-					}while(getGrad(current_x, current_y, current_z) >= little_epsilon 
-						     );
-					tag1 : ; 
-					cout<<"break out"<<endl;
-
-					current_x = x;
-					current_y = y;
-					current_z = z;
-					do
-					{
-						L = getData(current_x, current_y, current_z);
-						for(i = current_x - 1;i <= current_x + 1; ++i)
-							for(j = current_y - 1; j <= current_y +1; ++j)
-								for(k = current_z - 1; k <= current_z + 1; ++k)
-								{
-									if(i < 0 || i > length - 1 || j < 0 || j > width - 1 || z < 0 || z > height - 1)
-									{
-										cout<<"Not ok";
-										goto tag2;
-									}	
-									if(i == current_x && j == current_y && k == current_z)
-										break;
-									if(getData(i, j, k) <= L)
-									{
-										L = getData(i, j, k);
-										L_x = i;
-										L_y = j;
-										L_z = k;
-									}
-								}
-								current_x = L_x;
-								current_y = L_y;
-								current_z = L_z;
-					}while(
-						      getGrad(current_x, current_y, current_z) >= little_epsilon);
-					cout<<"break out 2"<<endl;
-					tag2: ;
-					LH_Histogram[index].FH = H;
-					LH_Histogram[index].FL = L;
-
-					cout<<"H = "<<H<<", L = "<<L<<endl;
-				}
+							neighbor = index + k * slice + j * length + i;
+							if(ascend ? (data[neighbor] > data[best]) : (data[neighbor] < data[best]))
+								best = neighbor;
+						}
+				pointer[index] = best;
 			}
-			for(x = 0; x < length; ++x)
-				for(y = 0; y  < width; ++y)
-					for(z = 0; z < height; ++z)
-					{
-						index = getIndex(x, y, z);
-						if(LH_Histogram[index].FH != LH_Histogram[index].FL)
-						cout<<"X = "<<x<<",  Y = "<<y<<" ,  Z = "<<z<<" , FH = "
-							<<LH_Histogram[index].FH<<endl;
-					//		" , FL = "<<LH_Histogram[index].FL<<endl;
-					}
+	}
+}
+
+/// resolve the steepest neighbor field into its roots by path compression, 
+/// afterwards every voxel points directly at the peak (or basin) it flows to
+static void resolve_pointer_field(unsigned int * pointer, unsigned int count)
+{
+	unsigned int i, root, current, next;
+
+	for(i = 0; i < count; ++i)
+	{
+		root = i;
+		while(pointer[root] != root)
+			root = pointer[root];
+
+		// compress the path, the voxels on it are never walked again
+		current = i;
+		while(pointer[current] != root)
+		{
+			next = pointer[current];
+			pointer[current] = root;
+			current = next;
+		}
+	}
+}
+
+/// compute FH by steepest ascent and FL by steepest descent for all the voxels
+template <class T>
+static void calculate_LH(const T * data, const half_utility::HalfField & gradient, float little_epsilon, int length, int width, int height, unsigned int * pointer, LH * LH_Histogram)
+{
+	const int count = length * width * height;
+	int i;
+
+	steepest_neighbor_field(data, gradient, little_epsilon, length, width, height, true, pointer);
+	resolve_pointer_field(pointer, count);
+#pragma omp parallel for
+	for(i = 0; i < count; ++i)
+		LH_Histogram[i].FH = data[pointer[i]];
+
+	steepest_neighbor_field(data, gradient, little_epsilon, length, width, height, false, pointer);
+	resolve_pointer_field(pointer, count);
+#pragma omp parallel for
+	for(i = 0; i < count; ++i)
+		LH_Histogram[i].FL = data[pointer[i]];
+}
+
+/// calculate LH histogram
+void Volume::calLH()
+{
+	unsigned int * pointer;
+
+	if(LH_Histogram)
+	{
+		free(LH_Histogram);
+		LH_Histogram = NULL;
+	}
+	LH_Histogram = (LH *)malloc(sizeof(LH) * count);
+	if(LH_Histogram == NULL)
+	{
+		cout<<"Not enough space for LH Histogram"<<endl;
+		return;
+	}
+
+	// the steepest neighbor field, reused for ascent and descent
+	pointer = (unsigned int *)malloc(sizeof(unsigned int) * count);
+	if(pointer == NULL)
+	{
+		cout<<"Not enough space for LH Histogram"<<endl;
+		free(LH_Histogram);
+		LH_Histogram = NULL;
+		return;
+	}
+
+	if(gradient.empty())
+		cout<<"Gradient magnitude is not calculated, LH paths only stop at extrema"<<endl;
+
+	if(strcmp(format, "UCHAR") == 0)
+		calculate_LH((unsigned char *)data, gradient, little_epsilon, length, width, height, pointer, LH_Histogram);
+	else if(strcmp(format, "USHORT") == 0)
+		calculate_LH((unsigned short *)data, gradient, little_epsilon, length, width, height, pointer, LH_Histogram);
+	else
+	{
+		printf("Invalid data.\n");
+		free(LH_Histogram);
+		LH_Histogram = NULL;
+	}
+
+	free(pointer);
+}
+
+/// return FL of the LH histogram at (x, y, z), the LH histogram is calculated on the first call
+unsigned short Volume::getFL(unsigned int x, unsigned int y, unsigned int z)
+{
+	if(LH_Histogram == NULL)
+		calLH();
+	if(LH_Histogram == NULL)
+		return 0;
+	return LH_Histogram[getIndex(x, y, z)].FL;
+}
+
+/// return FH of the LH histogram at (x, y, z), the LH histogram is calculated on the first call
+unsigned short Volume::getFH(unsigned int x, unsigned int y, unsigned int z)
+{
+	if(LH_Histogram == NULL)
+		calLH();
+	if(LH_Histogram == NULL)
+		return 0;
+	return LH_Histogram[getIndex(x, y, z)].FH;
 }
 
 /// calculate intensity-gradient magnitude scatter plot
@@ -1320,50 +1348,49 @@ void Volume::filter()
 /// calculate average value and deviation value
 void Volume::average_deviation()
 {
-	int i, j, k, p, q, r, index;
-	float a, d, d_max = 0;
+	int k;
+	const int X = getX(), Y = getY(), Z = getZ();
+	const mask_utility::Span * span, * last;
 	
-	max_variation = 0;
-	average = (float *)malloc(sizeof(float) * getCount());
-	variation = (float *)malloc(sizeof(float) * getCount());
+	// averages of values in [0, range) stay below range, variances are stored in float
+	if(!average.allocate(getCount(), float(range)) || !variation.allocate(getCount(), 0))
+	{
+		cout<<"Not enough space for average and variation"<<endl;
+		return;
+	}
+	// set up the spans once, so the threads only read them
+	getForegroundSpans(0, 0, span, last);
+	// the variations of each slice, merged in order after the parallel pass
+	std::vector<statistics_utility::Moments> slice_moments(Z);
 //	ofstream file("E:\\d4_ad.csv", std::ios::out);
-	for(i = 0;i < getX(); ++i)
-		for(j = 0; j < getY(); ++j)
-			for(k = 0; k < getZ(); ++k)
-			{
-				index =getIndex(i ,j, k);
-				if(i == 0 || i == getX() - 1|| j == 0 || j == getY() - 1 || k == 0 || k == getZ() - 1)
-				{						
-					a = d = 0; 
-					average[index] = variation[index] = 0;
-				//	file<<a<<", "<<d<<endl;
-				}
-				else
+#pragma omp parallel for private(span, last)
+	for(k = 1; k < Z - 1; ++k)
+	{
+		int i, j, p, q, r, n;
+		float values[27];
+		statistics_utility::Moments & moments = slice_moments[k];
+		for(j = 1; j < Y - 1; ++j)
+		{
+			getForegroundSpans(j, k, span, last);
+			for(; span != last; ++span)
+				for(i = std::max(span->begin, 1); i < std::min(span->end, X - 1); ++i)
 				{
-					a = d = 0;
+					// mean and variance of the neighbourhood from shifted sums in double,
+					// the boundary voxels stay 0 from allocate
+					n = 0;
 					for(p = i - 1;p <= i + 1;++p)
 						for(q = j - 1; q <= j + 1; ++q)
 							for(r = k - 1; r <= k + 1; ++r)
-								a += float(getData(p, q, r));
-					a /= 27;
-					average[index] = a;
-					for(p = i - 1;p <= i + 1;++p)
-						for(q = j - 1; q <= j + 1; ++q)
-							for(r = k - 1; r <= k + 1; ++r)
-								d += pow(double(getData(p, q, r)) - a, 2.0);
-					d /= 27.0;
-					variation[index] = d;
-					if(d > max_variation)
-						max_variation = d;
-		//			cout<<a<<d<<endl;
-		//			if(d > 0 && a != 0)
-		//				file<<a<<", "<<d<<endl;
-				
-			//		cout<<i<<", "<<j<<", "<<k<<",  a = "<<a<<", d = "<<d<<endl;
-					
+								values[n++] = float(getData(p, q, r));
+					statistics_utility::Moments local = statistics_utility::block_moments(statistics_utility::ArrayAttribute<float>(values), 0, 27);
+					average.set(getIndex(i, j, k), float(local.mean));
+					variation.set(getIndex(i, j, k), float(local.variance()));
+					moments.add(local.variance());
+				//	file<<local.mean<<", "<<local.variance()<<endl;
 				}
-			}
-		//	cout<<d_max<<endl;
+		}
+	}
+	max_variation = std::max(float(statistics_utility::reduce(slice_moments).max), 0.0f);
 }
 
 /// calculate local entropy of all the voxels
@@ -1371,11 +1398,14 @@ void Volume::calLocalEntropy()
 {
 	int x, y, z, index, i, j, k, p;
 	float sum, prob;
+	const mask_utility::Span * span, * last;
 
-	local_entropy = (float *)malloc(sizeof(float) * getCount());
-
-	if(local_entropy == NULL)
+	// the entropy of 27 values is at most log(27)
+	if(!local_entropy.allocate(getCount(), 4.0f))
+	{
 		cout<<"Not enough space for local entropy"<<endl;
+		return;
+	}
 
 	typedef struct 
 	{
@@ -1390,37 +1420,41 @@ void Volume::calLocalEntropy()
 	local_entropy_max = 0;
 
 
-	for(x = 0; x < getX(); ++x)
+	for(z = 0; z < getZ(); ++z)
 		for(y = 0; y < getY(); ++y)
-			for(z = 0; z < getZ(); ++z)
-			{
-				for(i = 0; i < 65536; ++i)
-					num[i] = 0;
-				index = getIndex(x, y, z);
-				if(x == 0 || x == getX() - 1 || y == 0 || y == getY() - 1 || z == 0 || z == getZ() - 1)
-					local_entropy[index] = 0;
-				else
+		{
+			getForegroundSpans(y, z, span, last);
+			for(; span != last; ++span)
+				for(x = span->begin; x < span->end; ++x)
 				{
-					for(i = x - 1; i <= x + 1; ++i)
-						for(j = y - 1;j <= y + 1; ++j)
-							for(k = z - 1; k <= z + 1; ++k)
+					for(i = 0; i < 65536; ++i)
+						num[i] = 0;
+					index = getIndex(x, y, z);
+					if(x == 0 || x == getX() - 1 || y == 0 || y == getY() - 1 || z == 0 || z == getZ() - 1)
+						local_entropy.set(index, 0);
+					else
+					{
+						for(i = x - 1; i <= x + 1; ++i)
+							for(j = y - 1;j <= y + 1; ++j)
+								for(k = z - 1; k <= z + 1; ++k)
+								{
+									p = getData(i, j, k);
+									num[p]++;
+								}
+						sum = 0;
+						for(i = 0;i < 65536; ++i)
+						{
+							if(num[i] != 0)
 							{
-								p = getData(i, j, k);
-								num[p]++;
+								prob = float(num[i]) / 27.0;
+								sum += (-prob) * log(prob);
 							}
-				sum = 0;
-				for(i = 0;i < 65536; ++i)
-				{
-					if(num[i] != 0)
-					{
-						prob = float(num[i]) / 27.0;
-						sum += (-prob) * log(prob);
+						}
+						local_entropy.set(index, sum);
+						if(sum > local_entropy_max)
+							local_entropy_max = sum;
 					}
 				}
-				local_entropy[index] = sum;
-				if(sum > local_entropy_max)
-					local_entropy_max = sum;
-			}
 		}
 }
 
@@ -1429,7 +1463,9 @@ float Volume::getLocalEntropy(unsigned int x, unsigned int y, unsigned int z)
 {
 	int index = getIndex(x, y, z);
 
-	return local_entropy[index];
+	if(local_entropy.empty() && lazy_local_entropy)
+		return lazy_local_entropy->get(x, y, z);
+	return local_entropy.get(index);
 }
 
 /// return maximum local entropy
@@ -1444,15 +1480,11 @@ void Volume::calAverage()
 	int x, y, z, i, j, k, index;
 	float sum;
 
-	average = (float *)malloc(sizeof(float) * getCount());
-
-	for(x = 0; x < getX(); ++x)
-		for(y = 0; y < getY(); ++y)
-			for(z = 0; z < getZ(); ++z)
-			{
-				index = getIndex(x, y, z);
-				average[index] = 0;
-			}
+	if(!average.allocate(getCount(), float(range)))
+	{
+		cout<<"Not enough space for average"<<endl;
+		return;
+	}
 	for(x = 0; x < getX(); ++x)
 		for(y = 0; y < getY(); ++y)
 			for(z = 0; z < getZ(); ++z)
@@ -1461,7 +1493,7 @@ void Volume::calAverage()
 				if(x == 0 || x == getX() - 1 
 				  || y ==0 || y == getY() - 1 
 				  || z == 0 || z == getZ() - 1)
-					average[index] = 0;
+					average.set(index, 0);
 				else
 				{
 					sum = 0;	
@@ -1470,7 +1502,7 @@ void Volume::calAverage()
 								for(k = z - 1; k <= z + 1; ++k)
 									sum += getData(x, y, z);
 					sum /= 27.0;
-					average[index] = sum;
+					average.set(index, sum);
 				}
 			}
 }
@@ -1480,7 +1512,7 @@ float Volume::getAverage(unsigned int x, unsigned int y, unsigned int z)
 {
 	int index = getIndex(x, y, z);
 
-	return average[index];
+	return average.get(index);
 }
 
 void Volume::calVariation()
@@ -1489,15 +1521,11 @@ void Volume::calVariation()
 	float sum, a;
 
 	max_variation = 0;
-	variation = (float *)malloc(sizeof(float) * getCount());
-
-	for(x = 0; x < getX(); ++x)
-		for(y = 0; y < getY(); ++y)
-			for(z = 0; z < getZ(); ++z)
-			{
-				index = getIndex(x, y, z);
-				variation[index] = 0;
-			}
+	if(!variation.allocate(getCount(), 0))
+	{
+		cout<<"Not enough space for variation"<<endl;
+		return;
+	}
 
 	for(x = 0; x < getX(); ++x)
 		for(y = 0; y < getY(); ++y)
@@ -1507,7 +1535,7 @@ void Volume::calVariation()
 				if(x == 0 || x == getX() - 1 
 					|| y ==0 || y == getY() - 1 
 					|| z == 0 || z == getZ() - 1)
-					variation[index] = 0;
+					variation.set(index, 0);
 				else
 				{
 					sum = 0;	
@@ -1517,9 +1545,9 @@ void Volume::calVariation()
 							for(k = z - 1; k <= z + 1; ++k)
 								sum += pow(double(a - getData(i, j, k)), 2.0);
 					sum /= 27.0;
-					variation[index] = sum;
+					variation.set(index, sum);
 					if(sum == 0)
-						variation[index] = 1e-4;
+						variation.set(index, 1e-4f);
 					if(sum > max_variation)
 						max_variation = sum;
 				}
@@ -1531,7 +1559,7 @@ float Volume::getVariation(unsigned int x, unsigned int y, unsigned int z)
 {
 	int index = getIndex(x, y, z);
 
-	return variation[index];
+	return variation.get(index);
 }
 
 /// return maximum variation of the dataset
@@ -1539,3 +1567,138 @@ float Volume::getMaxVariation()
 {
 	return max_variation;
 }
+
+/// copy 8/16-bit data to float
+template <class T>
+static void convert_to_float(const T * data, unsigned int count, float * out)
+{
+	int i, n = (int)count;
+
+#pragma omp parallel for
+	for(i = 0; i < n; ++i)
+		out[i] = float(data[i]);
+}
+
+/// separate the foreground from the background
+void Volume::calForegroundMask(float percentile, int radius)
+{
+	const int sizes[3] = {int(length), int(width), int(height)};
+	std::vector<float> scalar(count);
+
+	if(strcmp(format, "UCHAR") == 0)
+		convert_to_float((unsigned char *)data, count, &scalar[0]);
+	else if(strcmp(format, "USHORT") == 0)
+		convert_to_float((unsigned short *)data, count, &scalar[0]);
+	else
+	{
+		printf("Invalid data.\n");
+		return;
+	}
+
+	foreground.build(&scalar[0], sizes, mask_utility::percentile_threshold(&scalar[0], count, percentile));
+	foreground.open(radius);
+	foreground.close(radius);
+	grown_foreground[0] = foreground;
+	grown_foreground[0].dilate(1);
+	grown_foreground[1] = grown_foreground[0];
+	grown_foreground[1].dilate(1);
+	cout<<"Foreground: "<<foreground.get_foreground_count()<<" of "<<count<<" voxels"<<endl;
+}
+
+/// return the foreground spans of a row
+void Volume::getForegroundSpans(unsigned int y, unsigned int z, const mask_utility::Span *& first, const mask_utility::Span *& last, int margin)
+{
+	if(foreground.empty())
+	{
+		if(whole_row.end != int(length))
+		{
+			whole_row.begin = 0;
+			whole_row.end = length;
+		}
+		first = &whole_row;
+		last = &whole_row + 1;
+	}
+	else if(margin > 0)
+		grown_foreground[std::min(margin, 2) - 1].get_spans(y, z, first, last);
+	else
+		foreground.get_spans(y, z, first, last);
+}
+
+/// calculate the Hessian eigenvalues, vesselness and planarness
+void Volume::calHessian(float sigma)
+{
+	const int sizes[3] = {int(length), int(width), int(height)};
+	std::vector<float> scalar(count);
+
+	if(strcmp(format, "UCHAR") == 0)
+		convert_to_float((unsigned char *)data, count, &scalar[0]);
+	else if(strcmp(format, "USHORT") == 0)
+		convert_to_float((unsigned short *)data, count, &scalar[0]);
+	else
+	{
+		printf("Invalid data.\n");
+		return;
+	}
+
+	// eigenvalues are bounded by the norm of the Hessian, second differences stay below 4 * range
+	if(!hessian_eigenvalue[0].allocate(count, 8.0f * range) || !hessian_eigenvalue[1].allocate(count, 8.0f * range)
+		|| !hessian_eigenvalue[2].allocate(count, 8.0f * range) || !vesselness.allocate(count, 1) || !planarness.allocate(count, 1))
+	{
+		cout<<"Not enough space for Hessian"<<endl;
+		return;
+	}
+
+	std::vector<float> e1(count), e2(count), e3(count);
+	{
+		tensor_utility::TensorField hessian;
+		tensor_utility::hessian(&scalar[0], sizes, sigma, hessian);
+		if(foreground.empty())
+			tensor_utility::eigenvalues(hessian, &e1[0], &e2[0], &e3[0]);
+		else
+		{
+			// the recursive Gaussians run along whole lines, only the eigenvalues are restricted to the foreground,
+			// the background keeps eigenvalues 0 and so vesselness and planarness 0
+			const mask_utility::Span * span, * last;
+			int z;
+#pragma omp parallel for private(span, last)
+			for(z = 0; z < sizes[2]; ++z)
+				for(int y = 0; y < sizes[1]; ++y)
+					for(foreground.get_spans(y, z, span, last); span != last; ++span)
+					{
+						const int first = getIndex(span->begin, y, z), n = span->end - span->begin;
+						tensor_utility::eigenvalues_batch(&hessian.xx[first], &hessian.xy[first], &hessian.xz[first], &hessian.yy[first], &hessian.yz[first], &hessian.zz[first],
+							n, &e1[first], &e2[first], &e3[first]);
+					}
+		}
+	}
+
+	// the feature values are written over the scalar data, which is not needed any more
+	std::vector<float> &feature = scalar;
+	const tensor_utility::ShapeMeasure measure(0.5f, 0.5f, 0.5f * tensor_utility::max_structureness(&e1[0], &e2[0], &e3[0], count));
+	tensor_utility::shape_features(&e1[0], &e2[0], &e3[0], count, measure, &feature[0], NULL);
+	vesselness.set(0, &feature[0], count);
+	tensor_utility::shape_features(&e1[0], &e2[0], &e3[0], count, measure, NULL, &feature[0]);
+	planarness.set(0, &feature[0], count);
+
+	hessian_eigenvalue[0].set(0, &e1[0], count);
+	hessian_eigenvalue[1].set(0, &e2[0], count);
+	hessian_eigenvalue[2].set(0, &e3[0], count);
+}
+
+/// return the i-th largest Hessian eigenvalue at position (x, y, z)
+float Volume::getHessianEigenvalue(unsigned int x, unsigned int y, unsigned int z, int i)
+{
+	return hessian_eigenvalue[i].get(getIndex(x, y, z));
+}
+
+/// return vesselness at position (x, y, z)
+float Volume::getVesselness(unsigned int x, unsigned int y, unsigned int z)
+{
+	return vesselness.get(getIndex(x, y, z));
+}
+
+/// return planarness at position (x, y, z)
+float Volume::getPlanarness(unsigned int x, unsigned int y, unsigned int z)
+{
+	return planarness.get(getIndex(x, y, z));
+}
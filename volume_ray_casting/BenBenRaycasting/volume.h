@@ -9,6 +9,10 @@
 #include <cstdlib>
 #include <cmath>
 
+#include "../my_raycasting/half_utility.h"
+#include "../my_raycasting/brick_utility.h"
+#include "../my_raycasting/mask_utility.h"
+
 /**	@brief	rgb triple to store r, g, b color component
 *	
 *	
@@ -72,22 +76,30 @@ protected:
 	unsigned int * histogram;            
 	/// number of bytes of the data type
 	unsigned short dataTypeSize;         
-	/// gradient magnitude
-	unsigned int * gradient;             
+	/// gradient magnitude, the derived attributes are stored as half floats for 8-bit data and as floats for 16-bit data
+	half_utility::HalfField gradient;
 	/// second derivative
-	unsigned int * df2;                             
+	half_utility::HalfField df2;
 	/// third derivative
-	unsigned int * df3;                      
+	half_utility::HalfField df3;
 	/// color in rgb space
 	Color * color;                            
 	/// opacity
 	float * opacity;                         
 	/// local entropy
-	float * local_entropy;                
+	half_utility::HalfField local_entropy;
 	/// statistical property average
-	float * average;                        
-	/// statistical property variation
-	float * variation;                       
+	half_utility::HalfField average;
+	/// statistical property variation, in float because it has no tight bound
+	half_utility::FloatField variation;
+	/// eigenvalues of the Hessian in descending order, and the vesselness and planarness derived from them
+	half_utility::HalfField hessian_eigenvalue[3], vesselness, planarness;
+	/// foreground voxels, the analysis passes skip the rest when it is built
+	mask_utility::ForegroundMask foreground;
+	/// the foreground grown by 1 and 2 voxels, where the derivatives read by the next derivative are computed
+	mask_utility::ForegroundMask grown_foreground[2];
+	/// the span of a whole row, for passes without a foreground mask
+	mask_utility::Span whole_row;
 	/// store maximum local entropy
 	float local_entropy_max;         
 	/// store maximum variation
@@ -103,12 +115,18 @@ protected:
 	unsigned int max_grad, max_df2, max_df3, min_grad, min_df2, min_df3, max_frequency; 
 	/// maximum and minimum elasticity
 	float max_ep, min_ep;                               
-	float * ep, little_epsilon;
+	/// elasticity, in float because it has no tight bound
+	half_utility::FloatField ep;
+	float little_epsilon;
 	float * acc_distribution;
 	int intensity_gradient_histogram[12][12];
 	float spatial_distribution[12][12];
 	/// LH histogram
 	LH * LH_Histogram;                                
+	/// the data as a field, source of the fields computed per brick on demand
+	brick_utility::Field * data_field;
+	/// gradient, second and third derivative and local entropy computed per brick on demand
+	brick_utility::BrickStore * lazy_gradient, * lazy_df2, * lazy_df3, * lazy_local_entropy;
 public:
 	Volume()
 	{
@@ -118,18 +136,16 @@ public:
 		min_df2 = min_df3 = max_ep = min_ep = 0;
 		data = NULL;
 		local_entropy_max = 0;
-		local_entropy = NULL;
+		whole_row.begin = whole_row.end = 0;
 		histogram = NULL;
 		color = NULL;
 		opacity = NULL;
 		group = NULL;
 		tag = NULL;
-		gradient = NULL;
-		df2 = NULL;
-		df3 = NULL;
-		average = NULL;
-		variation = NULL;
+		LH_Histogram = NULL;
 		little_epsilon = 10;
+		data_field = NULL;
+		lazy_gradient = lazy_df2 = lazy_df3 = lazy_local_entropy = NULL;
 	}
 	virtual ~Volume()
 	{
@@ -137,22 +153,15 @@ public:
 			free(data);
 		if(histogram)
 			free(histogram);
-		if(gradient)
-			free(gradient);
 		if(opacity)
 			free(opacity);
 		if(group)
 			free(group);
 		if(tag)	
 			free(tag);
-		if(df2)
-			free(df2);
-		if(df3)
-			free(df3);
-		if(average)
-			free(average);
-		if(variation)
-			free(variation);
+		if(LH_Histogram)
+			free(LH_Histogram);
+		releaseLazyFields();
 	}
 
 	/**	@brief	read data discription file, .dat file format 
@@ -200,6 +209,28 @@ public:
 	*/
 	void calGrad_ex();                   //use f(x) = a * exp(bx)
 
+	/**	@brief	compute gradient, second and third derivative and local entropy per brick, when they are read
+	*	
+	*	Until calGrad, calDf2, calDf3 or calLocalEntropy computes a whole field, its getter reads from bricks of
+	*	brick_size^3 voxels that are computed the first time they are touched and cached in budget bytes per field.
+	*	The getters return the values of the eager passes, except at the volume boundary, where the lazy fields
+	*	use one-sided differences and clamped neighbourhoods. The maxima and minima cover the prefetched boxes.
+	*/
+	void useLazyFields(int brick_size = 32, size_t budget = 64 << 20);
+
+	/**	@brief	compute the lazy fields of the box [origin, origin + extent) on all threads, ahead of a pass over it,
+	*	and include the box in the maxima and minima of the fields
+	*	
+	*	With a foreground mask only the bricks around the foreground of the box are computed and the extremes
+	*	cover its foreground, the transfer functions read no other voxels.
+	*/
+	void prefetchLazyFields(const int * origin, const int * extent);
+
+	/**	@brief	free the lazy fields
+	*	
+	*/
+	void releaseLazyFields();
+
 	/**	@brief	calculate elasticity of all the voxels to approximate gradient magnitude
 	*	
 	*/
@@ -210,6 +241,18 @@ public:
 	*/
 	void calLH();
 
+	/**	@brief	return FL of the LH histogram at (x, y, z)
+	*	
+	*	calLH is called first if the LH histogram is not calculated, 0 is returned if that fails.
+	*/
+	unsigned short getFL(unsigned int x, unsigned int y, unsigned int z);
+
+	/**	@brief	return FH of the LH histogram at (x, y, z)
+	*	
+	*	calLH is called first if the LH histogram is not calculated, 0 is returned if that fails.
+	*/
+	unsigned short getFH(unsigned int x, unsigned int y, unsigned int z);
+
 	/**	@brief	calculate local entropy of all the voxels
 	*	
 	*/
@@ -225,6 +268,27 @@ public:
 	*/
 	void calVariation();
 
+	/**	@brief	separate the foreground from the background (air)
+	*	
+	*	Voxels below the value at the given percentile of the histogram are background, the mask is cleaned up by
+	*	opening and closing with the given radius. The analysis passes (calGrad, calDf2, calDf3, calEp, calHessian,
+	*	calLocalEntropy, average_deviation) and the transfer functions then only visit the foreground and leave
+	*	the background at 0. The gradient is computed 2 voxels and the second derivative 1 voxel beyond the
+	*	foreground, so that the derivatives of the foreground voxels read no skipped neighbours.
+	*/
+	void calForegroundMask(float percentile, int radius = 1);
+
+	/**	@brief	return the foreground spans [first, last) of the row (y, z), the whole row if there is no foreground mask
+	*	
+	*	margin (0, 1 or 2) selects the foreground grown by that many voxels.
+	*/
+	void getForegroundSpans(unsigned int y, unsigned int z, const mask_utility::Span *& first, const mask_utility::Span *& last, int margin = 0);
+
+	/**	@brief	calculate the eigenvalues of the Hessian at scale sigma, and the vesselness and planarness of bright structures
+	*	
+	*/
+	void calHessian(float sigma);
+
 	/**	@brief	calculate intensity-gradient magnitude scatter plot
 	*	
 	*/
@@ -265,6 +329,21 @@ public:
 	*/
 	float getVariation(unsigned int x, unsigned int y, unsigned int z);
 
+	/**	@brief	return the i-th largest eigenvalue of the Hessian at position (x, y, z), i = 0, 1, 2
+	*	
+	*/
+	float getHessianEigenvalue(unsigned int x, unsigned int y, unsigned int z, int i);
+
+	/**	@brief	return vesselness at position (x, y, z), in [0, 1]
+	*	
+	*/
+	float getVesselness(unsigned int x, unsigned int y, unsigned int z);
+
+	/**	@brief	return planarness at position (x, y, z), in [0, 1]
+	*	
+	*/
+	float getPlanarness(unsigned int x, unsigned int y, unsigned int z);
+
 	/**	@brief	return maximum variation of the dataset
 	*	
 	*/
@@ -67,7 +67,7 @@ bool LoadData(CxFuzzyCMeans& filter)
 		p.pattern.push_back(b);
 		p.pattern.push_back(c);
 		p.pattern.push_back(d);
-		filter.m_ArrayPattern.push_back(p);
+		filter.AddPattern(p);
 
 	}
 	infile.close();
@@ -32,7 +32,10 @@ CxCluster::CxCluster(int nPattern, int nDim, int nCluster)
 	m_nDim = nDim;
 	m_nCluster = nCluster;
 
-	m_ArrayPattern.reserve(nPattern);
+	m_MatPattern.Reserve(nPattern, nDim);
+	m_MatCenter.Resize(nCluster, nDim);
+	m_Points.resize((size_t)nPattern * nDim);
+	m_Centers.resize(nCluster * nDim);
 	m_ArrayCluster.resize(nCluster);
 	m_label_ptr = NULL;
 
@@ -40,6 +43,35 @@ CxCluster::CxCluster(int nPattern, int nDim, int nCluster)
 
 }
 
+void CxCluster::AddPattern(const Pattern& p)
+{
+	m_MatPattern.AppendRow(p.pattern);
+
+	int r = m_MatPattern.Rows() - 1;
+	assert ( r < NumPatterns() );
+	for(int d=0; d<GetDim(); ++d)
+		m_Points[(size_t)d*NumPatterns() + r] = (float)p.pattern[d];
+}
+
+void CxCluster::SetCenter(int c, const double* center)
+{
+	double* row = m_MatCenter.Row(c);
+	vector<double>& v = m_ArrayCluster.at(c).center;
+	v.resize(GetDim());
+
+	for(int d=0; d<GetDim(); ++d)
+	{
+		row[d] = center[d];
+		v[d] = center[d];
+		m_Centers[c*GetDim() + d] = (float)center[d];
+	}
+}
+
+void CxCluster::CalSquaredDistances(int first, int n, float* dist)
+{
+	clustering::Distance_Kernel<>::distances(&m_Points[first], NumPatterns(), GetDim(), &m_Centers[0], NumClusters(), n, dist, n);
+}
+
 double CxCluster::CalEuclideanNorm(const vector<double> &p1, const vector<double> &p2)
 {
 	assert( p1.size() == p2.size() );
@@ -56,28 +88,20 @@ double CxCluster::CalEuclideanNorm(const vector<double> &p1, const vector<double
 double CxCluster::CalEuclideanNorm(int c, // 
 								   int p) // ;
 {
-	const vector<double>& center = m_ArrayCluster.at(c).center;
-	const vector<double>& sample = m_ArrayPattern.at(p).pattern;
+	float dist;
+	clustering::Distance_Kernel<>::distances(&m_Points[p], NumPatterns(), GetDim(), &m_Centers[c*GetDim()], 1, 1, &dist, 1);
 
-	return CalEuclideanNorm(center, sample);
+	return sqrt((double)dist);
 }
 
 // ľ; ԭ;
 int CxCluster::FindClosestCluster(int p)
 {
-	double minDist = numeric_limits<double>::max();
+	float dist;
 	int clusterID = -1;
-	double dist;
 
-	for ( int c=0; c<NumClusters(); ++c )
-	{
-		dist = CalEuclideanNorm(c, p);
-		if ( dist < minDist )
-		{
-			minDist = dist;
-			clusterID = c;
-		}
-	}
+	// the squared distances are ordered as the distances
+	clustering::Distance_Kernel<>::nearest(&m_Points[p], NumPatterns(), GetDim(), &m_Centers[0], NumClusters(), 1, &dist, &clusterID);
 
 	assert ( clusterID >= 0 );
 
@@ -93,11 +117,10 @@ void CxCluster::InitClusters()
 
 	for ( int i=0; i<NumClusters(); ++i )
 	{
-		const Pattern& p = m_ArrayPattern.at(i);
 		Cluster c; 
-		c.center = p.pattern;
 		c.member.push_back(i);
 		m_ArrayCluster[i] = c;
+		SetCenter(i, m_MatPattern.Row(i));
 	}
 
 	return ;
@@ -112,14 +135,19 @@ void CxCluster::DistributeSamples()
 		m_ArrayCluster.at(k).member.clear();
 	}
 
-	int sizes = (int)m_ArrayPattern.size();
-	for (int i=0; i<sizes; ++i )
+	int sizes = m_MatPattern.Rows();
+	vector<float> dist(DISTANCE_BLOCK);
+	vector<int> id(DISTANCE_BLOCK);
+	for (int first=0; first<sizes; first+=DISTANCE_BLOCK )
 	{
-		//Find cluster center to which the pattern is closest
-		int id = FindClosestCluster(i);
+		int n = (sizes - first < DISTANCE_BLOCK) ? sizes - first : DISTANCE_BLOCK;
+
+		//Find cluster centers to which the patterns are closest
+		clustering::Distance_Kernel<>::nearest(&m_Points[first], NumPatterns(), GetDim(), &m_Centers[0], NumClusters(), n, &dist[0], &id[0]);
 
-		//add this pattern to the cluster
-		m_ArrayCluster.at(id).member.push_back(i);
+		//add these patterns to the clusters
+		for (int i=0; i<n; ++i )
+			m_ArrayCluster.at(id[i]).member.push_back(first + i);
 
 	}
 }
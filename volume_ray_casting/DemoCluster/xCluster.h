@@ -16,7 +16,12 @@
 
 #include <vector>
 using std::vector;
+
+#include "xMatrix.h"
+#include "../my_raycasting/Distance_Kernel.h"
+
 const double EPISLON = 0.000001;
+const int DISTANCE_BLOCK = 256; // patterns whose distances are computed together
 
 
 struct Pattern  // ;
@@ -54,6 +59,17 @@ protected:
 	//Сھ,󻯾ۼ
 	double CalFitCostMinMax(double w1 = 0.5, double w2 = 0.5);
 
+	CxMatrix m_MatCenter; // cluster centers, one per row, kept equal to m_ArrayCluster[c].center
+
+	// single precision copies for clustering::Distance_Kernel
+	vector<float> m_Points;  // the patterns component by component, component d of pattern p at d*NumPatterns() + p
+	vector<float> m_Centers; // the centers row by row
+
+	void SetCenter(int c, const double* center); // set the center of cluster c
+
+	// squared distances of the patterns [first, first+n) to all centers, center c at dist[c*n + p]
+	void CalSquaredDistances(int first, int n, float* dist);
+
 public:
 
 	CxCluster(int nPattern, // ;
@@ -62,10 +78,12 @@ public:
 
 	virtual~CxCluster(void) {}
 
-	vector<Pattern> m_ArrayPattern; // 洢;
+	CxMatrix        m_MatPattern;   // 洢;
 	vector<Cluster> m_ArrayCluster; // ;
 	unsigned char * m_label_ptr; // ŷ
 
+	void AddPattern(const Pattern& p); // append a pattern as a row of m_MatPattern
+
 	int GetDim()      { return m_nDim;     }
 	int NumClusters() { return m_nCluster; }
 	int NumPatterns() { return m_nPattern; }
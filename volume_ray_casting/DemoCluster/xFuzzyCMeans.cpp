@@ -36,53 +36,48 @@ void CxFuzzyCMeans::InitClusters()
 	for ( int i=0; i<NumClusters(); ++i )
 	{		
 		int rad = gRand.int32(0, sizes-1); // ѡһΪ;
-		const Pattern& p = m_ArrayPattern.at(rad);
 
 		Cluster c; 
-		c.center = p.pattern;
 		c.member.push_back(i);
 		m_ArrayCluster[i] = c;
+		SetCenter(i, m_MatPattern.Row(rad));
 	}
 
-	m_FuzzyMat.resize(sizes);
+	m_FuzzyMat.Resize(sizes, NumClusters());
 
 	return;
 }
 
 void CxFuzzyCMeans::InitClusters2()
 {
-	int size = (int)m_ArrayPattern.size();
+	int size = m_MatPattern.Rows();
 	if ( size == 0) return;
-	m_FuzzyMat.resize(size);
+	m_FuzzyMat.Resize(size, NumClusters());
 	
 	for(int i=0; i<size; ++i)
 	{
-		vector<double> degree(NumClusters(), 0);
+		double* degree = m_FuzzyMat.Row(i);
 		for(int c=0; c<NumClusters(); ++c)
 		{
-			degree.at(c) = gRand.doub(0, 1); // ;
+			degree[c] = gRand.doub(0, 1); // ;
 		}
-
-		m_FuzzyMat.at(i) = degree;
 	}
 
 	// normalization;
 	for(int i=0; i<size; ++i)
 	{
-		vector<double> degree = m_FuzzyMat.at(i);
+		double* degree = m_FuzzyMat.Row(i);
 		double sum = 0;
 
 		for(int c=0; c<NumClusters(); ++c)
-			sum += degree.at(c);
+			sum += degree[c];
 		
 		for(int c=0; c<NumClusters(); ++c)
-			degree.at(c) = degree.at(c)/sum;
-
-		m_FuzzyMat.at(i) = degree;
+			degree[c] = degree[c]/sum;
 	}
 
 	// compute center;
-	int dim = (int)m_ArrayPattern.at(0).pattern.size();
+	int dim = GetDim();
 	m_ArrayCluster.resize(NumClusters());
 
 	for(int c=0; c<NumClusters(); ++c)
@@ -92,19 +87,17 @@ void CxFuzzyCMeans::InitClusters2()
 
 		for(int i=0; i<size; ++i)
 		{
-			double u = m_FuzzyMat[i][c];
-			u = pow(u, m_M);
-			const Pattern& pat = m_ArrayPattern.at(i);
+			double u = Power(m_FuzzyMat(i, c));
+			const double* pat = m_MatPattern.Row(i);
 			for(int d=0; d<dim; ++d)
-				center[d] += u * pat.pattern.at(d);
+				center[d] += u * pat[d];
 			sum += u;
 		}
 
 		for (int d=0; d<dim; ++d)
-		{
-			double t = center[d]/sum;
-			m_ArrayCluster.at(c).center.push_back(t);
-		}
+			center[d] = center[d]/sum;
+
+		SetCenter(c, &center[0]);
 
 	} // end for c;
 	
@@ -112,95 +105,94 @@ void CxFuzzyCMeans::InitClusters2()
 
 void CxFuzzyCMeans::CalFuzzyMatrix()
 {
-	int size = (int)m_ArrayPattern.size();
-	vector<double> degree(NumClusters(), 0.0);
-    
-	vector<pair<int, int> > tmp; // ¼ЩΪ;
-
-	for(int i=0; i<size; ++i)
+	// u(i,c) = 1 / sum_k (|x_i - v_c| / |x_i - v_k|)^(2/(m-1))
+	//        = w_c / sum_k w_k,  w_k = |x_i - v_k|^(-2/(m-1)),
+	// so the distances of a pattern are computed once, and for m = 2
+	// w_k is the inverse squared distance.
+	int size = m_MatPattern.Rows();
+	double e = 1.0/(m_M-1);
+	vector<float> dists(NumClusters() * DISTANCE_BLOCK);
+
+	for(int first=0; first<size; first+=DISTANCE_BLOCK)
 	{
-		for(int c=0; c<NumClusters(); ++c)
+		int n = (size - first < DISTANCE_BLOCK) ? size - first : DISTANCE_BLOCK;
+		CalSquaredDistances(first, n, &dists[0]);
+
+		for(int p=0; p<n; ++p)
 		{
-			double dist = CalEuclideanNorm(c, i);
+			double* degree = m_FuzzyMat.Row(first + p);
 			double sum = 0;
-			for(int k=0; k<NumClusters(); ++k)
+			int zero = -1;
+
+			for(int c=0; c<NumClusters(); ++c)
 			{
-				double dist2 = CalEuclideanNorm(k, i);
-				double u = 0;
-				if ( dist2 != 0 )
-				{
-					u = dist / dist2;
-					u = pow(u, 2.0/(m_M-1));
-				}
-				else   // Ƿ?? 
+				double dist = dists[c*n + p];
+				if ( dist == 0 )
 				{
-					if ( c == k ) 
-					{
-						u = 1;
-						tmp.push_back(std::make_pair(i, c));
-					}
-					else u = 0;
+					zero = c;
+					continue;
 				}
-
-				sum += u;
+				degree[c] = (m_M == 2) ? 1.0/dist : pow(dist, -e);
+				sum += degree[c];
 			}
 
-			degree.at(c) = 1.0/sum;
-		}
-
-		m_FuzzyMat.at(i) = degree;
+			// if the pattern lies on a center, it belongs to this cluster only
+			if ( zero >= 0 )
+			{
+				for(int c=0; c<NumClusters(); ++c)
+					degree[c] = (c == zero) ? 1 : 0;
+				continue;
+			}
 
-	} // end for i
+			for(int c=0; c<NumClusters(); ++c)
+				degree[c] = degree[c]/sum;
 
-	// ģ,
-	// ĳĵľΪ,ȫ
-	// Ϊ1, Ϊ0;
-	int size2 = (int)tmp.size();
-	for(int i=0; i<size2; ++i)
-	{
-		pair<int,int>& p = tmp.at(i);
-		for(int c=0; c<NumClusters(); ++c)
-		{
-			if ( p.second == c )
-				m_FuzzyMat[p.first][c] = 1;
-			else
-				m_FuzzyMat[p.first][c] = 0;
-		}
-	}
+		} // end for p
+	} // end for first
 }
 
 bool CxFuzzyCMeans::CalNewClusterCenters()
 {
 	CalFuzzyMatrix();
 
-	int size = (int)m_ArrayPattern.size();
-	int dim = (int)m_ArrayCluster.at(0).center.size();
+	int size = m_MatPattern.Rows();
+	int dim = GetDim();
+	int stride = m_MatPattern.Stride();
     bool convergence = true;
-	for(int c=0; c<NumClusters(); ++c)
-	{
-		double sum = 0;	
-		vector<double> center(dim, 0);
 
-		for(int i=0; i<size; ++i)
+	// sum the weighted patterns of all clusters in one pass over the patterns
+	CxMatrix center(NumClusters(), dim);
+	vector<double> sum(NumClusters(), 0);
+
+	for(int i=0; i<size; ++i)
+	{
+		const double* pat = m_MatPattern.Row(i);
+		const double* degree = m_FuzzyMat.Row(i);
+		for(int c=0; c<NumClusters(); ++c)
 		{
-			double u = m_FuzzyMat[i][c];
-			u = pow(u, m_M);
-            const Pattern& pat = m_ArrayPattern.at(i);
-            for(int d=0; d<dim; ++d)
-				center[d] += u * pat.pattern.at(d);
-			sum += u;
+			double u = Power(degree[c]);
+			double* v = center.Row(c);
+			for(int d=0; d<stride; ++d)
+				v[d] += u * pat[d];
+			sum[c] += u;
 		}
+	}
 
+	for(int c=0; c<NumClusters(); ++c)
+	{
+		double* v = center.Row(c);
 		for (int d=0; d<dim; ++d)
 		{
-			double t = center[d]/sum;
-			//if ( m_ArrayCluster.at(c).center[d] != t )
-			if ( fabs(m_ArrayCluster.at(c).center[d] - t) > GetError())
+			double t = v[d]/sum[c];
+			//if ( m_MatCenter(c, d) != t )
+			if ( fabs(m_MatCenter(c, d) - t) > GetError())
 				convergence = false;
 
-			m_ArrayCluster.at(c).center[d] = t;
+			v[d] = t;
 		}
 
+		SetCenter(c, v);
+
 	} // end for c;
 
 	return convergence;
@@ -211,9 +203,10 @@ int CxFuzzyCMeans::FindMaxDegreeCluster(int p)
 	double maxDegree = -1;
 	int clusterID = -1;
 	double degree;
+	const double* row = m_FuzzyMat.Row(p);
 	for (int c=0; c<NumClusters(); ++c)
 	{
-		degree = m_FuzzyMat.at(p).at(c);
+		degree = row[c];
 		if ( degree > maxDegree )
 		{
 			maxDegree = degree;
@@ -232,7 +225,7 @@ void CxFuzzyCMeans::DistributeSamples()
 	for (int c=0; c<NumClusters(); ++c)
 		m_ArrayCluster.at(c).member.clear();
 
-	int sizes = (int)m_ArrayPattern.size();
+	int sizes = m_MatPattern.Rows();
 	for (int i=0; i<sizes; ++i )
 	{
 		// ԭ
@@ -259,16 +252,14 @@ void CxFuzzyCMeans::DistributeSamples()
 double CxFuzzyCMeans::CalFitCost()
 {
 	double sum = 0;
-	int size = (int)m_ArrayPattern.size();
+	int size = m_MatPattern.Rows();
 	for(int i=0; i<size; ++i)
 	{
 		double total = 0;
-		const Pattern& pat = m_ArrayPattern.at(i);
+		const double* degree = m_FuzzyMat.Row(i);
 		for(int c=0; c<NumClusters(); ++c)
 		{
-			const vector<double>& center = m_ArrayCluster.at(c).center;
-			double u = m_FuzzyMat.at(i).at(c);
-			u = pow(u, m_M);
+			double u = Power(degree[c]);
 			double dist = CalEuclideanNorm(c, i);
 			total += u*dist;
 		}
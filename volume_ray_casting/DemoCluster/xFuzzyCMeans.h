@@ -16,12 +16,14 @@
 
 #include "xCluster.h"
 
+#include <cmath>
+
 class CxFuzzyCMeans:public CxCluster
 {
 private:
 
 	int                     m_M;        // ģָ;
-	vector<vector<double> > m_FuzzyMat; // ģ;
+	CxMatrix                m_FuzzyMat; // ģ;
 
 protected:
 
@@ -32,6 +34,8 @@ protected:
 	double CalFitCost();     // Ŀ꺯
 	void   CalFuzzyMatrix(); // ģ;
 
+	double Power(double u) { return (m_M == 2) ? u*u : pow(u, m_M); } // u^m
+
 public:
 
 	CxFuzzyCMeans(int nPattern, int nDim, int nCluster):
@@ -35,11 +35,10 @@ void CxKMeans::InitClusters()
 	for ( int i=0; i<NumClusters(); ++i )
 	{
 		int rand_id = gRand2.int32(0, NumPatterns()-1);
-		const Pattern& p = m_ArrayPattern.at(rand_id);
 		Cluster c; 
-		c.center = p.pattern;
 		c.member.push_back(rand_id);
 		m_ArrayCluster[i] = c;
+		SetCenter(i, m_MatPattern.Row(rand_id));
 	}
 
 
@@ -60,11 +59,10 @@ bool CxKMeans::CalNewClusterCenters()
 		vector<double> center(dim, 0);
 		for (int n=0; n<size; ++n)
 		{
+			const double* pat = m_MatPattern.Row(m_ArrayCluster.at(k).member.at(n));
 			for(int i=0; i<dim; ++i)
 			{
-				int id = m_ArrayCluster.at(k).member.at(n);
-				const Pattern& pat = m_ArrayPattern.at(id); 
-				center[i] += pat.pattern.at(i);
+				center[i] += pat[i];
 			}
 		}
 
@@ -75,10 +73,10 @@ bool CxKMeans::CalNewClusterCenters()
 			// if ( center.at(i) != m_ArrayCluster.at(k).center.at(i))
 			if ( fabs(center.at(i) - m_ArrayCluster.at(k).center.at(i)) > GetError() )
 				flag = false;
-
-			m_ArrayCluster.at(k).center.at(i) = center.at(i);
 		}
 
+		SetCenter(k, &center[0]);
+
 	} // end for k;
 
 	return flag;
@@ -0,0 +1,150 @@
+//  *************************************************************************
+//	xMatrix       version: 1.0
+//  -------------------------------------------------------------------------
+//  Purpose:
+//	-------------------------------------------------------------------------
+//
+//  *************************************************************************
+//
+//  *************************************************************************
+#include "StdAfx.h"
+#include "xMatrix.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+
+double* CxMatrix::Allocate(int nRows, int nStride)
+{
+	size_t bytes = (size_t)nRows * nStride * sizeof(double);
+	if ( bytes == 0 )
+		return NULL;
+
+#ifdef _MSC_VER
+	void* p = _aligned_malloc(bytes, MATRIX_ALIGN);
+#else
+	void* p = NULL;
+	if ( posix_memalign(&p, MATRIX_ALIGN, bytes) != 0 )
+		p = NULL;
+#endif
+	assert ( p != NULL );
+
+	return (double*)p;
+}
+
+void CxMatrix::Free(double* p)
+{
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+CxMatrix::CxMatrix()
+{
+	m_nRows = m_nCols = m_nStride = m_nCapacity = 0;
+	m_pData = NULL;
+}
+
+CxMatrix::CxMatrix(int nRows, int nCols)
+{
+	m_nRows = m_nCols = m_nStride = m_nCapacity = 0;
+	m_pData = NULL;
+
+	Resize(nRows, nCols);
+}
+
+CxMatrix::CxMatrix(const CxMatrix& m)
+{
+	m_nRows = m_nCols = m_nStride = m_nCapacity = 0;
+	m_pData = NULL;
+
+	*this = m;
+}
+
+CxMatrix& CxMatrix::operator=(const CxMatrix& m)
+{
+	if ( this != &m )
+	{
+		Resize(m.m_nRows, m.m_nCols);
+		if ( m_pData != NULL )
+			memcpy(m_pData, m.m_pData, (size_t)m_nRows * m_nStride * sizeof(double));
+	}
+
+	return *this;
+}
+
+CxMatrix::~CxMatrix()
+{
+	Free(m_pData);
+}
+
+void CxMatrix::Resize(int nRows, int nCols)
+{
+	int nAlign = MATRIX_ALIGN / (int)sizeof(double);
+	int nStride = (nCols + nAlign - 1) / nAlign * nAlign;
+
+	if ( nRows > m_nCapacity || nStride != m_nStride )
+	{
+		Free(m_pData);
+		m_pData = Allocate(nRows, nStride);
+		m_nCapacity = nRows;
+	}
+
+	m_nRows = nRows;
+	m_nCols = nCols;
+	m_nStride = nStride;
+
+	if ( m_pData != NULL )
+		memset(m_pData, 0, (size_t)m_nCapacity * m_nStride * sizeof(double));
+}
+
+void CxMatrix::Reserve(int nRows, int nCols)
+{
+	int nAlign = MATRIX_ALIGN / (int)sizeof(double);
+	int nStride = (nCols + nAlign - 1) / nAlign * nAlign;
+
+	if ( nRows <= m_nCapacity && nStride == m_nStride )
+	{
+		m_nCols = nCols;
+		return;
+	}
+	if ( nRows < m_nRows )
+		nRows = m_nRows;
+
+	// keep the rows already stored
+	double* pData = Allocate(nRows, nStride);
+	if ( pData != NULL )
+		memset(pData, 0, (size_t)nRows * nStride * sizeof(double));
+	if ( m_pData != NULL && nStride == m_nStride )
+		memcpy(pData, m_pData, (size_t)m_nRows * m_nStride * sizeof(double));
+	else
+		m_nRows = 0;
+
+	Free(m_pData);
+	m_pData = pData;
+	m_nCapacity = nRows;
+	m_nCols = nCols;
+	m_nStride = nStride;
+}
+
+void CxMatrix::AppendRow(const vector<double>& row)
+{
+	if ( m_nRows == 0 && m_nCols != (int)row.size() )
+		Reserve(m_nCapacity, (int)row.size());
+
+	assert ( (int)row.size() == m_nCols );
+
+	if ( m_nRows == m_nCapacity )
+		Reserve(m_nCapacity > 0 ? 2*m_nCapacity : 16, m_nCols);
+
+	double* r = Row(m_nRows++);
+	for (int c=0; c<m_nCols; ++c)
+		r[c] = row[c];
+}
@@ -0,0 +1,82 @@
+//  *************************************************************************
+//	xMatrix       version: 1.0
+//  -------------------------------------------------------------------------
+//  Purpose:    A contiguous row-major matrix with aligned rows,
+//              which stores the patterns and the centers of CxCluster;
+//	-------------------------------------------------------------------------
+//
+//  Each row starts at a 16-byte boundary and is padded with zeros to an
+//  even number of doubles, so two rows of the same width can be compared
+//  two components at a time with SSE2, padding included.
+//  *************************************************************************
+//
+//  *************************************************************************
+#pragma once
+
+#include <vector>
+using std::vector;
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define XMATRIX_SSE2
+#endif
+
+const int MATRIX_ALIGN = 16; // alignment of the rows in bytes
+
+class CxMatrix
+{
+private:
+
+	int m_nRows;     // number of rows
+	int m_nCols;     // number of used columns
+	int m_nStride;   // doubles per row, m_nCols rounded up to the alignment
+	int m_nCapacity; // number of allocated rows
+
+	double* m_pData;
+
+	static double* Allocate(int nRows, int nStride);
+	static void    Free(double* p);
+
+public:
+
+	CxMatrix();
+	CxMatrix(int nRows, int nCols);
+	CxMatrix(const CxMatrix& m);
+	CxMatrix& operator=(const CxMatrix& m);
+	~CxMatrix();
+
+	void Resize(int nRows, int nCols);      // all values are set to 0
+	void Reserve(int nRows, int nCols);     // allocate rows for AppendRow
+	void AppendRow(const vector<double>& row);
+
+	int Rows() const   { return m_nRows;   }
+	int Cols() const   { return m_nCols;   }
+	int Stride() const { return m_nStride; }
+
+	double*       Row(int r)       { return m_pData + (size_t)r * m_nStride; }
+	const double* Row(int r) const { return m_pData + (size_t)r * m_nStride; }
+
+	double& operator()(int r, int c)       { return Row(r)[c]; }
+	double  operator()(int r, int c) const { return Row(r)[c]; }
+
+	// squared Euclidean distance between two aligned rows of stride doubles
+	static double SquaredDistance(const double* a, const double* b, int stride)
+	{
+#ifdef XMATRIX_SSE2
+		__m128d sum = _mm_setzero_pd();
+		for (int d=0; d<stride; d+=2)
+		{
+			__m128d diff = _mm_sub_pd(_mm_load_pd(a + d), _mm_load_pd(b + d));
+			sum = _mm_add_pd(sum, _mm_mul_pd(diff, diff));
+		}
+		double s[2];
+		_mm_storeu_pd(s, sum);
+		return s[0] + s[1];
+#else
+		double sum = 0.0;
+		for (int d=0; d<stride; ++d)
+			sum += (a[d] - b[d])*(a[d] - b[d]);
+		return sum;
+#endif
+	}
+};
@@ -0,0 +1,266 @@
+/**	@file
+* a header file for the Distance_Kernel class
+*/
+
+#pragma once
+
+#ifndef Distance_Kernel_h
+#define Distance_Kernel_h
+
+#include <cfloat>
+
+#include "simd_utility.h"
+
+namespace clustering
+{
+	/**	@brief	The squared Euclidean distance, sum (x_d - c_d)^2
+	*
+	*	A metric gives the scale of component d of the distance to center c, the distance is
+	*	sum scale(c, d) (x_d - c_d)^2. The scale of 1 is folded away by the compiler.
+	*/
+	struct Squared_Euclidean
+	{
+		float scale(const int /*c*/, const int /*d*/) const { return 1; }
+	};
+
+	/// the squared Euclidean distance with a weight per component, dimension weights
+	struct Weighted_Euclidean
+	{
+		const float * weights;
+
+		explicit Weighted_Euclidean(const float * weights) : weights(weights) {}
+		float scale(const int /*c*/, const int d) const { return weights[d]; }
+	};
+
+	/// the Mahalanobis distance of a diagonal covariance per center, k * dimension inverse variances row by row
+	struct Diagonal_Mahalanobis
+	{
+		const float * inverse_variances;
+		int dimension;
+
+		Diagonal_Mahalanobis(const float * inverse_variances, const int dimension) : inverse_variances(inverse_variances), dimension(dimension) {}
+		float scale(const int c, const int d) const { return inverse_variances[c * dimension + d]; }
+	};
+
+	/**	@brief	Distances from a block of points to all centers at once
+	*
+	*	The points are stored component by component, component d of point p at points[d * stride + p] as in
+	*	a Feature_Set, and the centers row by row. For 1 to 8 dimensions the components of 4 points are kept
+	*	in SSE registers while all centers pass by, so a point is loaded once per block instead of once per
+	*	center, and the nearest center is selected with compares instead of branches. Other dimensions use
+	*	the scalar loop over the centers. The sums are taken in the same order in both paths, so the
+	*	distances do not depend on the path.
+	*
+	*	The metric is a functor (Squared_Euclidean, Weighted_Euclidean, Diagonal_Mahalanobis) inlined into the loops.
+	*
+	*	K_Means_Lloyd, K_Means_Mini_Batch, K_Means_Seeding, Fuzzy_CMeans_Streaming, K_Means_Supervoxel,
+	*	K_Means_PP_Generic and K_Means_Bounded (for the Euclidean distance of flat types), DemoCluster's
+	*	CxCluster and BenBenRaycasting's k_means.h compute their distances here. kmpp and kmlocal keep
+	*	their own double precision distances for the filtering of their kd-trees.
+	*/
+	template <class M = Squared_Euclidean>
+	class Distance_Kernel
+	{
+	public:
+
+		/// the largest dimension with a specialized kernel
+		static const int MAX_DIMENSION = 8;
+
+		/// the nearest of the k centers to the points [0, n), and their distances. Return the sum of the distances.
+		static double nearest(const float * points, const size_t stride, const int dimension, const float * centers, const int k, const int n,
+			float * best_distance, int * best_label, const M & metric = M())
+		{
+			switch (dimension)
+			{
+			case 1: nearest_fixed<1>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			case 2: nearest_fixed<2>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			case 3: nearest_fixed<3>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			case 4: nearest_fixed<4>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			case 5: nearest_fixed<5>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			case 6: nearest_fixed<6>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			case 7: nearest_fixed<7>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			case 8: nearest_fixed<8>(points, stride, centers, k, n, best_distance, best_label, metric); break;
+			default: nearest_any(points, stride, dimension, centers, k, n, best_distance, best_label, metric); break;
+			}
+			double sum = 0;
+			for (int p=0; p<n; p++)
+			{
+				sum += best_distance[p];
+			}
+			return sum;
+		}
+
+		/// the distances of the points [0, n) to the k centers, the distance of point p to center c at distance[c * distance_stride + p]
+		static void distances(const float * points, const size_t stride, const int dimension, const float * centers, const int k, const int n,
+			float * distance, const int distance_stride, const M & metric = M())
+		{
+			switch (dimension)
+			{
+			case 1: distances_fixed<1>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			case 2: distances_fixed<2>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			case 3: distances_fixed<3>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			case 4: distances_fixed<4>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			case 5: distances_fixed<5>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			case 6: distances_fixed<6>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			case 7: distances_fixed<7>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			case 8: distances_fixed<8>(points, stride, centers, k, n, distance, distance_stride, metric); break;
+			default: distances_any(points, stride, dimension, centers, k, n, distance, distance_stride, metric); break;
+			}
+		}
+
+	private:
+
+		/// the distance of point p to center c, the scalar path of the fixed kernels
+		template <int D>
+		static float distance_fixed(const float * points, const size_t stride, const float * center, const int c, const int p, const M & metric)
+		{
+			float sum = 0;
+			for (int d=0; d<D; d++)
+			{
+				const float difference = points[d * stride + p] - center[d];
+				sum += metric.scale(c, d) * (difference * difference);
+			}
+			return sum;
+		}
+
+		template <int D>
+		static void nearest_fixed(const float * points, const size_t stride, const float * centers, const int k, const int n,
+			float * best_distance, int * best_label, const M & metric)
+		{
+			int p = 0;
+#ifdef SIMD_UTILITY_SSE2
+			for (; p+4<=n; p+=4)
+			{
+				__m128 x[D];
+				for (int d=0; d<D; d++)
+				{
+					x[d] = _mm_loadu_ps(points + d * stride + p);
+				}
+				__m128 best = _mm_set1_ps(FLT_MAX);
+				__m128i label = _mm_setzero_si128();
+				for (int c=0; c<k; c++)
+				{
+					const float * center = centers + c * D;
+					__m128 sum = _mm_setzero_ps();
+					for (int d=0; d<D; d++)
+					{
+						const __m128 difference = _mm_sub_ps(x[d], _mm_set1_ps(center[d]));
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(metric.scale(c, d)), _mm_mul_ps(difference, difference)));
+					}
+					// the first of equal distances wins as in the scalar loop
+					const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(sum, best));
+					best = _mm_min_ps(sum, best);
+					label = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(c)), _mm_andnot_si128(closer, label));
+				}
+				_mm_storeu_ps(best_distance + p, best);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(best_label + p), label);
+			}
+#endif
+			for (; p<n; p++)
+			{
+				float best = FLT_MAX;
+				int label = 0;
+				for (int c=0; c<k; c++)
+				{
+					const float distance = distance_fixed<D>(points, stride, centers + c * D, c, p, metric);
+					if (distance < best)
+					{
+						best = distance;
+						label = c;
+					}
+				}
+				best_distance[p] = best;
+				best_label[p] = label;
+			}
+		}
+
+		template <int D>
+		static void distances_fixed(const float * points, const size_t stride, const float * centers, const int k, const int n,
+			float * distance, const int distance_stride, const M & metric)
+		{
+			int p = 0;
+#ifdef SIMD_UTILITY_SSE2
+			for (; p+4<=n; p+=4)
+			{
+				__m128 x[D];
+				for (int d=0; d<D; d++)
+				{
+					x[d] = _mm_loadu_ps(points + d * stride + p);
+				}
+				for (int c=0; c<k; c++)
+				{
+					const float * center = centers + c * D;
+					__m128 sum = _mm_setzero_ps();
+					for (int d=0; d<D; d++)
+					{
+						const __m128 difference = _mm_sub_ps(x[d], _mm_set1_ps(center[d]));
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(metric.scale(c, d)), _mm_mul_ps(difference, difference)));
+					}
+					_mm_storeu_ps(distance + c * distance_stride + p, sum);
+				}
+			}
+#endif
+			for (; p<n; p++)
+			{
+				for (int c=0; c<k; c++)
+				{
+					distance[c * distance_stride + p] = distance_fixed<D>(points, stride, centers + c * D, c, p, metric);
+				}
+			}
+		}
+
+		static void nearest_any(const float * points, const size_t stride, const int dimension, const float * centers, const int k, const int n,
+			float * best_distance, int * best_label, const M & metric)
+		{
+			int p;
+			for (p=0; p<n; p++)
+			{
+				best_distance[p] = FLT_MAX;
+				best_label[p] = 0;
+			}
+			for (int c=0; c<k; c++)
+			{
+				for (p=0; p<n; p++)
+				{
+					float sum = 0;
+					for (int d=0; d<dimension; d++)
+					{
+						const float difference = points[d * stride + p] - centers[c * dimension + d];
+						sum += metric.scale(c, d) * (difference * difference);
+					}
+					if (sum < best_distance[p])
+					{
+						best_distance[p] = sum;
+						best_label[p] = c;
+					}
+				}
+			}
+		}
+
+		static void distances_any(const float * points, const size_t stride, const int dimension, const float * centers, const int k, const int n,
+			float * distance, const int distance_stride, const M & metric)
+		{
+			for (int c=0; c<k; c++)
+			{
+				float * out = distance + c * distance_stride;
+				for (int p=0; p<n; p++)
+				{
+					out[p] = 0;
+				}
+				for (int d=0; d<dimension; d++)
+				{
+					const float * x = points + d * stride;
+					const float center = centers[c * dimension + d];
+					const float scale = metric.scale(c, d);
+					for (int p=0; p<n; p++)
+					{
+						const float difference = x[p] - center;
+						out[p] += scale * (difference * difference);
+					}
+				}
+			}
+		}
+	};
+}
+
+#endif // Distance_Kernel_h
@@ -97,12 +97,19 @@ namespace clustering
 			std::cout<<"--------------------------------";
 		}
 
+		/// copy the points into the rows of the pattern matrix
 		template <class T>
 		static void load_data(CxFuzzyCMeans& filter, const std::vector<T> & data)
 		{
-			for (std::vector<T>::const_iterator i=data.begin(); i!=data.end(); i++)
+			const int dimension = get_dimension(*data.begin());
+			filter.m_MatPattern.Resize(static_cast<int>(data.size()), dimension);
+			for (unsigned int i=0; i<data.size(); i++)
 			{
-				filter.m_ArrayPattern.push_back(to_Pattern(*i));
+				double * row = filter.m_MatPattern.Row(i);
+				for (int d=0; d<dimension; d++)
+				{
+					row[d] = data[i][d];
+				}
 			}
 			//for (int i=0; i<data.size(); i++)
 			//{
@@ -141,7 +148,7 @@ namespace clustering
 				p.pattern.push_back(b);
 				p.pattern.push_back(c);
 				p.pattern.push_back(d);
-				filter.m_ArrayPattern.push_back(p);
+				filter.AddPattern(p);
 
 			}
 			infile.close();
@@ -0,0 +1,289 @@
+/**	@file
+* a header file for the Fuzzy_CMeans_Streaming class
+*/
+
+#pragma once
+
+#ifndef Fuzzy_CMeans_Streaming_h
+#define Fuzzy_CMeans_Streaming_h
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
+#include "Distance_Kernel.h"
+#include "K_Means_Lloyd.h"
+#include "K_Means_Seeding.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
+	/**	@brief	When the fuzzy c-means iteration stops
+	*
+	*	fuzziness is the exponent m of the memberships, m > 1. The iteration stops when no centroid moves
+	*	farther than tolerance, or after max_iterations.
+	*/
+	struct Fuzzy_Options
+	{
+		float fuzziness;
+		float tolerance;
+		int max_iterations;
+
+		Fuzzy_Options(const float fuzziness = 2, const float tolerance = 1e-4f, const int max_iterations = 300)
+			: fuzziness(fuzziness), tolerance(tolerance), max_iterations(max_iterations)
+		{
+		}
+	};
+
+	/**	@brief	Fuzzy c-means on a Feature_Set without a membership matrix
+	*
+	*	The membership of a point in cluster c is u_c = 1 / sum_j (d_c / d_j)^(2 / (m - 1)), d being the distances
+	*	to the centroids. It only depends on the point and the centroids, so each iteration computes the memberships
+	*	of a block of points, adds u_c^m x and u_c^m to the sums of the clusters and forgets them. The state is
+	*	O(k * dimension) per thread instead of the count * k memberships of Fuzzy_CMeans.
+	*	For m = 2 the memberships are the normalized inverse squared distances and no pow() is needed.
+	*
+	*	The blocks are distributed over the threads as in K_Means_Lloyd, and the sums are merged in thread order.
+	*	The labels are the clusters of highest membership, which are the nearest centroids. The memberships
+	*	themselves can be written quantized to bytes.
+	*
+	*	Bezdek J C. Pattern Recognition with Fuzzy Objective Function Algorithms. Plenum Press, 1981.
+	*/
+	class Fuzzy_CMeans_Streaming
+	{
+	public:
+
+		/// run the iteration from the given centroids, which are updated.
+		/// The inertia of the result is the objective sum u^m d^2 of the last iteration.
+		static Lloyd_Result run(const Feature_Set & features, const int k, std::vector<float> & centroids, const Fuzzy_Options & options = Fuzzy_Options())
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int blocks = static_cast<int>((count + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE);
+			const int threads = parallel_utility::get_thread_number();
+			const int stride = k * dimension;
+
+			// per thread: weighted sums of the points of each cluster, sums of the weights and the objective
+			std::vector<double> sums(threads * stride);
+			std::vector<double> weights(threads * k);
+			std::vector<double> objectives(threads);
+
+			Lloyd_Result result;
+			while (result.iterations < options.max_iterations)
+			{
+				std::fill(sums.begin(), sums.end(), 0.0);
+				std::fill(weights.begin(), weights.end(), 0.0);
+				std::fill(objectives.begin(), objectives.end(), 0.0);
+
+#pragma omp parallel
+				{
+					const int t = parallel_utility::get_thread_index();
+					double * sum = &sums[t * stride];
+					double * weight = &weights[t * k];
+					std::vector<double> values(k * K_Means_Lloyd::BLOCK_SIZE);
+					std::vector<float> distances(k * K_Means_Lloyd::BLOCK_SIZE);
+					int b;
+#pragma omp for schedule(static)
+					for (b=0; b<blocks; b++)
+					{
+						const unsigned int first = static_cast<unsigned int>(b) * K_Means_Lloyd::BLOCK_SIZE;
+						const int n = static_cast<int>(std::min<unsigned int>(K_Means_Lloyd::BLOCK_SIZE, count - first));
+						objectives[t] += memberships_block(features, &centroids[0], k, first, n, options.fuzziness, true, &distances[0], &values[0]);
+						for (int c=0; c<k; c++)
+						{
+							const double * u = &values[c * K_Means_Lloyd::BLOCK_SIZE];
+							for (int p=0; p<n; p++)
+							{
+								weight[c] += u[p];
+							}
+							for (int d=0; d<dimension; d++)
+							{
+								const float * x = features.component(d) + first;
+								double s = 0;
+								for (int p=0; p<n; p++)
+								{
+									s += u[p] * x[p];
+								}
+								sum[c * dimension + d] += s;
+							}
+						}
+					}
+				}
+
+				// merge the threads in order and move the centroids
+				double objective = 0;
+				float max_shift = 0;
+				for (int t=0; t<threads; t++)
+				{
+					objective += objectives[t];
+				}
+				for (int c=0; c<k; c++)
+				{
+					double total_weight = 0;
+					for (int t=0; t<threads; t++)
+					{
+						total_weight += weights[t * k + c];
+					}
+					if (total_weight == 0)
+					{
+						continue;
+					}
+					float shift = 0;
+					for (int d=0; d<dimension; d++)
+					{
+						double total = 0;
+						for (int t=0; t<threads; t++)
+						{
+							total += sums[t * stride + c * dimension + d];
+						}
+						const float center = static_cast<float>(total / total_weight);
+						const float difference = center - centroids[c * dimension + d];
+						shift += difference * difference;
+						centroids[c * dimension + d] = center;
+					}
+					max_shift = std::max(max_shift, shift);
+				}
+				result.iterations++;
+				result.inertia = objective;
+				result.distances += static_cast<double>(count) * k;
+				result.converged = std::sqrt(max_shift) <= options.tolerance;
+				if (result.converged)
+				{
+					break;
+				}
+			}
+			return result;
+		}
+
+		/// label all features with their clusters of highest membership, the nearest centroids
+		template <class L>
+		static void assign(const Feature_Set & features, const int k, const std::vector<float> & centroids, L * labels)
+		{
+			const unsigned int count = features.get_count();
+			const int blocks = static_cast<int>((count + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE);
+#pragma omp parallel
+			{
+				float best_distance[K_Means_Lloyd::BLOCK_SIZE];
+				int best_label[K_Means_Lloyd::BLOCK_SIZE];
+				int b;
+#pragma omp for schedule(static)
+				for (b=0; b<blocks; b++)
+				{
+					const unsigned int first = static_cast<unsigned int>(b) * K_Means_Lloyd::BLOCK_SIZE;
+					const int n = static_cast<int>(std::min<unsigned int>(K_Means_Lloyd::BLOCK_SIZE, count - first));
+					K_Means_Lloyd::assign_block(features, &centroids[0], k, first, n, best_distance, best_label);
+					for (int p=0; p<n; p++)
+					{
+						labels[first + p] = static_cast<L>(best_label[p]);
+					}
+				}
+			}
+		}
+
+		/// write the memberships of all features, k bytes per point in point order, 255 for a membership of 1
+		static void quantize_memberships(const Feature_Set & features, const int k, const std::vector<float> & centroids, const float fuzziness,
+			unsigned char * memberships)
+		{
+			const unsigned int count = features.get_count();
+			const int blocks = static_cast<int>((count + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE);
+#pragma omp parallel
+			{
+				std::vector<double> values(k * K_Means_Lloyd::BLOCK_SIZE);
+				std::vector<float> distances(k * K_Means_Lloyd::BLOCK_SIZE);
+				int b;
+#pragma omp for schedule(static)
+				for (b=0; b<blocks; b++)
+				{
+					const unsigned int first = static_cast<unsigned int>(b) * K_Means_Lloyd::BLOCK_SIZE;
+					const int n = static_cast<int>(std::min<unsigned int>(K_Means_Lloyd::BLOCK_SIZE, count - first));
+					memberships_block(features, &centroids[0], k, first, n, fuzziness, false, &distances[0], &values[0]);
+					for (int p=0; p<n; p++)
+					{
+						unsigned char * m = memberships + static_cast<size_t>(first + p) * k;
+						for (int c=0; c<k; c++)
+						{
+							m[c] = static_cast<unsigned char>(values[c * K_Means_Lloyd::BLOCK_SIZE + p] * 255 + 0.5);
+						}
+					}
+				}
+			}
+		}
+
+		/// cluster points of nv::vec2f, vec3f or vec4f from k-means++ seeds and write the hard labels
+		template <class T>
+		static Lloyd_Result k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, const Fuzzy_Options & options = Fuzzy_Options())
+		{
+			Feature_Set features;
+			features.assign(data);
+			std::vector<float> centroids;
+			K_Means_Seeding::seed(features, k, centroids, static_cast<unsigned long long>(time(NULL)));
+			const Lloyd_Result result = run(features, k, centroids, options);
+			assign(features, k, centroids, label_ptr);
+			return result;
+		}
+
+	private:
+
+		/// the memberships of the points [first, first + n), u_c of point p at values[c * BLOCK_SIZE + p],
+		/// raised to the power fuzziness if raise is set. Return the objective of the points.
+		/// distances holds k * BLOCK_SIZE scratch values.
+		static double memberships_block(const Feature_Set & features, const float * centroids, const int k, const unsigned int first, const int n,
+			const float fuzziness, const bool raise, float * distances, double * values)
+		{
+			const bool quadratic = fuzziness == 2;
+			const double exponent = 1.0 / (fuzziness - 1);
+			int p;
+
+			// the squared distances
+			Distance_Kernel<>::distances(features.component(0) + first, features.get_count(), features.get_dimension(), centroids, k, n,
+				distances, K_Means_Lloyd::BLOCK_SIZE);
+			for (int c=0; c<k; c++)
+			{
+				for (p=0; p<n; p++)
+				{
+					values[c * K_Means_Lloyd::BLOCK_SIZE + p] = distances[c * K_Means_Lloyd::BLOCK_SIZE + p];
+				}
+			}
+
+			double objective = 0;
+			for (p=0; p<n; p++)
+			{
+				// a point on a centroid belongs to it alone
+				int on_centroid = -1;
+				double total = 0;
+				for (int c=0; c<k; c++)
+				{
+					double & v = values[c * K_Means_Lloyd::BLOCK_SIZE + p];
+					if (v == 0)
+					{
+						on_centroid = c;
+						break;
+					}
+					v = quadratic ? 1 / v : std::pow(v, -exponent);
+					total += v;
+				}
+				if (on_centroid >= 0)
+				{
+					for (int c=0; c<k; c++)
+					{
+						values[c * K_Means_Lloyd::BLOCK_SIZE + p] = c == on_centroid ? 1 : 0;
+					}
+					continue;
+				}
+
+				// sum u^m d^2 is total^(1 - m)
+				objective += quadratic ? 1 / total : std::pow(total, 1.0 - fuzziness);
+				for (int c=0; c<k; c++)
+				{
+					double & v = values[c * K_Means_Lloyd::BLOCK_SIZE + p];
+					const double u = v / total;
+					v = !raise ? u : quadratic ? u * u : std::pow(u, static_cast<double>(fuzziness));
+				}
+			}
+			return objective;
+		}
+	};
+}
+
+#endif // Fuzzy_CMeans_Streaming_h
@@ -0,0 +1,378 @@
+/**	@file
+* a header file for the K_Means_Bounded class
+*/
+
+#pragma once
+
+#ifndef K_Means_Bounded_h
+#define K_Means_Bounded_h
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <ctime>
+
+#include "K_Means_PP_Generic.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
+	/**	@brief	k-means accelerated by the triangle inequality
+	*
+	*	Every point keeps an upper bound of the distance to its centroid and lower bounds of the distances to the
+	*	other centroids. The bounds are loosened by the distances the centroids moved, and a distance is only
+	*	computed when the bounds can no longer rule out a closer centroid. After the first iterations most
+	*	points keep their centroid without computing any distance.
+	*
+	*	Hamerly's algorithm keeps one lower bound per point (to the second closest centroid), Elkan's keeps k.
+	*	Elkan's skips more distances, but updating k bounds per point costs more than the distances it saves
+	*	for the 3 to 6 dimensional features of the volumes unless k is large.
+	*
+	*	get_distance has to be a metric (satisfy the triangle inequality), like the Euclidean distance
+	*	K_Means_PP_Generic::get_distance. The centroids are the means of the points, computed from sums on all
+	*	threads for the default get_centroid and from the lists of points for any other. When get_distance is
+	*	the Euclidean distance of nv::vec2f, vec3f or vec4f, the distances to all centroids, of the first
+	*	assignment and of the points whose bounds fail in Hamerly's algorithm, are computed by Distance_Kernel
+	*	through Flat_Points.
+	*
+	*	Elkan C. Using the triangle inequality to accelerate k-means. ICML 2003.
+	*	Hamerly G. Making k-means even faster. SDM 2010.
+	*/
+	class K_Means_Bounded
+	{
+	public:
+
+		typedef K_Means_PP_Generic::real real;
+
+		/// which bounds to keep
+		enum Bounds { AUTOMATIC, HAMERLY, ELKAN };
+
+		/// AUTOMATIC uses Elkan's bounds from this k on
+		static const int ELKAN_MIN_K = 64;
+
+		/**	@brief	Do the k-means clustering from k-means++ seeds
+		*
+		*	The options are those of K_Means_Lloyd, the INERTIA criterion is handled as LABEL_CHANGES
+		*	as the bounds do not give the exact distances.
+		*/
+		template <class T>
+		static Lloyd_Result k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, real get_distance(const T & v1, const T & v2), T get_centroid(const std::vector<T> & list),
+			const Lloyd_Options & options = Lloyd_Options(), const Bounds bounds = AUTOMATIC)
+		{
+			std::vector<T> centroids;
+			K_Means_PP_Generic::seed(data, k, centroids, get_distance, static_cast<unsigned long long>(time(NULL)));
+			return run(data, k, centroids, label_ptr, get_distance, get_centroid, options, bounds);
+		}
+
+		/// run the iteration from the given centroids, which are updated, and write the labels
+		template <class T, class L>
+		static Lloyd_Result run(const std::vector<T> & data, const int k, std::vector<T> & centroids, L * labels, real get_distance(const T & v1, const T & v2), T get_centroid(const std::vector<T> & list),
+			const Lloyd_Options & options = Lloyd_Options(), const Bounds bounds = AUTOMATIC)
+		{
+			const int n = static_cast<int>(data.size());
+			const int threads = parallel_utility::get_thread_number();
+			const bool elkan = bounds == ELKAN || (bounds == AUTOMATIC && k >= ELKAN_MIN_K);
+			const bool sums = get_centroid == &K_Means_PP_Generic::get_centroid<T>;
+			const bool flat = Flat_Points<T>::enabled && K_Means_PP_Generic::is_euclidean(get_distance);
+
+			std::vector<real> upper(n);
+			std::vector<real> lower(elkan ? static_cast<size_t>(n) * k : n);
+			std::vector<real> center_distance(k * k), half_separation(k), movement(k);
+			std::vector<T> old_centroids(k);
+			std::vector<double> thread_distances(threads);
+			std::vector<unsigned int> thread_changes(threads);
+			Lloyd_Result result;
+			int i;
+
+			Flat_Points<T> points;
+			if (flat)
+			{
+				points.assign(data);
+				points.set_centroids(&centroids[0], k);
+			}
+
+			// the first assignment computes all distances, of a block of points at once for flat points
+			const int blocks = (n + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE;
+#pragma omp parallel
+			{
+				std::vector<float> squared_distance(flat ? k * K_Means_Lloyd::BLOCK_SIZE : 0);
+				int b;
+#pragma omp for schedule(static)
+				for (b=0; b<blocks; b++)
+				{
+					const int first = b * K_Means_Lloyd::BLOCK_SIZE;
+					const int size = std::min(n - first, static_cast<int>(K_Means_Lloyd::BLOCK_SIZE));
+					if (flat)
+					{
+						points.squared_distances(first, size, &squared_distance[0]);
+					}
+					for (int p=0; p<size; p++)
+					{
+						const int index = first + p;
+						real best = FLT_MAX, second = FLT_MAX;
+						int label = 0;
+						for (int j=0; j<k; j++)
+						{
+							const real d = flat ? std::sqrt(squared_distance[j * size + p]) : get_distance(data[index], centroids[j]);
+							if (elkan)
+							{
+								lower[static_cast<size_t>(index) * k + j] = d;
+							}
+							if (d < best)
+							{
+								second = best;
+								best = d;
+								label = j;
+							}else if (d < second)
+							{
+								second = d;
+							}
+						}
+						labels[index] = static_cast<L>(label);
+						upper[index] = best;
+						if (!elkan)
+						{
+							lower[index] = second;
+						}
+					}
+				}
+			}
+			result.distances = static_cast<double>(n) * k;
+
+			while (result.iterations < options.max_iterations)
+			{
+				// move the centroids to the means of their points
+				old_centroids = centroids;
+				update_centroids(data, k, labels, centroids, get_centroid, sums);
+				if (flat)
+				{
+					points.set_centroids(&centroids[0], k);
+				}
+				real max_movement = 0;
+				for (int j=0; j<k; j++)
+				{
+					movement[j] = get_distance(old_centroids[j], centroids[j]);
+					max_movement = std::max(max_movement, movement[j]);
+				}
+				result.iterations++;
+				if (options.criterion == Lloyd_Options::CENTROID_SHIFT && max_movement <= options.tolerance)
+				{
+					result.converged = true;
+					break;
+				}
+
+				// the largest and the second largest movement, for Hamerly's single lower bound
+				int fastest = 0;
+				real second_movement = 0;
+				for (int j=1; j<k; j++)
+				{
+					if (movement[j] > movement[fastest])
+					{
+						fastest = j;
+					}
+				}
+				for (int j=0; j<k; j++)
+				{
+					if (j != fastest)
+					{
+						second_movement = std::max(second_movement, movement[j]);
+					}
+				}
+
+				// the distances among the centroids, half the distance of each to its nearest neighbour
+				for (int a=0; a<k; a++)
+				{
+					half_separation[a] = FLT_MAX;
+					center_distance[a * k + a] = 0;
+				}
+				for (int a=0; a<k; a++)
+				{
+					for (int b=a+1; b<k; b++)
+					{
+						const real d = get_distance(centroids[a], centroids[b]);
+						center_distance[a * k + b] = center_distance[b * k + a] = d;
+						half_separation[a] = std::min(half_separation[a], d / 2);
+						half_separation[b] = std::min(half_separation[b], d / 2);
+					}
+				}
+
+				std::fill(thread_distances.begin(), thread_distances.end(), 0.0);
+				std::fill(thread_changes.begin(), thread_changes.end(), 0);
+#pragma omp parallel
+				{
+					const int t = parallel_utility::get_thread_index();
+					double distances = 0;
+					unsigned int changes = 0;
+					std::vector<float> squared_distance(flat ? k : 0);
+#pragma omp for schedule(dynamic, 4096)
+					for (i=0; i<n; i++)
+					{
+						const int previous = static_cast<int>(labels[i]);
+						int label = previous;
+						upper[i] += movement[label];
+						if (elkan)
+						{
+							real * l = &lower[static_cast<size_t>(i) * k];
+							for (int j=0; j<k; j++)
+							{
+								l[j] = std::max(l[j] - movement[j], real(0));
+							}
+							if (upper[i] > half_separation[label])
+							{
+								bool tight = false;
+								for (int j=0; j<k; j++)
+								{
+									if (j == label || upper[i] <= l[j] || upper[i] <= center_distance[label * k + j] / 2)
+									{
+										continue;
+									}
+									if (!tight)
+									{
+										upper[i] = l[label] = get_distance(data[i], centroids[label]);
+										distances++;
+										tight = true;
+										if (upper[i] <= l[j] || upper[i] <= center_distance[label * k + j] / 2)
+										{
+											continue;
+										}
+									}
+									l[j] = get_distance(data[i], centroids[j]);
+									distances++;
+									if (l[j] < upper[i])
+									{
+										label = j;
+										upper[i] = l[j];
+									}
+								}
+							}
+						}else
+						{
+							lower[i] -= label == fastest ? second_movement : movement[fastest];
+							const real bound = std::max(half_separation[label], lower[i]);
+							if (upper[i] > bound)
+							{
+								upper[i] = get_distance(data[i], centroids[label]);
+								distances++;
+								if (upper[i] > bound)
+								{
+									real best = FLT_MAX, second = FLT_MAX;
+									if (flat)
+									{
+										points.squared_distances(i, 1, &squared_distance[0]);
+									}
+									for (int j=0; j<k; j++)
+									{
+										const real d = flat ? std::sqrt(squared_distance[j]) : get_distance(data[i], centroids[j]);
+										if (d < best)
+										{
+											second = best;
+											best = d;
+											label = j;
+										}else if (d < second)
+										{
+											second = d;
+										}
+									}
+									distances += k;
+									upper[i] = best;
+									lower[i] = second;
+								}
+							}
+						}
+						if (label != previous)
+						{
+							labels[i] = static_cast<L>(label);
+							changes++;
+						}
+					}
+					thread_distances[t] = distances;
+					thread_changes[t] = changes;
+				}
+
+				unsigned int changed = 0;
+				for (int t=0; t<threads; t++)
+				{
+					result.distances += thread_distances[t];
+					changed += thread_changes[t];
+				}
+				result.distances += static_cast<double>(k) * (k + 1) / 2;
+				if (options.criterion != Lloyd_Options::CENTROID_SHIFT && changed <= options.tolerance * n)
+				{
+					result.converged = true;
+					break;
+				}
+			}
+
+			// the exact inertia of the final assignment
+			double inertia = 0;
+#pragma omp parallel for reduction(+:inertia)
+			for (i=0; i<n; i++)
+			{
+				const real d = get_distance(data[i], centroids[labels[i]]);
+				inertia += d * d;
+			}
+			result.inertia = inertia;
+			result.distances += n;
+			return result;
+		}
+
+	private:
+
+		/// the means of the points of each cluster, a cluster without points keeps its centroid
+		template <class T, class L>
+		static void update_centroids(const std::vector<T> & data, const int k, const L * labels, std::vector<T> & centroids, T get_centroid(const std::vector<T> & list), const bool sums)
+		{
+			const int n = static_cast<int>(data.size());
+			if (!sums)
+			{
+				std::vector<std::vector<T> > clusters(k);
+				for (int i=0; i<n; i++)
+				{
+					clusters[labels[i]].push_back(data[i]);
+				}
+				for (int j=0; j<k; j++)
+				{
+					if (!clusters[j].empty())
+					{
+						centroids[j] = get_centroid(clusters[j]);
+					}
+				}
+				return;
+			}
+
+			// per thread sums, merged in thread order
+			const int threads = parallel_utility::get_thread_number();
+			const T zero = data[0] - data[0];
+			std::vector<T> thread_sums(threads * k, zero);
+			std::vector<unsigned int> thread_sizes(threads * k, 0);
+#pragma omp parallel
+			{
+				const int t = parallel_utility::get_thread_index();
+				int i;
+#pragma omp for schedule(static)
+				for (i=0; i<n; i++)
+				{
+					thread_sums[t * k + labels[i]] += data[i];
+					thread_sizes[t * k + labels[i]]++;
+				}
+			}
+			for (int j=0; j<k; j++)
+			{
+				T sum = zero;
+				unsigned int size = 0;
+				for (int t=0; t<threads; t++)
+				{
+					sum += thread_sums[t * k + j];
+					size += thread_sizes[t * k + j];
+				}
+				if (size > 0)
+				{
+					centroids[j] = sum / static_cast<real>(size);
+				}
+			}
+		}
+	};
+}
+
+#endif // K_Means_Bounded_h
@@ -0,0 +1,301 @@
+/**	@file
+* a header file for the K_Means_Coreset class
+*/
+
+#pragma once
+
+#ifndef K_Means_Coreset_h
+#define K_Means_Coreset_h
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <ctime>
+
+#include "K_Means_Lloyd.h"
+#include "K_Means_Seeding.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
+	/**	@brief	A hash table from 64-bit keys to entry indices, with open addressing
+	*
+	*/
+	class Key_Table
+	{
+	public:
+
+		static const unsigned int NOT_FOUND = 0xFFFFFFFFu;
+
+		explicit Key_Table(const size_t expected = 1024)
+		{
+			reset(expected);
+		}
+
+		/// remove all keys and make room for the expected number of keys
+		void reset(const size_t expected)
+		{
+			size_t capacity = 16;
+			while (capacity < 2 * expected)
+			{
+				capacity *= 2;
+			}
+			const unsigned long long empty = EMPTY;
+			const unsigned int not_found = NOT_FOUND;
+			keys.assign(capacity, empty);
+			entries.assign(capacity, not_found);
+			size = 0;
+		}
+
+		/// the entry of key, a new key gets the entry size() before the insertion
+		unsigned int insert(const unsigned long long key)
+		{
+			if (2 * (size + 1) > keys.size())
+			{
+				grow();
+			}
+			size_t slot = locate(key);
+			if (keys[slot] == EMPTY)
+			{
+				keys[slot] = key;
+				entries[slot] = static_cast<unsigned int>(size++);
+			}
+			return entries[slot];
+		}
+
+		/// the entry of key, NOT_FOUND if it is not in the table
+		unsigned int find(const unsigned long long key) const
+		{
+			return entries[locate(key)];
+		}
+
+		size_t get_size() const
+		{
+			return size;
+		}
+
+	private:
+		static const unsigned long long EMPTY = 0xFFFFFFFFFFFFFFFFULL;
+
+		std::vector<unsigned long long> keys;
+		std::vector<unsigned int> entries;
+		size_t size;
+
+		/// the slot of key or the empty slot where it would go
+		size_t locate(const unsigned long long key) const
+		{
+			const size_t mask = keys.size() - 1;
+			size_t slot = static_cast<size_t>(Random::hash(key)) & mask;
+			while (keys[slot] != EMPTY && keys[slot] != key)
+			{
+				slot = (slot + 1) & mask;
+			}
+			return slot;
+		}
+
+		void grow()
+		{
+			std::vector<unsigned long long> old_keys;
+			std::vector<unsigned int> old_entries;
+			old_keys.swap(keys);
+			old_entries.swap(entries);
+			const unsigned long long empty = EMPTY;
+			const unsigned int not_found = NOT_FOUND;
+			keys.assign(old_keys.size() * 2, empty);
+			entries.assign(old_keys.size() * 2, not_found);
+			for (size_t i=0; i<old_keys.size(); i++)
+			{
+				if (old_keys[i] != EMPTY)
+				{
+					const size_t slot = locate(old_keys[i]);
+					keys[slot] = old_keys[i];
+					entries[slot] = old_entries[i];
+				}
+			}
+		}
+	};
+
+	/**	@brief	k-means on a weighted coreset of quantized features
+	*
+	*	Each component of the features is quantized into levels steps between its minimum and maximum.
+	*	The points of a cell of the quantization grid are replaced by their mean, weighted by their number.
+	*	Weighted k-means++ and K_Means_Lloyd cluster the cells, and the points take the labels of their cells.
+	*	The features of 8/16-bit volumes fall into far fewer cells than there are voxels, so the clustering
+	*	costs scale with the number of distinct features, and the volume is read only three times:
+	*	for the ranges, the cells and the labels.
+	*
+	*	The cells are found with a hash table per thread, merged into one table and ordered by their keys,
+	*	so the coreset does not depend on the number of threads.
+	*/
+	class K_Means_Coreset
+	{
+	public:
+
+		/// quantize the features into coreset, weights holds the number of points of each cell
+		/// and cells the cell of each point. Return the number of cells.
+		static unsigned int build(const Feature_Set & features, const int levels, Feature_Set & coreset, std::vector<float> & weights, std::vector<unsigned int> & cells)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int threads = parallel_utility::get_thread_number();
+			const int n = static_cast<int>(count);
+
+			// the quantization steps, the levels of all components have to fit in a 64-bit key
+			const int bits = std::min(64 / dimension, 20);
+			const int used_levels = std::max(2, std::min(levels, 1 << bits));
+			std::vector<float> lower(dimension), scale(dimension);
+			for (int d=0; d<dimension; d++)
+			{
+				const float * x = features.component(d);
+				std::vector<float> thread_lower(threads, FLT_MAX), thread_upper(threads, -FLT_MAX);
+				int i;
+#pragma omp parallel
+				{
+					const int t = parallel_utility::get_thread_index();
+#pragma omp for
+					for (i=0; i<n; i++)
+					{
+						thread_lower[t] = std::min(thread_lower[t], x[i]);
+						thread_upper[t] = std::max(thread_upper[t], x[i]);
+					}
+				}
+				lower[d] = *std::min_element(thread_lower.begin(), thread_lower.end());
+				const float upper = *std::max_element(thread_upper.begin(), thread_upper.end());
+				scale[d] = upper > lower[d] ? (used_levels - 1) / (upper - lower[d]) : 0;
+			}
+
+			// cells and sums per thread
+			std::vector<Key_Table> tables(threads);
+			std::vector<std::vector<unsigned long long> > thread_keys(threads);
+			std::vector<std::vector<double> > thread_sums(threads);
+			std::vector<std::vector<double> > thread_weights(threads);
+			int i;
+#pragma omp parallel
+			{
+				const int t = parallel_utility::get_thread_index();
+				Key_Table & table = tables[t];
+#pragma omp for schedule(static)
+				for (i=0; i<n; i++)
+				{
+					const unsigned long long key = get_key(features, i, &lower[0], &scale[0], bits);
+					const unsigned int entry = table.insert(key);
+					if (entry == thread_keys[t].size())
+					{
+						thread_keys[t].push_back(key);
+						thread_weights[t].push_back(0);
+						thread_sums[t].resize(thread_sums[t].size() + dimension, 0);
+					}
+					thread_weights[t][entry]++;
+					for (int d=0; d<dimension; d++)
+					{
+						thread_sums[t][entry * dimension + d] += features.get(i, d);
+					}
+				}
+			}
+
+			// merge the threads, then order the cells by their keys
+			Key_Table merged;
+			std::vector<unsigned long long> keys;
+			std::vector<double> sums, cell_weights;
+			for (int t=0; t<threads; t++)
+			{
+				for (size_t e=0; e<thread_keys[t].size(); e++)
+				{
+					const unsigned int entry = merged.insert(thread_keys[t][e]);
+					if (entry == keys.size())
+					{
+						keys.push_back(thread_keys[t][e]);
+						cell_weights.push_back(0);
+						sums.resize(sums.size() + dimension, 0);
+					}
+					cell_weights[entry] += thread_weights[t][e];
+					for (int d=0; d<dimension; d++)
+					{
+						sums[entry * dimension + d] += thread_sums[t][e * dimension + d];
+					}
+				}
+			}
+			const unsigned int m = static_cast<unsigned int>(keys.size());
+			std::vector<std::pair<unsigned long long, unsigned int> > order(m);
+			for (unsigned int e=0; e<m; e++)
+			{
+				order[e] = std::make_pair(keys[e], e);
+			}
+			std::sort(order.begin(), order.end());
+
+			coreset.resize(m, dimension);
+			weights.resize(m);
+			merged.reset(m);
+			for (unsigned int c=0; c<m; c++)
+			{
+				const unsigned int e = order[c].second;
+				merged.insert(order[c].first);
+				weights[c] = static_cast<float>(cell_weights[e]);
+				for (int d=0; d<dimension; d++)
+				{
+					coreset.set(c, d, static_cast<float>(sums[e * dimension + d] / cell_weights[e]));
+				}
+			}
+
+			// the cell of each point
+			cells.resize(count);
+#pragma omp parallel for
+			for (i=0; i<n; i++)
+			{
+				cells[i] = merged.find(get_key(features, i, &lower[0], &scale[0], bits));
+			}
+			return m;
+		}
+
+		/// cluster the features through a coreset of levels steps per component, the centroids are written row by row
+		template <class L>
+		static Lloyd_Result run(const Feature_Set & features, const int k, const int levels, std::vector<float> & centroids, L * labels,
+			const Lloyd_Options & options, const unsigned long long random_seed)
+		{
+			Feature_Set coreset;
+			std::vector<float> weights;
+			std::vector<unsigned int> cells;
+			const unsigned int m = build(features, levels, coreset, weights, cells);
+
+			std::vector<int> cell_labels(m);
+			K_Means_Seeding::seed_plus_plus(coreset, k, centroids, random_seed, &weights[0]);
+			Lloyd_Result result = K_Means_Lloyd::run(coreset, k, centroids, &cell_labels[0], options, &weights[0]);
+
+			const int n = static_cast<int>(features.get_count());
+			int i;
+#pragma omp parallel for
+			for (i=0; i<n; i++)
+			{
+				labels[i] = static_cast<L>(cell_labels[cells[i]]);
+			}
+			return result;
+		}
+
+		/// cluster points of nv::vec2f, vec3f or vec4f through a coreset of levels steps per component
+		template <class T>
+		static Lloyd_Result k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, const int levels = 256,
+			const Lloyd_Options & options = Lloyd_Options())
+		{
+			Feature_Set features;
+			features.assign(data);
+			std::vector<float> centroids;
+			return run(features, k, levels, centroids, label_ptr, options, static_cast<unsigned long long>(time(NULL)));
+		}
+
+	private:
+
+		/// the key of the cell of point i, bits per component
+		static unsigned long long get_key(const Feature_Set & features, const unsigned int i, const float * lower, const float * scale, const int bits)
+		{
+			unsigned long long key = 0;
+			for (int d=0; d<features.get_dimension(); d++)
+			{
+				const unsigned long long level = static_cast<unsigned long long>((features.get(i, d) - lower[d]) * scale[d] + 0.5f);
+				key = (key << bits) | level;
+			}
+			return key;
+		}
+	};
+}
+
+#endif // K_Means_Coreset_h
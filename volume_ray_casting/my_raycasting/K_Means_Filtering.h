@@ -0,0 +1,74 @@
+/**	@file
+* a header file for the K_Means_Filtering class
+*/
+
+#pragma once
+
+#ifndef K_Means_Filtering_h
+#define K_Means_Filtering_h
+
+#include <vector>
+
+#include "kmpp/KMeansPP.h"
+#include "kmpp/KmTree.h"
+#include "K_Means_Lloyd.h"
+
+namespace clustering
+{
+	/**	@brief	k-means++ with the filtering algorithm of Kanungo and Mount on a kd-tree (kmpp/KmTree)
+	*
+	*	The tree is built once over the single precision features, which it reads in place, so the features
+	*	are neither copied to double nor reordered and have to outlive the object. Each node keeps the
+	*	bounding box and the sum of its points, and a k-means step assigns whole nodes to the only centroid
+	*	that can be nearest to their boxes. For the 3 dimensional features of the volumes most nodes are
+	*	decided high in the tree, and voxels with equal features end up in one leaf.
+	*
+	*	One object serves any number of runs: the attempts of a run and later runs with other k reuse the tree.
+	*/
+	class K_Means_Filtering
+	{
+	public:
+
+		/// build the tree over count points of dimension values each, stored point by point
+		K_Means_Filtering(const float * points, const int count, const int dimension)
+			: tree(count, dimension, points), assignments(count)
+		{
+		}
+
+		/// build the tree over points of nv::vec2f, vec3f or vec4f, whose components are stored contiguously
+		template <class T>
+		explicit K_Means_Filtering(const std::vector<T> & data)
+			: tree(static_cast<int>(data.size()), Feature_Traits<T>::dimension, reinterpret_cast<const float *>(&data[0])), assignments(data.size())
+		{
+		}
+
+		/// run k-means++ attempts times and write the labels of the run with the lowest cost, which is returned
+		double k_means(const int k, unsigned char * label_ptr, const int attempts = 1)
+		{
+			const double cost = RunKMeansPlusPlus(tree, k, attempts, NULL, &assignments[0]);
+			for (size_t i=0; i<assignments.size(); i++)
+			{
+				label_ptr[i] = static_cast<unsigned char>(assignments[i]);
+			}
+			return cost;
+		}
+
+		/// cluster points of nv::vec2f, vec3f or vec4f with a tree built for this call
+		template <class T>
+		static double k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, const int attempts = 1)
+		{
+			K_Means_Filtering filtering(data);
+			return filtering.k_means(k, label_ptr, attempts);
+		}
+
+	private:
+		KmTree tree;
+		std::vector<int> assignments;
+
+		// the tree owns raw memory
+		K_Means_Filtering(const K_Means_Filtering &);
+		K_Means_Filtering & operator=(const K_Means_Filtering &);
+	};
+}
+
+#endif // K_Means_Filtering_h
@@ -0,0 +1,355 @@
+/**	@file
+* a header file for the K_Means_Lloyd class
+*/
+
+#pragma once
+
+#ifndef K_Means_Lloyd_h
+#define K_Means_Lloyd_h
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <nvMath.h>
+
+#include "Distance_Kernel.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
+	/**	@brief	Access to the components of a feature type, dimension is 0 for types without a flat layout
+	*
+	*/
+	template <class T>
+	struct Feature_Traits
+	{
+		enum { dimension = 0 };
+	};
+
+	template <>
+	struct Feature_Traits<nv::vec2f>
+	{
+		enum { dimension = 2 };
+		static float get(const nv::vec2f & v, const int d) { return v[d]; }
+		static void set(nv::vec2f & v, const int d, const float x) { v[d] = x; }
+	};
+
+	template <>
+	struct Feature_Traits<nv::vec3f>
+	{
+		enum { dimension = 3 };
+		static float get(const nv::vec3f & v, const int d) { return v[d]; }
+		static void set(nv::vec3f & v, const int d, const float x) { v[d] = x; }
+	};
+
+	template <>
+	struct Feature_Traits<nv::vec4f>
+	{
+		enum { dimension = 4 };
+		static float get(const nv::vec4f & v, const int d) { return v[d]; }
+		static void set(nv::vec4f & v, const int d, const float x) { v[d] = x; }
+	};
+
+	/**	@brief	Points stored as a structure of arrays
+	*
+	*	Component d of point i is at component(d)[i], so a loop over the points reads contiguous memory
+	*	and the compiler can vectorize the distance computations.
+	*/
+	class Feature_Set
+	{
+	public:
+
+		Feature_Set() : count(0), dimension(0)
+		{
+		}
+
+		void resize(const unsigned int point_count, const int point_dimension)
+		{
+			count = point_count;
+			dimension = point_dimension;
+			values.assign(static_cast<size_t>(count) * dimension, 0);
+		}
+
+		/// copy points of a type with Feature_Traits
+		template <class T>
+		void assign(const std::vector<T> & data)
+		{
+			resize(static_cast<unsigned int>(data.size()), Feature_Traits<T>::dimension);
+			const int n = static_cast<int>(count);
+			int i;
+#pragma omp parallel for
+			for (i=0; i<n; i++)
+			{
+				for (int d=0; d<dimension; d++)
+				{
+					values[static_cast<size_t>(d) * count + i] = Feature_Traits<T>::get(data[i], d);
+				}
+			}
+		}
+
+		unsigned int get_count() const
+		{
+			return count;
+		}
+
+		int get_dimension() const
+		{
+			return dimension;
+		}
+
+		float * component(const int d)
+		{
+			return &values[static_cast<size_t>(d) * count];
+		}
+
+		const float * component(const int d) const
+		{
+			return &values[static_cast<size_t>(d) * count];
+		}
+
+		float get(const unsigned int i, const int d) const
+		{
+			return values[static_cast<size_t>(d) * count + i];
+		}
+
+		void set(const unsigned int i, const int d, const float x)
+		{
+			values[static_cast<size_t>(d) * count + i] = x;
+		}
+
+	private:
+		unsigned int count;
+		int dimension;
+		std::vector<float> values;
+	};
+
+	/**	@brief	When the Lloyd iteration stops
+	*
+	*	CENTROID_SHIFT: no centroid moves farther than tolerance.
+	*	LABEL_CHANGES: at most the fraction tolerance of the points changes its cluster.
+	*	INERTIA: the sum of squared distances decreases by at most the fraction tolerance.
+	*	The iteration stops after max_iterations in any case.
+	*/
+	struct Lloyd_Options
+	{
+		enum Criterion { CENTROID_SHIFT, LABEL_CHANGES, INERTIA };
+
+		Criterion criterion;
+		float tolerance;
+		int max_iterations;
+
+		Lloyd_Options(const Criterion criterion = CENTROID_SHIFT, const float tolerance = 1e-4f, const int max_iterations = 300)
+			: criterion(criterion), tolerance(tolerance), max_iterations(max_iterations)
+		{
+		}
+	};
+
+	/**	@brief	The outcome of a Lloyd iteration
+	*
+	*/
+	struct Lloyd_Result
+	{
+		int iterations;
+		/// the sum of squared distances of the points to their centroids in the last assignment
+		double inertia;
+		/// the number of point to centroid distances computed
+		double distances;
+		bool converged;
+
+		Lloyd_Result() : iterations(0), inertia(0), distances(0), converged(false)
+		{
+		}
+	};
+
+	/**	@brief	The Lloyd iteration of k-means on a Feature_Set
+	*
+	*	The points are assigned in blocks distributed over the threads. Each thread adds its points to its own
+	*	sums and sizes of the clusters, which are merged in thread order for the new centroids,
+	*	so an iteration allocates nothing. The centroids are stored row by row, k * dimension values.
+	*	A cluster that loses all its points keeps its centroid. Points may carry weights, a point of weight w
+	*	counts as w points at the same position. The points are assigned by the squared Euclidean distance or
+	*	by another metric of Distance_Kernel, whose scales are fixed, so the means stay the centroids.
+	*/
+	class K_Means_Lloyd
+	{
+	public:
+
+		/// the number of points whose distances are computed together
+		static const int BLOCK_SIZE = 256;
+
+		/// label the points [first, first + n) with their nearest centroids and return the sum of squared distances.
+		/// best_distance and best_label hold BLOCK_SIZE values.
+		static double assign_block(const Feature_Set & features, const float * centroids, const int k, const unsigned int first, const int n,
+			float * best_distance, int * best_label)
+		{
+			return assign_block(features, centroids, k, first, n, best_distance, best_label, Squared_Euclidean());
+		}
+
+		/// assign_block by the distance of a metric
+		template <class M>
+		static double assign_block(const Feature_Set & features, const float * centroids, const int k, const unsigned int first, const int n,
+			float * best_distance, int * best_label, const M & metric)
+		{
+			return Distance_Kernel<M>::nearest(features.component(0) + first, features.get_count(), features.get_dimension(), centroids, k, n,
+				best_distance, best_label, metric);
+		}
+
+		/// run the Lloyd iteration from the given centroids, which are updated, and write the labels.
+		/// weights holds a weight per point, NULL for weights of 1
+		template <class L>
+		static Lloyd_Result run(const Feature_Set & features, const int k, std::vector<float> & centroids, L * labels, const Lloyd_Options & options = Lloyd_Options(),
+			const float * weights = NULL)
+		{
+			return run(features, k, centroids, labels, options, weights, Squared_Euclidean());
+		}
+
+		/// run by the distance of a metric, the inertia is the sum of the distances of the metric
+		template <class L, class M>
+		static Lloyd_Result run(const Feature_Set & features, const int k, std::vector<float> & centroids, L * labels, const Lloyd_Options & options,
+			const float * weights, const M & metric)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int blocks = static_cast<int>((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+			const int threads = parallel_utility::get_thread_number();
+			const int stride = k * dimension;
+
+			// per thread: sums of the points of each cluster, sizes, inertia and label changes
+			std::vector<double> sums(threads * stride);
+			std::vector<double> sizes(threads * k);
+			std::vector<double> inertias(threads);
+			std::vector<unsigned int> changes(threads);
+			std::vector<double> total(stride);
+			std::vector<double> total_size(k);
+
+			Lloyd_Result result;
+			double previous_inertia = DBL_MAX;
+			while (result.iterations < options.max_iterations)
+			{
+				std::fill(sums.begin(), sums.end(), 0.0);
+				std::fill(sizes.begin(), sizes.end(), 0.0);
+				std::fill(inertias.begin(), inertias.end(), 0.0);
+				std::fill(changes.begin(), changes.end(), 0);
+
+#pragma omp parallel
+				{
+					const int t = parallel_utility::get_thread_index();
+					double * sum = &sums[t * stride];
+					double * size = &sizes[t * k];
+					float best_distance[BLOCK_SIZE];
+					int best_label[BLOCK_SIZE];
+					int b;
+#pragma omp for schedule(static)
+					for (b=0; b<blocks; b++)
+					{
+						const unsigned int first = static_cast<unsigned int>(b) * BLOCK_SIZE;
+						const int n = static_cast<int>(std::min<unsigned int>(BLOCK_SIZE, count - first));
+						const double block_inertia = assign_block(features, &centroids[0], k, first, n, best_distance, best_label, metric);
+						for (int p=0; p<n; p++)
+						{
+							const int label = best_label[p];
+							if (result.iterations == 0 || labels[first + p] != static_cast<L>(label))
+							{
+								changes[t]++;
+								labels[first + p] = static_cast<L>(label);
+							}
+						}
+						if (weights)
+						{
+							const float * w = weights + first;
+							for (int p=0; p<n; p++)
+							{
+								size[best_label[p]] += w[p];
+								inertias[t] += w[p] * best_distance[p];
+							}
+							for (int d=0; d<dimension; d++)
+							{
+								const float * x = features.component(d) + first;
+								for (int p=0; p<n; p++)
+								{
+									sum[best_label[p] * dimension + d] += w[p] * x[p];
+								}
+							}
+						}else
+						{
+							for (int p=0; p<n; p++)
+							{
+								size[best_label[p]]++;
+							}
+							inertias[t] += block_inertia;
+							for (int d=0; d<dimension; d++)
+							{
+								const float * x = features.component(d) + first;
+								for (int p=0; p<n; p++)
+								{
+									sum[best_label[p] * dimension + d] += x[p];
+								}
+							}
+						}
+					}
+				}
+
+				// merge the threads in order and move the centroids
+				std::fill(total.begin(), total.end(), 0.0);
+				std::fill(total_size.begin(), total_size.end(), 0.0);
+				double inertia = 0;
+				unsigned int changed = 0;
+				for (int t=0; t<threads; t++)
+				{
+					for (int i=0; i<stride; i++)
+					{
+						total[i] += sums[t * stride + i];
+					}
+					for (int c=0; c<k; c++)
+					{
+						total_size[c] += sizes[t * k + c];
+					}
+					inertia += inertias[t];
+					changed += changes[t];
+				}
+				float max_shift = 0;
+				for (int c=0; c<k; c++)
+				{
+					if (total_size[c] == 0)
+					{
+						continue;
+					}
+					float shift = 0;
+					for (int d=0; d<dimension; d++)
+					{
+						const float center = static_cast<float>(total[c * dimension + d] / total_size[c]);
+						const float difference = center - centroids[c * dimension + d];
+						shift += difference * difference;
+						centroids[c * dimension + d] = center;
+					}
+					max_shift = std::max(max_shift, shift);
+				}
+				result.iterations++;
+				result.inertia = inertia;
+				result.distances += static_cast<double>(count) * k;
+
+				switch (options.criterion)
+				{
+				case Lloyd_Options::CENTROID_SHIFT:
+					result.converged = std::sqrt(max_shift) <= options.tolerance;
+					break;
+				case Lloyd_Options::LABEL_CHANGES:
+					result.converged = result.iterations > 1 && changed <= options.tolerance * count;
+					break;
+				case Lloyd_Options::INERTIA:
+					result.converged = previous_inertia - inertia <= options.tolerance * inertia;
+					break;
+				}
+				previous_inertia = inertia;
+				if (result.converged)
+				{
+					break;
+				}
+			}
+			return result;
+		}
+	};
+}
+
+#endif // K_Means_Lloyd_h
@@ -5,10 +5,14 @@
 #ifndef K_Means_Local_h
 #define K_Means_Local_h
 
-namespace clustering
-{
+#include <vector>
 
 #include "kmlocal/KMlocal.h"
+#include "K_Means_Lloyd.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
 
 	/**	@brief	A class for k-means local clustering.
 	*	
@@ -21,14 +25,23 @@ namespace clustering
 	*	http://www.cs.umd.edu/~mount/Projects/KMeans/pami02.pdf
 	*	
 	*	http://www.cs.umd.edu/~mount/Projects/KMeans/kmlocal-1.7.2.zip
+	*	
+	*	The points are nv::vec2f, vec3f or vec4f. With KM_FLOAT_COORD defined (see kmlocal/KM_ANN.h) the
+	*	kc-tree is built over the points in place, otherwise they are copied to double.
+	*	
+	*	The swap based heuristics try as many swaps per stage as there are threads, and evaluate them in parallel.
 	*/
 	class K_Means_Local
 	{
 	public:
-		static void k_means(const unsigned int count, const vector<float> & scalar_value, const vector<float> & gradient_magnitude, const vector<float> & second_derivative_magnitude, const int k, unsigned char *& label_ptr)
+		/// the local search heuristics of kmlocal
+		enum Method { LLOYDS, SWAP, EZ_HYBRID, HYBRID };
+
+		template <class T>
+		static void k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, const Method method = LLOYDS)
 		{
-			int	dim		= 3;		// dimension
-			int	maxPts		= static_cast<int>(count);		// max number of data points
+			int	dim		= Feature_Traits<T>::dimension;		// dimension
+			int	maxPts		= static_cast<int>(data.size());		// max number of data points
 			int	stages		= 100;		// number of stages
 
 			//----------------------------------------------------------------------
@@ -44,17 +57,19 @@ namespace clustering
 				10,			// temp. run length
 				0.95);			// temp. reduction factor
 			term.setAbsMaxTotStage(stages);		// set number of stages
-			KMdata dataPts(dim, maxPts);	// allocate data storage
 
-#if 0
-			kmClusGaussPts(dataPts.getPts(), maxPts, dim, k);
+#ifdef KM_FLOAT_COORD
+			// the points are only read
+			KMdata dataPts(dim, maxPts, const_cast<KMcoord *>(reinterpret_cast<const KMcoord *>(&data[0])));
 #else
+			KMdata dataPts(dim, maxPts);	// allocate data storage
+
 			// read the points
 			KMpointArray pa = dataPts.getPts();
 			for (int i = 0; i < dataPts.getNPts(); i++) {
-				pa[i][0] = scalar_value[i];
-				pa[i][1] = gradient_magnitude[i];
-				pa[i][2] = second_derivative_magnitude[i];
+				for (int d = 0; d < dim; d++) {
+					pa[i][d] = Feature_Traits<T>::get(data[i], d);
+				}
 			}
 #endif
 
@@ -62,8 +77,25 @@ namespace clustering
 			KMfilterCenters ctrs(k, dataPts);		// allocate centers
 
 			// run the k-means algorithm
-			KMlocalLloyds km(ctrs, term);
-			ctrs = km.execute();			// execute
+			KMlocal * km;
+			switch (method)
+			{
+			case SWAP:
+				km = new KMlocalSwap(ctrs, term);
+				break;
+			case EZ_HYBRID:
+				km = new KMlocalEZ_Hybrid(ctrs, term);
+				break;
+			case HYBRID:
+				km = new KMlocalHybrid(ctrs, term);
+				break;
+			default:
+				km = new KMlocalLloyds(ctrs, term);
+				break;
+			}
+			km->setSwapCands(parallel_utility::get_thread_number());
+			ctrs = km->execute();			// execute
+			delete km;
 
 			// get/print final cluster assignments
 			KMctrIdxArray closeCtr = new KMctrIdx[dataPts.getNPts()];
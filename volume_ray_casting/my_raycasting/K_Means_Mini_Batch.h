@@ -0,0 +1,294 @@
+/**	@file
+* a header file for the K_Means_Mini_Batch class
+*/
+
+#pragma once
+
+#ifndef K_Means_Mini_Batch_h
+#define K_Means_Mini_Batch_h
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <ctime>
+#include <iostream>
+
+#include "K_Means_PP_Generic.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
+	/**	@brief	When the mini-batch iteration stops
+	*
+	*	The iteration stops after max_batches batches, or when the smoothed inertia of the batches
+	*	has not improved for patience batches in a row.
+	*/
+	struct Mini_Batch_Options
+	{
+		int batch_size;
+		int max_batches;
+		int patience;
+
+		Mini_Batch_Options(const int batch_size = 4096, const int max_batches = 200, const int patience = 10)
+			: batch_size(batch_size), max_batches(max_batches), patience(patience)
+		{
+		}
+	};
+
+	/**	@brief	Mini-batch k-means (Sculley) on a Feature_Set
+	*
+	*	Each batch draws batch_size points uniformly at random, assigns them to their nearest centroids on all
+	*	threads and moves every centroid towards the mean of its points in the batch. A centroid that has seen
+	*	v points in all batches moves by the fraction 1 / v per point, so the steps shrink as the centroid settles.
+	*	The seeds are drawn by k-means++ from a sample of 3 batches, and one final pass assigns all points.
+	*	The cost apart from the final pass does not depend on the number of points, which makes the labels
+	*	of large volumes available in a fraction of the time of the Lloyd iteration, at a slightly higher inertia.
+	*
+	*	The points of a batch are drawn from hashes of their positions in the batch, and the threads sum
+	*	their parts of the batch separately, so the result depends only on random_seed and the thread count.
+	*
+	*	Sculley D. Web-scale k-means clustering. WWW 2010.
+	*/
+	class K_Means_Mini_Batch
+	{
+	public:
+
+		/// cluster the features, the centroids are written row by row
+		template <class L>
+		static Lloyd_Result run(const Feature_Set & features, const int k, std::vector<float> & centroids, L * labels,
+			const Mini_Batch_Options & options, const unsigned long long random_seed)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int threads = parallel_utility::get_thread_number();
+			const int stride = k * dimension;
+			const int batch_size = static_cast<int>(std::min<unsigned int>(options.batch_size, count));
+			Random random(random_seed);
+			Lloyd_Result result;
+
+			// the seeds from a sample
+			Feature_Set batch;
+			sample(features, static_cast<int>(std::min<unsigned int>(3 * batch_size, count)), random.next(), batch);
+			K_Means_Seeding::seed_plus_plus(batch, k, centroids, random.next());
+
+			std::vector<double> sums(threads * stride);
+			std::vector<double> sizes(threads * k);
+			std::vector<double> inertias(threads);
+			std::vector<double> seen(k, 0);
+			const int blocks = (batch_size + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE;
+
+			// the inertia per point, smoothed over about count / batch_size batches
+			const double alpha = std::min(2.0 * batch_size / (count + 1.0), 1.0);
+			double smoothed = -1, best = DBL_MAX;
+			int no_improvement = 0;
+			while (result.iterations < options.max_batches)
+			{
+				sample(features, batch_size, random.next(), batch);
+				std::fill(sums.begin(), sums.end(), 0.0);
+				std::fill(sizes.begin(), sizes.end(), 0.0);
+				std::fill(inertias.begin(), inertias.end(), 0.0);
+#pragma omp parallel
+				{
+					const int t = parallel_utility::get_thread_index();
+					double * sum = &sums[t * stride];
+					double * size = &sizes[t * k];
+					float best_distance[K_Means_Lloyd::BLOCK_SIZE];
+					int best_label[K_Means_Lloyd::BLOCK_SIZE];
+					int b;
+#pragma omp for schedule(static)
+					for (b=0; b<blocks; b++)
+					{
+						const unsigned int first = static_cast<unsigned int>(b) * K_Means_Lloyd::BLOCK_SIZE;
+						const int n = std::min(K_Means_Lloyd::BLOCK_SIZE, batch_size - static_cast<int>(first));
+						inertias[t] += K_Means_Lloyd::assign_block(batch, &centroids[0], k, first, n, best_distance, best_label);
+						for (int p=0; p<n; p++)
+						{
+							size[best_label[p]]++;
+						}
+						for (int d=0; d<dimension; d++)
+						{
+							const float * x = batch.component(d) + first;
+							for (int p=0; p<n; p++)
+							{
+								sum[best_label[p] * dimension + d] += x[p];
+							}
+						}
+					}
+				}
+
+				// move each centroid by its learning rate, merging the threads in order
+				double inertia = 0;
+				for (int t=0; t<threads; t++)
+				{
+					inertia += inertias[t];
+				}
+				for (int c=0; c<k; c++)
+				{
+					double size = 0;
+					for (int t=0; t<threads; t++)
+					{
+						size += sizes[t * k + c];
+					}
+					if (size == 0)
+					{
+						continue;
+					}
+					seen[c] += size;
+					for (int d=0; d<dimension; d++)
+					{
+						double sum = 0;
+						for (int t=0; t<threads; t++)
+						{
+							sum += sums[t * stride + c * dimension + d];
+						}
+						float & center = centroids[c * dimension + d];
+						center += static_cast<float>((sum - size * center) / seen[c]);
+					}
+				}
+				result.iterations++;
+				result.distances += static_cast<double>(batch_size) * k;
+
+				inertia /= batch_size;
+				smoothed = smoothed < 0 ? inertia : smoothed * (1 - alpha) + inertia * alpha;
+				if (smoothed < best)
+				{
+					best = smoothed;
+					no_improvement = 0;
+				}else if (++no_improvement >= options.patience)
+				{
+					result.converged = true;
+					break;
+				}
+			}
+
+			result.inertia = assign(features, k, centroids, labels);
+			result.distances += static_cast<double>(count) * k;
+			return result;
+		}
+
+		/// label all features with their nearest centroids on all threads and return the sum of squared distances
+		template <class L>
+		static double assign(const Feature_Set & features, const int k, const std::vector<float> & centroids, L * labels)
+		{
+			const unsigned int count = features.get_count();
+			const int blocks = static_cast<int>((count + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE);
+			std::vector<double> inertias(parallel_utility::get_thread_number(), 0.0);
+#pragma omp parallel
+			{
+				const int t = parallel_utility::get_thread_index();
+				float best_distance[K_Means_Lloyd::BLOCK_SIZE];
+				int best_label[K_Means_Lloyd::BLOCK_SIZE];
+				int b;
+#pragma omp for schedule(static)
+				for (b=0; b<blocks; b++)
+				{
+					const unsigned int first = static_cast<unsigned int>(b) * K_Means_Lloyd::BLOCK_SIZE;
+					const int n = static_cast<int>(std::min<unsigned int>(K_Means_Lloyd::BLOCK_SIZE, count - first));
+					inertias[t] += K_Means_Lloyd::assign_block(features, &centroids[0], k, first, n, best_distance, best_label);
+					for (int p=0; p<n; p++)
+					{
+						labels[first + p] = static_cast<L>(best_label[p]);
+					}
+				}
+			}
+			double inertia = 0;
+			for (size_t t=0; t<inertias.size(); t++)
+			{
+				inertia += inertias[t];
+			}
+			return inertia;
+		}
+
+		/// cluster points of nv::vec2f, vec3f or vec4f with the Euclidean distance and the mean as centroid.
+		/// Other distances and centroids are passed to K_Means_PP_Generic::k_means, as the mini-batch steps move
+		/// the centroids towards the means.
+		template <class T>
+		static void k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, K_Means_PP_Generic::real get_distance(const T & v1, const T & v2), T get_centroid(const std::vector<T> & list),
+			const Mini_Batch_Options & options = Mini_Batch_Options())
+		{
+			if (get_distance == &K_Means_PP_Generic::get_distance<T> && get_centroid == &K_Means_PP_Generic::get_centroid<T>
+				&& Adapter<T>::run(data, k, label_ptr, options, static_cast<unsigned long long>(time(NULL))))
+			{
+				return;
+			}
+			K_Means_PP_Generic::k_means(data, k, label_ptr, get_distance, get_centroid);
+		}
+
+		/// print the time and the inertia of the Lloyd iteration and of mini-batches of several sizes on the same features
+		static void benchmark(const Feature_Set & features, const int k, const unsigned long long random_seed, std::ostream & out = std::cout)
+		{
+			std::vector<unsigned char> labels(features.get_count());
+			std::vector<float> centroids;
+
+			double start = parallel_utility::get_time();
+			K_Means_Seeding::seed(features, k, centroids, random_seed);
+			const Lloyd_Result lloyd = K_Means_Lloyd::run(features, k, centroids, &labels[0]);
+			const double lloyd_time = parallel_utility::get_time() - start;
+			const double lloyd_inertia = K_Means_Mini_Batch::assign(features, k, centroids, &labels[0]);
+			out<<"k-means benchmark: "<<features.get_count()<<" points, "<<features.get_dimension()<<" dimensions, k="<<k
+				<<", "<<parallel_utility::get_thread_number()<<" threads"<<std::endl;
+			out<<"Lloyd\t"<<lloyd.iterations<<" iterations\t"<<lloyd_time<<" s\tinertia "<<lloyd_inertia<<std::endl;
+
+			const int batch_sizes[] = {1024, 4096, 16384, 65536};
+			for (int i=0; i<4; i++)
+			{
+				start = parallel_utility::get_time();
+				const Lloyd_Result mini_batch = run(features, k, centroids, &labels[0], Mini_Batch_Options(batch_sizes[i]), random_seed);
+				const double seconds = parallel_utility::get_time() - start;
+				out<<"mini-batch "<<batch_sizes[i]<<"\t"<<mini_batch.iterations<<" batches\t"<<seconds<<" s\tinertia "<<mini_batch.inertia
+					<<" ("<<(lloyd_inertia > 0 ? mini_batch.inertia / lloyd_inertia : 1)<<" of Lloyd, "
+					<<(seconds > 0 ? lloyd_time / seconds : 0)<<" times faster)"<<std::endl;
+			}
+		}
+
+	private:
+
+		/// copy n points drawn uniformly at random with replacement into batch
+		static void sample(const Feature_Set & features, const int n, const unsigned long long key, Feature_Set & batch)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			if (batch.get_count() != static_cast<unsigned int>(n) || batch.get_dimension() != dimension)
+			{
+				batch.resize(n, dimension);
+			}
+			int j;
+#pragma omp parallel for
+			for (j=0; j<n; j++)
+			{
+				const unsigned int i = std::min(static_cast<unsigned int>(Random::to_uniform(Random::hash(key + j)) * count), count - 1);
+				for (int d=0; d<dimension; d++)
+				{
+					batch.set(j, d, features.get(i, d));
+				}
+			}
+		}
+
+		/// run the mini-batches on a vector of points of type T, if T has a flat layout
+		template <class T, int D = Feature_Traits<T>::dimension>
+		struct Adapter
+		{
+			template <class L>
+			static bool run(const std::vector<T> & data, const int k, L * labels, const Mini_Batch_Options & options, const unsigned long long random_seed)
+			{
+				Feature_Set features;
+				features.assign(data);
+				std::vector<float> centroids;
+				K_Means_Mini_Batch::run(features, k, centroids, labels, options, random_seed);
+				return true;
+			}
+		};
+
+		template <class T>
+		struct Adapter<T, 0>
+		{
+			template <class L>
+			static bool run(const std::vector<T> &, const int, L *, const Mini_Batch_Options &, const unsigned long long)
+			{
+				return false;
+			}
+		};
+	};
+}
+
+#endif // K_Means_Mini_Batch_h
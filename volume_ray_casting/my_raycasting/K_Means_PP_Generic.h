@@ -10,6 +10,11 @@
 #include <vector>
 #include <nvMath.h>
 #include <ctime>
+#include <cmath>
+#include <algorithm>
+
+#include "K_Means_Lloyd.h"
+#include "K_Means_Seeding.h"
 
 /**	@brief	A namespace includes classes and functions for clustering
 *	
@@ -21,6 +26,141 @@ namespace clustering
 	//#define _DEBUG_OUTPUT
 	//#endif
 
+	/**	@brief	Seed with K_Means_Seeding and run K_Means_Lloyd on a vector of points of type T, if T has a flat layout
+	*
+	*/
+	template <class T, int D = Feature_Traits<T>::dimension>
+	struct Lloyd_Adapter
+	{
+		template <class L>
+		static bool run(const std::vector<T> & data, const int k, L * labels, const Lloyd_Options & options, const unsigned long long random_seed)
+		{
+			return run(data, k, labels, options, random_seed, Squared_Euclidean());
+		}
+
+		/// the seeds are drawn by the Euclidean distance, the iteration uses the metric
+		template <class L, class M>
+		static bool run(const std::vector<T> & data, const int k, L * labels, const Lloyd_Options & options, const unsigned long long random_seed, const M & metric)
+		{
+			Feature_Set features;
+			features.assign(data);
+			std::vector<float> centroids;
+			K_Means_Seeding::seed(features, k, centroids, random_seed);
+			K_Means_Lloyd::run(features, k, centroids, labels, options, NULL, metric);
+			return true;
+		}
+	};
+
+	template <class T>
+	struct Lloyd_Adapter<T, 0>
+	{
+		template <class L>
+		static bool run(const std::vector<T> &, const int, L *, const Lloyd_Options &, const unsigned long long)
+		{
+			return false;
+		}
+
+		template <class L, class M>
+		static bool run(const std::vector<T> &, const int, L *, const Lloyd_Options &, const unsigned long long, const M &)
+		{
+			return false;
+		}
+	};
+
+	/**	@brief	Points of type T with a flat layout as a Feature_Set, for Distance_Kernel
+	*
+	*	The generic k-means take their distances as function pointers. When such a function is the Euclidean
+	*	distance, the distances to all centroids are computed here for a block of points at once.
+	*	enabled is false for types without a flat layout, which keep calling the function.
+	*/
+	template <class T, int D = Feature_Traits<T>::dimension>
+	class Flat_Points
+	{
+	public:
+
+		enum { enabled = true };
+
+		void assign(const std::vector<T> & data)
+		{
+			features.assign(data);
+		}
+
+		/// copy the centroids row by row
+		void set_centroids(const T * centroids, const int k)
+		{
+			centers.resize(k * D);
+			for (int c=0; c<k; c++)
+			{
+				for (int d=0; d<D; d++)
+				{
+					centers[c * D + d] = Feature_Traits<T>::get(centroids[c], d);
+				}
+			}
+		}
+
+		/// label all points with their nearest centroids
+		template <class L>
+		void label(L * labels) const
+		{
+			const unsigned int count = features.get_count();
+			const int k = static_cast<int>(centers.size()) / D;
+			const int blocks = static_cast<int>((count + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE);
+#pragma omp parallel
+			{
+				float best_distance[K_Means_Lloyd::BLOCK_SIZE];
+				int best_label[K_Means_Lloyd::BLOCK_SIZE];
+				int b;
+#pragma omp for schedule(static)
+				for (b=0; b<blocks; b++)
+				{
+					const unsigned int first = static_cast<unsigned int>(b) * K_Means_Lloyd::BLOCK_SIZE;
+					const int n = static_cast<int>(std::min<unsigned int>(K_Means_Lloyd::BLOCK_SIZE, count - first));
+					K_Means_Lloyd::assign_block(features, &centers[0], k, first, n, best_distance, best_label);
+					for (int p=0; p<n; p++)
+					{
+						labels[first + p] = static_cast<L>(best_label[p]);
+					}
+				}
+			}
+		}
+
+		/// the squared distances of the points [first, first + n) to the centroids, centroid c at distance[c * n + p]
+		void squared_distances(const unsigned int first, const int n, float * distance) const
+		{
+			Distance_Kernel<>::distances(features.component(0) + first, features.get_count(), D, &centers[0], static_cast<int>(centers.size()) / D, n,
+				distance, n);
+		}
+
+	private:
+		Feature_Set features;
+		std::vector<float> centers;
+	};
+
+	template <class T>
+	class Flat_Points<T, 0>
+	{
+	public:
+
+		enum { enabled = false };
+
+		void assign(const std::vector<T> &)
+		{
+		}
+
+		void set_centroids(const T *, const int)
+		{
+		}
+
+		template <class L>
+		void label(L *) const
+		{
+		}
+
+		void squared_distances(const unsigned int, const int, float *) const
+		{
+		}
+	};
+
 	/**	@brief	A generic version of the k-means++ clustering
 	*	
 	*/
@@ -63,6 +203,18 @@ namespace clustering
 			return nv::length(v);
 		}
 
+		/// whether get_distance is the Euclidean distance, which Flat_Points computes with Distance_Kernel
+		template <class T>
+		static bool is_euclidean(real get_distance(const T & v1, const T & v2))
+		{
+			return get_distance == &K_Means_PP_Generic::get_distance<T>;
+		}
+
+		static bool is_euclidean(real get_distance(const nv::vec4f & v1, const nv::vec4f & v2))
+		{
+			return get_distance == &K_Means_PP_Generic::get_distance<nv::vec4f> || get_distance == &get_distance_with_direction;
+		}
+
 		/// get a centroid from a cluster of points
 		static nv::vec3f get_centroid_vec3f(const std::vector<nv::vec3f> & list)
 		{
@@ -103,76 +255,110 @@ namespace clustering
 		* http://en.wikipedia.org/wiki/K-means++
 		*/
 
-		/**	@brief	Do the k-means++ clustering
+		/**	@brief	Choose k initial centroids by D^2 sampling
 		*	
+		*	The first centroid is chosen at random, each next one with a probability proportional to
+		*	the squared distance to its nearest centroid. The Euclidean distances of flat types are
+		*	computed by Flat_Points.
 		*/
 		template <class T>
-		static void k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, real get_distance(const T & v1, const T & v2), T get_centroid(const std::vector<T> & list))
+		static void seed(const std::vector<T> & data, const int k, std::vector<T> & centroids, real get_distance(const T & v1, const T & v2), const unsigned long long random_seed)
 		{
 			const unsigned int count = data.size();
+			Random random(random_seed);
+			unsigned int chosen = random.below(count);
+			centroids.assign(k, data[chosen]);
 
-			std::vector<std::vector<T>> clusters(k);
-			std::vector<T> centroids0(k);
-			std::vector<T> centroids1(k);
-			std::vector<T> * centroids = &centroids0;
-			std::vector<T> * centroids_new = &centroids1;
-			std::vector<T> * temp_ptr;
-
-			real distance;
+			std::vector<real> nearest(count, FLT_MAX);
+			std::vector<double> distance_accumulation(count);
 
+			const bool flat = Flat_Points<T>::enabled && is_euclidean(get_distance);
+			Flat_Points<T> points;
+			std::vector<float> squared_distance;
+			if (flat)
 			{
-				// Make initial guesses for the means m1, m2, ..., mk
-				// choose the first centroid at random
-
-				srand((unsigned)time(NULL));
-				int random = rand() % count;
-				centroids->at(0) = data[random];
+				points.assign(data);
+				squared_distance.resize(K_Means_Lloyd::BLOCK_SIZE);
+			}
 
-				// estimate the total cost
-				real total_cost = 0;
-				//float *distance_accumulation = new float[count];
-				std::vector<real> distance_accumulation(count);
+			// Repeatedly choose more centers
+			for (int cluster_index = 1; cluster_index < k; cluster_index++)
+			{
+				double total_cost = 0;
+				if (flat)
+				{
+					points.set_centroids(&centroids[cluster_index - 1], 1);
+				}
 				for (unsigned int i=0; i<count; i++)
 				{
-					distance = get_distance(data[i], centroids->at(0));
-
-					total_cost += distance;
-					if (i > 0)
+					real distance_squared;
+					if (flat)
 					{
-						distance_accumulation[i] = distance_accumulation[i-1] + distance;
+						const unsigned int p = i % K_Means_Lloyd::BLOCK_SIZE;
+						if (p == 0)
+						{
+							points.squared_distances(i, static_cast<int>(std::min<unsigned int>(K_Means_Lloyd::BLOCK_SIZE, count - i)), &squared_distance[0]);
+						}
+						distance_squared = squared_distance[p];
 					}else
 					{
-						distance_accumulation[i] = distance;
+						const real distance = get_distance(data[i], centroids[cluster_index - 1]);
+						distance_squared = distance * distance;
 					}
+					nearest[i] = std::min(nearest[i], distance_squared);
+					total_cost += nearest[i];
+					distance_accumulation[i] = total_cost;
+				}
+				if (total_cost > 0)
+				{
+					const double cutoff = random.uniform() * total_cost;
+					chosen = std::min(static_cast<unsigned int>(std::upper_bound(distance_accumulation.begin(), distance_accumulation.end(), cutoff) - distance_accumulation.begin()), count - 1);
+				}else
+				{
+					chosen = random.below(count);
 				}
+				centroids[cluster_index] = data[chosen];
+			}
+		}
 
-				bool loop;
-				real cutoff;
+		/**	@brief	Do the k-means++ clustering
+		*	
+		*	With the default get_distance and get_centroid, points of nv::vec2f, vec3f or vec4f are seeded by
+		*	K_Means_Seeding and clustered by K_Means_Lloyd on flat arrays on all threads.
+		*	Other functions run the seeding and the iteration below, which labels the points through
+		*	Flat_Points if get_distance is the Euclidean distance of a flat type, and calls get_distance for
+		*	each point and centroid otherwise. Both stop after options.max_iterations.
+		*/
+		template <class T>
+		static void k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, real get_distance(const T & v1, const T & v2), T get_centroid(const std::vector<T> & list),
+			const Lloyd_Options & options = Lloyd_Options())
+		{
+			if (get_distance == &K_Means_PP_Generic::get_distance<T> && get_centroid == &K_Means_PP_Generic::get_centroid<T>
+				&& Lloyd_Adapter<T>::run(data, k, label_ptr, options, static_cast<unsigned long long>(time(NULL))))
+			{
+				return;
+			}
 
-				// Repeatedly choose more centers
-				for (int cluster_index = 1; cluster_index < k; cluster_index++)
-				{
-					loop = true;
-					while (loop)
-					{
-						cutoff = (rand() / real(RAND_MAX)) * total_cost;
+			const unsigned int count = data.size();
 
-						for (unsigned int j = 0; j < count; j++)
-						{
-							if (distance_accumulation[j] >= cutoff)
-							{
-								random = j;
-								loop = false;
-								break;
-							}
-						}
+			std::vector<std::vector<T>> clusters(k);
+			std::vector<T> centroids0(k);
+			std::vector<T> centroids1(k);
+			std::vector<T> * centroids = &centroids0;
+			std::vector<T> * centroids_new = &centroids1;
+			std::vector<T> * temp_ptr;
 
-					}
-					centroids->at(cluster_index) = data[random];
-				}
+			real distance;
 
-			} // // Make initial guesses for the means m1, m2, ..., mk
+			// Make initial guesses for the means m1, m2, ..., mk
+			seed(data, k, *centroids, get_distance, static_cast<unsigned long long>(time(NULL)));
 
+			const bool flat = Flat_Points<T>::enabled && is_euclidean(get_distance);
+			Flat_Points<T> points;
+			if (flat)
+			{
+				points.assign(data);
+			}
 
 #ifdef _DEBUG_OUTPUT
 			ofstream fc("D:\\K_Means_PP_Generic_centroids.txt", ios::out);
@@ -190,9 +376,10 @@ namespace clustering
 			unsigned char centroids_index;
 			real distance_temp;
 			bool changed = true;
+			int iteration = 0;
 
 			// Until there are no changes in any mean
-			while (changed)
+			while (changed && iteration++ < options.max_iterations)
 			{
 				// Empty the clusters before classification
 				for (int i=0; i<k; i++)
@@ -204,25 +391,36 @@ namespace clustering
 				}
 
 				// Use the estimated means to classify the samples into K clusters
-				for (unsigned int i=0; i<count; i++)
+				if (flat)
 				{
-					// estimate the distance between points[i] and centroids[0]
-					centroids_index = 0;
-					distance = get_distance(data[i], centroids->at(0));
-
-					// look for a smaller distance in the rest of centroids
-					for (unsigned char j=1; j<k; j++)
+					points.set_centroids(&centroids->at(0), k);
+					points.label(label_ptr);
+					for (unsigned int i=0; i<count; i++)
+					{
+						clusters[label_ptr[i]].push_back(data[i]);
+					}
+				}else
+				{
+					for (unsigned int i=0; i<count; i++)
 					{
-						distance_temp = get_distance(data[i], centroids->at(j));
+						// estimate the distance between points[i] and centroids[0]
+						centroids_index = 0;
+						distance = get_distance(data[i], centroids->at(0));
 
-						if (distance_temp < distance)
+						// look for a smaller distance in the rest of centroids
+						for (unsigned char j=1; j<k; j++)
 						{
-							centroids_index = j;
-							distance = distance_temp;
+							distance_temp = get_distance(data[i], centroids->at(j));
+
+							if (distance_temp < distance)
+							{
+								centroids_index = j;
+								distance = distance_temp;
+							}
 						}
+						label_ptr[i] = centroids_index;
+						clusters[centroids_index].push_back(data[i]);
 					}
-					label_ptr[i] = centroids_index;
-					clusters[centroids_index].push_back(data[i]);
 				}
 
 #ifdef _DEBUG_OUTPUT
@@ -277,6 +475,18 @@ namespace clustering
 #endif
 
 		}
+
+		/**	@brief	Do the k-means++ clustering by a metric of Distance_Kernel
+		*
+		*	metric is Squared_Euclidean, Weighted_Euclidean, Diagonal_Mahalanobis or another functor with scale(c, d).
+		*	Points of nv::vec2f, vec3f or vec4f are seeded by K_Means_Seeding with the Euclidean distance and clustered
+		*	by K_Means_Lloyd with the metric. Return false for other types, which have no components to scale.
+		*/
+		template <class T, class M>
+		static bool k_means(const std::vector<T> & data, const int k, unsigned char *& label_ptr, const M & metric, const Lloyd_Options & options = Lloyd_Options())
+		{
+			return Lloyd_Adapter<T>::run(data, k, label_ptr, options, static_cast<unsigned long long>(time(NULL)), metric);
+		}
 	};
 
 }
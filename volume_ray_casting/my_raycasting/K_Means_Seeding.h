@@ -0,0 +1,440 @@
+/**	@file
+* a header file for the K_Means_Seeding class
+*/
+
+#pragma once
+
+#ifndef K_Means_Seeding_h
+#define K_Means_Seeding_h
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+#include "Distance_Kernel.h"
+#include "K_Means_Lloyd.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
+	/**	@brief	A small random number generator (splitmix64) with 53-bit uniform numbers
+	*
+	*	rand() gives 15 bits with Visual C++, too few to pick one of millions of points.
+	*	hash() gives a random number for a key, so points can draw their own numbers on any thread.
+	*/
+	class Random
+	{
+	public:
+
+		explicit Random(const unsigned long long seed = 0) : state(seed)
+		{
+		}
+
+		static unsigned long long hash(unsigned long long key)
+		{
+			key += 0x9E3779B97F4A7C15ULL;
+			key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+			return key ^ (key >> 31);
+		}
+
+		/// a number in [0, 1) from a key
+		static double to_uniform(const unsigned long long bits)
+		{
+			return (bits >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		unsigned long long next()
+		{
+			state += 0x9E3779B97F4A7C15ULL;
+			return hash(state);
+		}
+
+		/// a number in [0, 1)
+		double uniform()
+		{
+			return to_uniform(next());
+		}
+
+		/// a number in [0, n)
+		unsigned int below(const unsigned int n)
+		{
+			return static_cast<unsigned int>(uniform() * n);
+		}
+
+	private:
+		unsigned long long state;
+	};
+
+	/**	@brief	Initial centroids for K_Means_Lloyd
+	*
+	*	k-means++ (Arthur and Vassilvitskii) draws each new seed with a probability proportional to the squared
+	*	distance D^2 of a point to its nearest seed. The distances are updated on all threads after each seed,
+	*	together with the sum of each block of points. A seed is drawn by a binary search over the running
+	*	sums of the blocks and a scan inside the chosen block.
+	*
+	*	k-means|| (Bahmani et al.) needs only a few passes for large inputs: each round every point becomes a
+	*	candidate with probability oversampling * D^2 / sum(D^2), independently, and the candidates weighted
+	*	by the number of their nearest points are reduced to k seeds by a weighted k-means++ and a few
+	*	weighted Lloyd iterations. It computes more distances than k-means++ (about 3 * oversampling per point
+	*	instead of k), but it reads the points in about 2 * rounds passes instead of k.
+	*/
+	class K_Means_Seeding
+	{
+	public:
+
+		/// the number of points per block of the running sums
+		static const int BLOCK_SIZE = 4096;
+		/// inputs with more points are seeded by k-means||, smaller ones stay in the caches
+		static const unsigned int PARALLEL_THRESHOLD = 1u << 24;
+
+		/// k-means|| for large inputs, k-means++ otherwise and for weighted points
+		static void seed(const Feature_Set & features, const int k, std::vector<float> & centroids, const unsigned long long random_seed,
+			const float * weights = NULL)
+		{
+			if (features.get_count() > PARALLEL_THRESHOLD && weights == NULL)
+			{
+				seed_parallel(features, k, centroids, random_seed);
+			}else
+			{
+				seed_plus_plus(features, k, centroids, random_seed, weights);
+			}
+		}
+
+		/// k-means++ with D^2 sampling, a point of weight w is drawn with probability proportional to w D^2
+		static void seed_plus_plus(const Feature_Set & features, const int k, std::vector<float> & centroids, const unsigned long long random_seed,
+			const float * weights = NULL)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int blocks = static_cast<int>((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+			Random random(random_seed);
+			std::vector<float> distance(count, FLT_MAX);
+			std::vector<double> block_sums(blocks);
+
+			centroids.assign(k * dimension, 0);
+			unsigned int chosen = weights ? draw_by_weight(weights, count, random.uniform()) : random.below(count);
+			for (int c=0; c<k; c++)
+			{
+				copy_point(features, chosen, &centroids[c * dimension]);
+				if (c == k - 1)
+				{
+					break;
+				}
+				update_distances(features, &centroids[c * dimension], 0, 1, &distance[0], &block_sums[0], weights);
+
+				// running sums of the blocks
+				for (int b=1; b<blocks; b++)
+				{
+					block_sums[b] += block_sums[b - 1];
+				}
+				const double total = block_sums[blocks - 1];
+				if (total <= 0)
+				{
+					// fewer distinct points than clusters
+					chosen = random.below(count);
+					continue;
+				}
+				chosen = draw(&distance[0], weights, count, &block_sums[0], blocks, random.uniform() * total);
+			}
+		}
+
+		/// k-means|| with rounds passes of about oversampling candidates each, 0 for 2 * k
+		static void seed_parallel(const Feature_Set & features, const int k, std::vector<float> & centroids, const unsigned long long random_seed,
+			const int rounds = 5, int oversampling = 0)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int blocks = static_cast<int>((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+			const int threads = parallel_utility::get_thread_number();
+			if (oversampling <= 0)
+			{
+				oversampling = 2 * k;
+			}
+			Random random(random_seed);
+			std::vector<float> distance(count, FLT_MAX);
+			std::vector<double> block_sums(blocks);
+
+			// candidates row by row, the first one uniformly at random
+			std::vector<float> candidates(dimension);
+			copy_point(features, random.below(count), &candidates[0]);
+			update_distances(features, &candidates[0], 0, 1, &distance[0], &block_sums[0]);
+
+			std::vector<std::vector<unsigned int> > picked(threads);
+			const unsigned long long round_seed = random.next();
+			for (int round=0; round<rounds; round++)
+			{
+				double total = 0;
+				for (int b=0; b<blocks; b++)
+				{
+					total += block_sums[b];
+				}
+				if (total <= 0)
+				{
+					break;
+				}
+				const double factor = oversampling / total;
+
+				// every point draws its own number, so the candidates do not depend on the threads
+#pragma omp parallel
+				{
+					std::vector<unsigned int> & mine = picked[parallel_utility::get_thread_index()];
+					mine.clear();
+					int b;
+#pragma omp for schedule(static)
+					for (b=0; b<blocks; b++)
+					{
+						const unsigned int first = static_cast<unsigned int>(b) * BLOCK_SIZE;
+						const unsigned int last = std::min<unsigned int>(first + BLOCK_SIZE, count);
+						for (unsigned int i=first; i<last; i++)
+						{
+							const unsigned long long key = (round_seed + round) * 0x100000000ULL + i;
+							if (Random::to_uniform(Random::hash(key)) < factor * distance[i])
+							{
+								mine.push_back(i);
+							}
+						}
+					}
+				}
+
+				// the threads hold increasing ranges of blocks, so their lists are appended in thread order
+				const int first_new = static_cast<int>(candidates.size()) / dimension;
+				for (int t=0; t<threads; t++)
+				{
+					for (size_t j=0; j<picked[t].size(); j++)
+					{
+						candidates.resize(candidates.size() + dimension);
+						copy_point(features, picked[t][j], &candidates[candidates.size() - dimension]);
+					}
+				}
+				const int added = static_cast<int>(candidates.size()) / dimension - first_new;
+				if (added > 0)
+				{
+					update_distances(features, &candidates[first_new * dimension], 0, added, &distance[0], &block_sums[0]);
+				}
+			}
+
+			// weigh each candidate by the number of points nearest to it
+			const int m = static_cast<int>(candidates.size()) / dimension;
+			std::vector<double> weights(m, 0);
+			if (m <= k)
+			{
+				centroids.assign(k * dimension, 0);
+				for (int c=0; c<k; c++)
+				{
+					copy_point(features, random.below(count), &centroids[c * dimension]);
+				}
+				std::copy(candidates.begin(), candidates.end(), centroids.begin());
+				return;
+			}
+			count_nearest(features, candidates, m, weights);
+			reduce_weighted(candidates, weights, m, dimension, k, centroids, random);
+		}
+
+	private:
+
+		static void copy_point(const Feature_Set & features, const unsigned int i, float * point)
+		{
+			for (int d=0; d<features.get_dimension(); d++)
+			{
+				point[d] = features.get(i, d);
+			}
+		}
+
+		/// distance[i] = min(distance[i], squared distance to the centers [first, first + n) of the row-major array),
+		/// and the sum of distance over each block, weighted if weights is not NULL
+		static void update_distances(const Feature_Set & features, const float * centers, const int first, const int n,
+			float * distance, double * block_sums, const float * weights = NULL)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int blocks = static_cast<int>((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+			int b;
+#pragma omp parallel
+			{
+				std::vector<float> d2(BLOCK_SIZE);
+				std::vector<int> nearest(BLOCK_SIZE);
+#pragma omp for schedule(static)
+				for (b=0; b<blocks; b++)
+				{
+					const unsigned int begin = static_cast<unsigned int>(b) * BLOCK_SIZE;
+					const int size = static_cast<int>(std::min<unsigned int>(BLOCK_SIZE, count - begin));
+					float * out = distance + begin;
+					Distance_Kernel<>::nearest(features.component(0) + begin, count, dimension, centers + first * dimension, n, size, &d2[0], &nearest[0]);
+					for (int p=0; p<size; p++)
+					{
+						out[p] = std::min(out[p], d2[p]);
+					}
+					double sum = 0;
+					for (int p=0; p<size; p++)
+					{
+						sum += weights ? weights[begin + p] * out[p] : out[p];
+					}
+					block_sums[b] = sum;
+				}
+			}
+		}
+
+		/// the point where the running sum of distance passes cutoff, running_sums are the running sums of the blocks
+		static unsigned int draw(const float * distance, const float * weights, const unsigned int count, const double * running_sums, const int blocks, const double cutoff)
+		{
+			const int b = std::min(static_cast<int>(std::upper_bound(running_sums, running_sums + blocks, cutoff) - running_sums), blocks - 1);
+			double sum = b > 0 ? running_sums[b - 1] : 0;
+			const unsigned int first = static_cast<unsigned int>(b) * BLOCK_SIZE;
+			const unsigned int last = std::min<unsigned int>(first + BLOCK_SIZE, count);
+			unsigned int chosen = first;
+			for (unsigned int i=first; i<last; i++)
+			{
+				const double d = weights ? weights[i] * distance[i] : distance[i];
+				if (d > 0)
+				{
+					chosen = i;
+					sum += d;
+					if (sum > cutoff)
+					{
+						break;
+					}
+				}
+			}
+			return chosen;
+		}
+
+		/// a point with a probability proportional to its weight
+		static unsigned int draw_by_weight(const float * weights, const unsigned int count, const double u)
+		{
+			double total = 0;
+			for (unsigned int i=0; i<count; i++)
+			{
+				total += weights[i];
+			}
+			const double cutoff = u * total;
+			double sum = 0;
+			for (unsigned int i=0; i<count; i++)
+			{
+				sum += weights[i];
+				if (sum > cutoff)
+				{
+					return i;
+				}
+			}
+			return count - 1;
+		}
+
+		/// the number of points nearest to each of the m candidates
+		static void count_nearest(const Feature_Set & features, const std::vector<float> & candidates, const int m, std::vector<double> & weights)
+		{
+			const unsigned int count = features.get_count();
+			const int blocks = static_cast<int>((count + K_Means_Lloyd::BLOCK_SIZE - 1) / K_Means_Lloyd::BLOCK_SIZE);
+			const int threads = parallel_utility::get_thread_number();
+			std::vector<unsigned int> counts(threads * m, 0);
+#pragma omp parallel
+			{
+				unsigned int * mine = &counts[parallel_utility::get_thread_index() * m];
+				float best_distance[K_Means_Lloyd::BLOCK_SIZE];
+				int best_label[K_Means_Lloyd::BLOCK_SIZE];
+				int b;
+#pragma omp for schedule(static)
+				for (b=0; b<blocks; b++)
+				{
+					const unsigned int first = static_cast<unsigned int>(b) * K_Means_Lloyd::BLOCK_SIZE;
+					const int n = static_cast<int>(std::min<unsigned int>(K_Means_Lloyd::BLOCK_SIZE, count - first));
+					K_Means_Lloyd::assign_block(features, &candidates[0], m, first, n, best_distance, best_label);
+					for (int p=0; p<n; p++)
+					{
+						mine[best_label[p]]++;
+					}
+				}
+			}
+			for (int t=0; t<threads; t++)
+			{
+				for (int c=0; c<m; c++)
+				{
+					weights[c] += counts[t * m + c];
+				}
+			}
+		}
+
+		/// k seeds from m weighted points: weighted k-means++ followed by a few weighted Lloyd iterations
+		static void reduce_weighted(const std::vector<float> & points, const std::vector<double> & weights, const int m, const int dimension,
+			const int k, std::vector<float> & centroids, Random & random)
+		{
+			centroids.assign(k * dimension, 0);
+			std::vector<double> distance(m, DBL_MAX);
+			std::vector<double> running(m);
+
+			// the first seed with a probability proportional to its weight
+			double total = 0;
+			for (int i=0; i<m; i++)
+			{
+				total += weights[i];
+				running[i] = total;
+			}
+			int chosen = std::min(static_cast<int>(std::upper_bound(running.begin(), running.end(), random.uniform() * total) - running.begin()), m - 1);
+			for (int c=0; c<k; c++)
+			{
+				std::copy(&points[chosen * dimension], &points[chosen * dimension] + dimension, &centroids[c * dimension]);
+				total = 0;
+				for (int i=0; i<m; i++)
+				{
+					distance[i] = std::min(distance[i], squared_distance(&points[i * dimension], &centroids[c * dimension], dimension));
+					total += weights[i] * distance[i];
+					running[i] = total;
+				}
+				if (total > 0)
+				{
+					chosen = std::min(static_cast<int>(std::upper_bound(running.begin(), running.end(), random.uniform() * total) - running.begin()), m - 1);
+				}
+			}
+
+			std::vector<double> sums(k * dimension);
+			std::vector<double> sizes(k);
+			for (int iteration=0; iteration<10; iteration++)
+			{
+				std::fill(sums.begin(), sums.end(), 0.0);
+				std::fill(sizes.begin(), sizes.end(), 0.0);
+				for (int i=0; i<m; i++)
+				{
+					int best = 0;
+					double best_distance = DBL_MAX;
+					for (int c=0; c<k; c++)
+					{
+						const double d = squared_distance(&points[i * dimension], &centroids[c * dimension], dimension);
+						if (d < best_distance)
+						{
+							best_distance = d;
+							best = c;
+						}
+					}
+					sizes[best] += weights[i];
+					for (int d=0; d<dimension; d++)
+					{
+						sums[best * dimension + d] += weights[i] * points[i * dimension + d];
+					}
+				}
+				for (int c=0; c<k; c++)
+				{
+					if (sizes[c] > 0)
+					{
+						for (int d=0; d<dimension; d++)
+						{
+							centroids[c * dimension + d] = static_cast<float>(sums[c * dimension + d] / sizes[c]);
+						}
+					}
+				}
+			}
+		}
+
+		static double squared_distance(const float * a, const float * b, const int dimension)
+		{
+			double sum = 0;
+			for (int d=0; d<dimension; d++)
+			{
+				const double difference = a[d] - b[d];
+				sum += difference * difference;
+			}
+			return sum;
+		}
+	};
+}
+
+#endif // K_Means_Seeding_h
@@ -0,0 +1,448 @@
+/**	@file
+* a header file for the K_Means_Supervoxel class
+*/
+
+#pragma once
+
+#ifndef K_Means_Supervoxel_h
+#define K_Means_Supervoxel_h
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <ctime>
+
+#include "Distance_Kernel.h"
+#include "K_Means_Lloyd.h"
+#include "K_Means_Seeding.h"
+#include "parallel_utility.h"
+
+namespace clustering
+{
+	/**	@brief	How the supervoxels are grown
+	*
+	*	step is the spacing S of the seeds in voxels, a supervoxel has about S^3 voxels.
+	*	compactness is the weight m of the distance in space against the distance of the features,
+	*	which are scaled to the range [0, 1]: the distance is d_features^2 + (m / S)^2 d_xyz^2.
+	*	iterations is the number of local k-means steps, SLIC converges in about 10.
+	*/
+	struct Supervoxel_Options
+	{
+		int step;
+		float compactness;
+		int iterations;
+
+		Supervoxel_Options(const int step = 8, const float compactness = 0.1f, const int iterations = 10)
+			: step(step), compactness(compactness), iterations(iterations)
+		{
+		}
+	};
+
+	/**	@brief	k-means on 3D SLIC supervoxels of a volume
+	*
+	*	The centers are seeded on a regular grid of spacing S and move in the space of the features and the
+	*	voxel positions. Each voxel compares only the centers seeded in the 3 x 3 x 3 grid cells around its
+	*	own, which is the 2S window of SLIC seen from the voxel, so a step costs 27 distances per voxel for any
+	*	number of supervoxels. The rows of the volume are distributed over the threads, a voxel along a row
+	*	shares its candidate centers with the rest of its grid cell, and the distances of such a run are
+	*	computed together by Distance_Kernel. The voxels of a slab of grid cells along z belong to centers of
+	*	the slabs next to it, so each slab is summed by one thread and the sums of a center are merged in slab
+	*	order, and the supervoxels do not depend on the number of threads.
+	*
+	*	The last step splits the supervoxels into 6-connected components, and components smaller than S^3 / 4
+	*	voxels join the supervoxel before them in scan order. The supervoxels are replaced by the means of their
+	*	features, weighted by their sizes, and clustered by weighted k-means++ and K_Means_Lloyd as in
+	*	K_Means_Coreset. The voxels take the labels of their supervoxels, which makes the labels spatially
+	*	coherent and leaves about 1 / S^3 of the points to the clustering.
+	*	Volumes are indexed as (z * sizes[1] + y) * sizes[0] + x.
+	*
+	*	Achanta R, Shaji A, Smith K, et al. SLIC superpixels compared to state-of-the-art superpixel methods.
+	*	IEEE Transactions on Pattern Analysis and Machine Intelligence, 2012, 34(11): 2274-2282.
+	*/
+	class K_Means_Supervoxel
+	{
+	public:
+
+		/// grow the supervoxels over the features of the voxels, means holds the mean features of each supervoxel,
+		/// weights its number of voxels and supervoxels the supervoxel of each voxel. Return the number of supervoxels.
+		/// If mask is given the supervoxels still cover all voxels, but the means and the weights only count the voxels
+		/// where mask is set.
+		static unsigned int build(const Feature_Set & features, const int * sizes, const Supervoxel_Options & options,
+			Feature_Set & means, std::vector<float> & weights, std::vector<unsigned int> & supervoxels, const unsigned char * mask = NULL)
+		{
+			const unsigned int count = features.get_count();
+			const int dimension = features.get_dimension();
+			const int width = dimension + 3;
+			const int step = std::max(1, options.step);
+
+			// the seed grid
+			int cells[3];
+			for (int a=0; a<3; a++)
+			{
+				cells[a] = std::max(1, std::min(sizes[a], (sizes[a] + step / 2) / step));
+			}
+			const int center_count = cells[0] * cells[1] * cells[2];
+
+			// the weights of the distance, the features by their ranges and the positions by m / S
+			std::vector<float> metric_weights(width);
+			for (int d=0; d<dimension; d++)
+			{
+				float lower, upper;
+				find_range(features.component(d), count, lower, upper);
+				metric_weights[d] = upper > lower ? 1 / ((upper - lower) * (upper - lower)) : 0;
+			}
+			const float spatial = options.compactness / step;
+			metric_weights[dimension] = metric_weights[dimension + 1] = metric_weights[dimension + 2] = spatial * spatial;
+
+			// the centers row by row, the features of the voxel in the middle of each grid cell and its position
+			std::vector<float> centers(static_cast<size_t>(center_count) * width);
+			for (int c=0; c<center_count; c++)
+			{
+				const int cell[3] = {c % cells[0], c / cells[0] % cells[1], c / (cells[0] * cells[1])};
+				int position[3];
+				for (int a=0; a<3; a++)
+				{
+					position[a] = static_cast<int>((cell[a] + 0.5) * sizes[a] / cells[a]);
+				}
+				const unsigned int index = (position[2] * sizes[1] + position[1]) * sizes[0] + position[0];
+				float * center = &centers[static_cast<size_t>(c) * width];
+				for (int d=0; d<dimension; d++)
+				{
+					center[d] = features.get(index, d);
+				}
+				for (int a=0; a<3; a++)
+				{
+					center[dimension + a] = static_cast<float>(position[a]);
+				}
+			}
+
+			// the local k-means steps, the sums of each slab for the centers of the 3 slabs around it
+			supervoxels.resize(count);
+			std::vector<double> slab_sums(static_cast<size_t>(cells[2]) * 3 * cells[0] * cells[1] * (width + 1));
+			for (int iteration=0; iteration<options.iterations; iteration++)
+			{
+				assign(features, sizes, cells, &centers[0], metric_weights, &supervoxels[0]);
+				update_centers(features, sizes, cells, &supervoxels[0], slab_sums, centers);
+			}
+			if (options.iterations <= 0)
+			{
+				assign(features, sizes, cells, &centers[0], metric_weights, &supervoxels[0]);
+			}
+
+			// connected supervoxels and their means
+			const unsigned int m = enforce_connectivity(sizes, std::max(1, step * step * step / 4), supervoxels);
+			std::vector<double> sums, voxels;
+			sum_supervoxels(features, &supervoxels[0], mask, m, sums, voxels);
+			means.resize(m, dimension);
+			weights.resize(m);
+			for (unsigned int s=0; s<m; s++)
+			{
+				weights[s] = static_cast<float>(voxels[s]);
+				for (int d=0; d<dimension; d++)
+				{
+					means.set(s, d, voxels[s] > 0 ? static_cast<float>(sums[static_cast<size_t>(d) * m + s] / voxels[s]) : 0);
+				}
+			}
+			return m;
+		}
+
+		/// cluster the voxels through their supervoxels, the centroids are written row by row
+		template <class L>
+		static Lloyd_Result run(const Feature_Set & features, const int * sizes, const int k, std::vector<float> & centroids, L * labels,
+			const Supervoxel_Options & supervoxel_options, const Lloyd_Options & options, const unsigned long long random_seed)
+		{
+			Feature_Set means;
+			std::vector<float> weights;
+			std::vector<unsigned int> supervoxels;
+			const unsigned int m = build(features, sizes, supervoxel_options, means, weights, supervoxels);
+
+			std::vector<int> supervoxel_labels(m);
+			K_Means_Seeding::seed_plus_plus(means, k, centroids, random_seed, &weights[0]);
+			Lloyd_Result result = K_Means_Lloyd::run(means, k, centroids, &supervoxel_labels[0], options, &weights[0]);
+
+			const int n = static_cast<int>(features.get_count());
+			int i;
+#pragma omp parallel for
+			for (i=0; i<n; i++)
+			{
+				labels[i] = static_cast<L>(supervoxel_labels[supervoxels[i]]);
+			}
+			return result;
+		}
+
+		/// cluster the voxels of a volume of sizes[0] * sizes[1] * sizes[2] points of nv::vec2f, vec3f or vec4f
+		template <class T>
+		static Lloyd_Result k_means(const std::vector<T> & data, const int * sizes, const int k, unsigned char *& label_ptr,
+			const Supervoxel_Options & supervoxel_options = Supervoxel_Options(), const Lloyd_Options & options = Lloyd_Options())
+		{
+			Feature_Set features;
+			features.assign(data);
+			std::vector<float> centroids;
+			return run(features, sizes, k, centroids, label_ptr, supervoxel_options, options, static_cast<unsigned long long>(time(NULL)));
+		}
+
+	private:
+
+		/// the minimum and the maximum of count values
+		static void find_range(const float * x, const unsigned int count, float & lower, float & upper)
+		{
+			const int threads = parallel_utility::get_thread_number();
+			const int n = static_cast<int>(count);
+			std::vector<float> thread_lower(threads, FLT_MAX), thread_upper(threads, -FLT_MAX);
+			int i;
+#pragma omp parallel
+			{
+				const int t = parallel_utility::get_thread_index();
+#pragma omp for
+				for (i=0; i<n; i++)
+				{
+					thread_lower[t] = std::min(thread_lower[t], x[i]);
+					thread_upper[t] = std::max(thread_upper[t], x[i]);
+				}
+			}
+			lower = *std::min_element(thread_lower.begin(), thread_lower.end());
+			upper = *std::max_element(thread_upper.begin(), thread_upper.end());
+		}
+
+		/// the first voxel of grid cell g along an axis of size voxels and cells cells
+		static int cell_begin(const int g, const int size, const int cells)
+		{
+			return (g * size + cells - 1) / cells;
+		}
+
+		/// give each voxel the nearest of the centers seeded in the grid cells around its own
+		static void assign(const Feature_Set & features, const int * sizes, const int * cells, const float * centers,
+			const std::vector<float> & metric_weights, unsigned int * supervoxels)
+		{
+			const int dimension = features.get_dimension();
+			const int width = dimension + 3;
+			const int rows = sizes[1] * sizes[2];
+			const int run_size = (sizes[0] + cells[0] - 1) / cells[0] + 1;
+			const Weighted_Euclidean metric(&metric_weights[0]);
+			int row;
+#pragma omp parallel
+			{
+				// a run of voxels component by component, its candidate centers and the results
+				std::vector<float> points(static_cast<size_t>(run_size) * width);
+				std::vector<float> candidates(27 * width);
+				std::vector<int> candidate_index(27);
+				std::vector<float> best_distance(run_size);
+				std::vector<int> best_label(run_size);
+#pragma omp for schedule(static)
+				for (row=0; row<rows; row++)
+				{
+					const int y = row % sizes[1], z = row / sizes[1];
+					const int gy = static_cast<int>(static_cast<long long>(y) * cells[1] / sizes[1]);
+					const int gz = static_cast<int>(static_cast<long long>(z) * cells[2] / sizes[2]);
+					const unsigned int row_begin = static_cast<unsigned int>(row) * sizes[0];
+					for (int gx=0; gx<cells[0]; gx++)
+					{
+						const int begin = cell_begin(gx, sizes[0], cells[0]);
+						const int n = cell_begin(gx + 1, sizes[0], cells[0]) - begin;
+						if (n <= 0)
+						{
+							continue;
+						}
+
+						int m = 0;
+						for (int cz=std::max(gz-1, 0); cz<=std::min(gz+1, cells[2]-1); cz++)
+						{
+							for (int cy=std::max(gy-1, 0); cy<=std::min(gy+1, cells[1]-1); cy++)
+							{
+								for (int cx=std::max(gx-1, 0); cx<=std::min(gx+1, cells[0]-1); cx++)
+								{
+									const int c = (cz * cells[1] + cy) * cells[0] + cx;
+									std::copy(centers + static_cast<size_t>(c) * width, centers + static_cast<size_t>(c + 1) * width, &candidates[m * width]);
+									candidate_index[m++] = c;
+								}
+							}
+						}
+
+						for (int d=0; d<dimension; d++)
+						{
+							const float * x = features.component(d) + row_begin + begin;
+							std::copy(x, x + n, &points[d * n]);
+						}
+						float * position = &points[dimension * n];
+						for (int p=0; p<n; p++)
+						{
+							position[p] = static_cast<float>(begin + p);
+							position[n + p] = static_cast<float>(y);
+							position[2 * n + p] = static_cast<float>(z);
+						}
+
+						Distance_Kernel<Weighted_Euclidean>::nearest(&points[0], n, width, &candidates[0], m, n, &best_distance[0], &best_label[0], metric);
+						for (int p=0; p<n; p++)
+						{
+							supervoxels[row_begin + begin + p] = candidate_index[best_label[p]];
+						}
+					}
+				}
+			}
+		}
+
+		/// move the centers to the means of the features and the positions of their voxels. The voxels of grid slab g
+		/// along z belong to centers of the slabs g - 1 to g + 1, so the sums of slab g are kept for these centers only,
+		/// width + 1 values each with the number of voxels last, and a center adds up the slabs around it in order.
+		static void update_centers(const Feature_Set & features, const int * sizes, const int * cells, const unsigned int * supervoxels,
+			std::vector<double> & slab_sums, std::vector<float> & centers)
+		{
+			const int dimension = features.get_dimension();
+			const int width = dimension + 3;
+			const int plane = cells[0] * cells[1];
+			const size_t slab_stride = static_cast<size_t>(3) * plane * (width + 1);
+			int g;
+#pragma omp parallel for schedule(dynamic)
+			for (g=0; g<cells[2]; g++)
+			{
+				double * slab = &slab_sums[g * slab_stride];
+				std::fill(slab, slab + slab_stride, 0.0);
+				const unsigned int first_center = static_cast<unsigned int>(std::max(g - 1, 0) * plane);
+				for (int z=cell_begin(g, sizes[2], cells[2]); z<cell_begin(g + 1, sizes[2], cells[2]); z++)
+				{
+					for (int y=0; y<sizes[1]; y++)
+					{
+						const unsigned int row_begin = (static_cast<unsigned int>(z) * sizes[1] + y) * sizes[0];
+						for (int x=0; x<sizes[0]; x++)
+						{
+							const unsigned int i = row_begin + x;
+							double * s = slab + static_cast<size_t>(supervoxels[i] - first_center) * (width + 1);
+							for (int d=0; d<dimension; d++)
+							{
+								s[d] += features.component(d)[i];
+							}
+							s[dimension] += x;
+							s[dimension + 1] += y;
+							s[dimension + 2] += z;
+							s[width]++;
+						}
+					}
+				}
+			}
+
+			const int center_count = plane * cells[2];
+			int c;
+#pragma omp parallel
+			{
+				std::vector<double> sum(width + 1);
+#pragma omp for
+				for (c=0; c<center_count; c++)
+				{
+					std::fill(sum.begin(), sum.end(), 0.0);
+					const int cz = c / plane;
+					for (int h=std::max(cz - 1, 0); h<=std::min(cz + 1, cells[2] - 1); h++)
+					{
+						const double * s = &slab_sums[h * slab_stride + static_cast<size_t>(c - std::max(h - 1, 0) * plane) * (width + 1)];
+						for (int d=0; d<=width; d++)
+						{
+							sum[d] += s[d];
+						}
+					}
+					if (sum[width] > 0)
+					{
+						for (int d=0; d<width; d++)
+						{
+							centers[static_cast<size_t>(c) * width + d] = static_cast<float>(sum[d] / sum[width]);
+						}
+					}
+				}
+			}
+		}
+
+		/// the sums of the features of the voxels of each of the m supervoxels, component d of supervoxel s at
+		/// sums[d * m + s], and their numbers of voxels, only of the voxels where mask is set if it is given.
+		/// Each component is summed by one thread in scan order, the last one counts the voxels.
+		static void sum_supervoxels(const Feature_Set & features, const unsigned int * supervoxels, const unsigned char * mask, const unsigned int m,
+			std::vector<double> & sums, std::vector<double> & voxels)
+		{
+			const int dimension = features.get_dimension();
+			const unsigned int count = features.get_count();
+			sums.assign(static_cast<size_t>(dimension) * m, 0.0);
+			voxels.assign(m, 0.0);
+			int d;
+#pragma omp parallel for schedule(dynamic)
+			for (d=0; d<=dimension; d++)
+			{
+				double * s = d < dimension ? &sums[static_cast<size_t>(d) * m] : &voxels[0];
+				const float * x = d < dimension ? features.component(d) : NULL;
+				for (unsigned int i=0; i<count; i++)
+				{
+					if (mask && !mask[i])
+					{
+						continue;
+					}
+					s[supervoxels[i]] += x ? x[i] : 1;
+				}
+			}
+		}
+
+		/// relabel the supervoxels by their 6-connected components, components smaller than min_size voxels join the
+		/// component of the voxel before their first voxel. Return the number of components.
+		static unsigned int enforce_connectivity(const int * sizes, const int min_size, std::vector<unsigned int> & supervoxels)
+		{
+			const unsigned int UNSET = 0xFFFFFFFFu;
+			const unsigned int count = static_cast<unsigned int>(supervoxels.size());
+			const unsigned int slice = static_cast<unsigned int>(sizes[0]) * sizes[1];
+			std::vector<unsigned int> components(count, UNSET);
+			std::vector<unsigned int> queue;
+			unsigned int component_count = 0;
+			for (unsigned int i=0; i<count; i++)
+			{
+				if (components[i] != UNSET)
+				{
+					continue;
+				}
+
+				// the voxels before i along x, y and z are labelled already
+				unsigned int adjacent = component_count;
+				const int x = static_cast<int>(i % sizes[0]), y = static_cast<int>(i / sizes[0] % sizes[1]), z = static_cast<int>(i / slice);
+				if (x > 0) adjacent = components[i - 1];
+				else if (y > 0) adjacent = components[i - sizes[0]];
+				else if (z > 0) adjacent = components[i - slice];
+
+				// flood the component from i
+				const unsigned int supervoxel = supervoxels[i];
+				components[i] = component_count;
+				queue.clear();
+				queue.push_back(i);
+				for (size_t q=0; q<queue.size(); q++)
+				{
+					const unsigned int j = queue[q];
+					const int jx = static_cast<int>(j % sizes[0]), jy = static_cast<int>(j / sizes[0] % sizes[1]), jz = static_cast<int>(j / slice);
+					unsigned int neighbors[6];
+					int neighbor_count = 0;
+					if (jx > 0) neighbors[neighbor_count++] = j - 1;
+					if (jx < sizes[0] - 1) neighbors[neighbor_count++] = j + 1;
+					if (jy > 0) neighbors[neighbor_count++] = j - sizes[0];
+					if (jy < sizes[1] - 1) neighbors[neighbor_count++] = j + sizes[0];
+					if (jz > 0) neighbors[neighbor_count++] = j - slice;
+					if (jz < sizes[2] - 1) neighbors[neighbor_count++] = j + slice;
+					for (int a=0; a<neighbor_count; a++)
+					{
+						const unsigned int l = neighbors[a];
+						if (components[l] == UNSET && supervoxels[l] == supervoxel)
+						{
+							components[l] = component_count;
+							queue.push_back(l);
+						}
+					}
+				}
+
+				if (queue.size() < static_cast<size_t>(min_size) && adjacent != component_count)
+				{
+					for (size_t q=0; q<queue.size(); q++)
+					{
+						components[queue[q]] = adjacent;
+					}
+				}else
+				{
+					component_count++;
+				}
+			}
+			supervoxels.swap(components);
+			return component_count;
+		}
+	};
+}
+
+#endif // K_Means_Supervoxel_h
@@ -0,0 +1,212 @@
+/**	@file
+*	a header file for edge preserving smoothing with a bilateral grid
+*/
+
+#ifndef bilateral_utility_h
+#define bilateral_utility_h
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+/**	@brief	The bilateral filter approximated on a coarse grid over space and intensity
+*
+*	The voxels are accumulated into a grid of cells of sigma_spatial voxels along x, y, z and sigma_range
+*	along the intensity, the grid is blurred with a Gaussian of 1 cell along all four axes, and every voxel
+*	reads its result back by quadrilinear interpolation at its position and intensity.
+*	Voxels of different intensity fall into different cells, so smoothing does not cross edges.
+*	The cost is linear in the number of voxels plus the grid size, independent of the spatial radius.
+*	The grid has at most MAX_CELLS cells, sigma_range is raised for a call whose range would need more.
+*	Volumes are indexed as (z * sizes[1] + y) * sizes[0] + x.
+*/
+namespace bilateral_utility
+{
+	class BilateralGrid
+	{
+	public:
+
+		/// sigma_spatial in voxels, sigma_range in units of the values
+		BilateralGrid(const float sigma_spatial, const float sigma_range) : sigma_spatial(sigma_spatial), sigma_range(sigma_range)
+		{
+		}
+
+		/// filter count = sizes[0] * sizes[1] * sizes[2] values from in to out
+		void filter(const float *in, float *out, const int *sizes)
+		{
+			const int count = sizes[0] * sizes[1] * sizes[2];
+			lower = *std::min_element(in, in + count);
+			const float upper = *std::max_element(in, in + count);
+
+			// padding on each side for the blur and the interpolation, the cells rounded as in splat
+			for (int a=0; a<3; a++)
+			{
+				grid_sizes[a] = static_cast<int>((sizes[a] - 1) / sigma_spatial + 0.5f) + 1 + 2 * PADDING;
+			}
+			const size_t spatial_cells = static_cast<size_t>(grid_sizes[0]) * grid_sizes[1] * grid_sizes[2];
+
+			// cap the range bins, e.g. 16-bit data with a small sigma_range, so that the grid fits
+			cell_range = sigma_range;
+			const size_t max_bins = std::max(MAX_CELLS / spatial_cells, static_cast<size_t>(2 * PADDING + 3));
+			if ((upper - lower) / cell_range + 1 + 2 * PADDING > max_bins)
+			{
+				cell_range = (upper - lower) / static_cast<float>(max_bins - 2 * PADDING - 2);
+			}
+			grid_sizes[3] = static_cast<int>((upper - lower) / cell_range + 0.5f) + 1 + 2 * PADDING;
+			grid.assign(2 * spatial_cells * grid_sizes[3], 0);
+
+			splat(in, sizes);
+			for (int axis=0; axis<4; axis++)
+			{
+				blur(axis);
+			}
+			slice(in, out, sizes);
+		}
+
+	private:
+		static const int PADDING = 2;
+		/// the largest number of cells, 2 floats each
+		static const size_t MAX_CELLS = static_cast<size_t>(1) << 25;
+
+		float sigma_spatial, sigma_range, lower;
+		/// the range of a cell, sigma_range unless the grid would exceed MAX_CELLS
+		float cell_range;
+		/// cells along x, y, z and the intensity
+		int grid_sizes[4];
+		/// the sum of values and the number of voxels in each cell, the intensity running fastest
+		std::vector<float> grid;
+
+		/// index of a cell
+		size_t cell(const int x, const int y, const int z, const int r) const
+		{
+			return ((static_cast<size_t>(z) * grid_sizes[1] + y) * grid_sizes[0] + x) * grid_sizes[3] + r;
+		}
+
+		/// the grid coordinate of a spatial coordinate and of a value
+		float spatial_coordinate(const int v) const
+		{
+			return v / sigma_spatial + PADDING;
+		}
+
+		float range_coordinate(const float v) const
+		{
+			return (v - lower) / cell_range + PADDING;
+		}
+
+		/// accumulate the voxels into their nearest cells.
+		/// A grid slice along z only receives voxels of a range of z, so each thread owns its grid slices.
+		void splat(const float *in, const int *sizes)
+		{
+			int gz;
+#pragma omp parallel for schedule(dynamic)
+			for (gz=0; gz<grid_sizes[2]; gz++)
+			{
+				for (int z=0; z<sizes[2]; z++)
+				{
+					if (static_cast<int>(spatial_coordinate(z) + 0.5f) != gz)
+					{
+						continue;
+					}
+					for (int y=0; y<sizes[1]; y++)
+					{
+						const int gy = static_cast<int>(spatial_coordinate(y) + 0.5f);
+						const float *row = in + (z * sizes[1] + y) * sizes[0];
+						for (int x=0; x<sizes[0]; x++)
+						{
+							const int gx = static_cast<int>(spatial_coordinate(x) + 0.5f);
+							const int gr = static_cast<int>(range_coordinate(row[x]) + 0.5f);
+							float *c = &grid[2 * cell(gx, gy, gz, gr)];
+							c[0] += row[x];
+							c[1] += 1;
+						}
+					}
+				}
+			}
+		}
+
+		/// convolve the grid with [1 4 6 4 1] / 16 along an axis
+		void blur(const int axis)
+		{
+			size_t stride = 1;
+			const int order[4] = {3, 0, 1, 2};
+			for (int a=0; a<4 && order[a]!=axis; a++)
+			{
+				stride *= grid_sizes[order[a]];
+			}
+			const int n = grid_sizes[axis];
+			const int lines = static_cast<int>(grid.size() / 2 / n);
+			int line;
+#pragma omp parallel
+			{
+				std::vector<float> buffer(2 * n);
+#pragma omp for
+				for (line=0; line<lines; line++)
+				{
+					// the first cell of the line: line is split into the index below and above the axis
+					const size_t first = line % stride + line / stride * stride * n;
+					for (int t=0; t<n; t++)
+					{
+						buffer[2 * t] = grid[2 * (first + t * stride)];
+						buffer[2 * t + 1] = grid[2 * (first + t * stride) + 1];
+					}
+					for (int t=0; t<n; t++)
+					{
+						float sum[2] = {6 * buffer[2 * t], 6 * buffer[2 * t + 1]};
+						for (int d=1; d<=2; d++)
+						{
+							const float w = d == 1 ? 4.0f : 1.0f;
+							for (int c=0; c<2; c++)
+							{
+								if (t - d >= 0) sum[c] += w * buffer[2 * (t - d) + c];
+								if (t + d < n) sum[c] += w * buffer[2 * (t + d) + c];
+							}
+						}
+						grid[2 * (first + t * stride)] = sum[0] * (1.0f / 16);
+						grid[2 * (first + t * stride) + 1] = sum[1] * (1.0f / 16);
+					}
+				}
+			}
+		}
+
+		/// interpolate the blurred grid at each voxel, the result is the normalized sum
+		void slice(const float *in, float *out, const int *sizes)
+		{
+			int z;
+#pragma omp parallel for
+			for (z=0; z<sizes[2]; z++)
+			{
+				const float fz = spatial_coordinate(z);
+				const int z0 = static_cast<int>(fz);
+				const float wz = fz - z0;
+				for (int y=0; y<sizes[1]; y++)
+				{
+					const float fy = spatial_coordinate(y);
+					const int y0 = static_cast<int>(fy);
+					const float wy = fy - y0;
+					const int index = (z * sizes[1] + y) * sizes[0];
+					for (int x=0; x<sizes[0]; x++)
+					{
+						const float fx = spatial_coordinate(x);
+						const int x0 = static_cast<int>(fx);
+						const float wx = fx - x0;
+						const float fr = range_coordinate(in[index + x]);
+						const int r0 = static_cast<int>(fr);
+						const float wr = fr - r0;
+
+						float sum = 0, weight = 0;
+						for (int c=0; c<16; c++)
+						{
+							const int dx = c & 1, dy = (c >> 1) & 1, dz = (c >> 2) & 1, dr = c >> 3;
+							const float w = (dx ? wx : 1 - wx) * (dy ? wy : 1 - wy) * (dz ? wz : 1 - wz) * (dr ? wr : 1 - wr);
+							const float *g = &grid[2 * cell(x0 + dx, y0 + dy, z0 + dz, r0 + dr)];
+							sum += w * g[0];
+							weight += w * g[1];
+						}
+						out[index + x] = weight > 0 ? sum / weight : in[index + x];
+					}
+				}
+			}
+		}
+	};
+}
+
+#endif // bilateral_utility_h
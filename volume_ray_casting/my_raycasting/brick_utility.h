@@ -0,0 +1,465 @@
+/**	@file
+*	a header file for computing derived volume attributes per brick on demand
+*/
+
+#ifndef brick_utility_h
+#define brick_utility_h
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "parallel_utility.h"
+
+/**	@brief	A demand-driven store of derived fields
+*
+*	The volume is split into cubic bricks. A derived field (gradient magnitude, local entropy, ...) is computed
+*	for a brick the first time one of its voxels is read, from the source values of the brick plus a halo
+*	of the kernel radius, and cached. When the cached bricks exceed the memory budget the least recently used
+*	ones are dropped and recomputed if they are read again. A consumer that reads a part of the volume
+*	(a region of interest, a zoomed view) only pays for the bricks it touches.
+*	Volumes are indexed as (z * sizes[1] + y) * sizes[0] + x.
+*/
+namespace brick_utility
+{
+	/**	@brief	A scalar field over the volume that can copy out a box of its values
+	*
+	*/
+	class Field
+	{
+	public:
+		virtual ~Field()
+		{
+		}
+
+		/// sizes of the volume in x, y and z
+		virtual const int *get_sizes() const = 0;
+
+		/// copy the box [origin, origin + extent) to out, x running fastest.
+		/// Coordinates outside the volume are clamped to the boundary.
+		virtual void gather(const int *origin, const int *extent, float *out) = 0;
+
+		/// make the box [origin, origin + extent) cheap to gather
+		virtual void prefetch(const int * /*origin*/, const int * /*extent*/)
+		{
+		}
+	};
+
+	/// clamp v into [0, size-1]
+	inline int clamp(const int v, const int size)
+	{
+		return v < 0 ? 0 : (v >= size ? size - 1 : v);
+	}
+
+	/**	@brief	The volume data as a field
+	*
+	*/
+	template <class T>
+	class ArrayField : public Field
+	{
+	public:
+
+		ArrayField(const T *data, const int *sizes) : data(data)
+		{
+			std::copy(sizes, sizes + 3, this->sizes);
+		}
+
+		const int *get_sizes() const
+		{
+			return sizes;
+		}
+
+		void gather(const int *origin, const int *extent, float *out)
+		{
+			for (int k=0; k<extent[2]; k++)
+			{
+				const int z = clamp(origin[2] + k, sizes[2]);
+				for (int j=0; j<extent[1]; j++)
+				{
+					const int y = clamp(origin[1] + j, sizes[1]);
+					const T *row = data + (z * sizes[1] + y) * sizes[0];
+					for (int i=0; i<extent[0]; i++)
+					{
+						*out++ = static_cast<float>(row[clamp(origin[0] + i, sizes[0])]);
+					}
+				}
+			}
+		}
+
+	private:
+		const T *data;
+		int sizes[3];
+	};
+
+	/**	@brief	The computation of a derived field on a box
+	*
+	*/
+	class Kernel
+	{
+	public:
+		virtual ~Kernel()
+		{
+		}
+
+		/// the number of voxels read on each side of an output voxel
+		virtual int get_halo() const = 0;
+
+		/// compute the box of the given extent from in, which holds the box grown by the halo on each side
+		virtual void compute(const float *in, const int *extent, float *out) const = 0;
+	};
+
+	/**	@brief	Magnitude of the central differences, multiplied by scale
+	*
+	*	At the volume boundary the clamped halo turns the central difference into a one-sided one.
+	*	If whole is set the magnitudes are truncated to integers.
+	*/
+	class GradientMagnitudeKernel : public Kernel
+	{
+	public:
+
+		explicit GradientMagnitudeKernel(const float scale = 1, const bool whole = false) : scale(scale), whole(whole)
+		{
+		}
+
+		int get_halo() const
+		{
+			return 1;
+		}
+
+		void compute(const float *in, const int *extent, float *out) const
+		{
+			const int sx = extent[0] + 2, sy = extent[1] + 2;
+			const int slice = sx * sy;
+			for (int k=0; k<extent[2]; k++)
+			{
+				for (int j=0; j<extent[1]; j++)
+				{
+					const float *p = in + ((k + 1) * sy + j + 1) * sx + 1;
+					for (int i=0; i<extent[0]; i++, p++)
+					{
+						const float dx = p[1] - p[-1];
+						const float dy = p[sx] - p[-sx];
+						const float dz = p[slice] - p[-slice];
+						const float magnitude = scale * std::sqrt(dx * dx + dy * dy + dz * dz);
+						*out++ = whole ? std::floor(magnitude) : magnitude;
+					}
+				}
+			}
+		}
+
+	private:
+		float scale;
+		bool whole;
+	};
+
+	/**	@brief	Entropy of the values in the 3x3x3 neighbourhood
+	*
+	*/
+	class LocalEntropyKernel : public Kernel
+	{
+	public:
+
+		int get_halo() const
+		{
+			return 1;
+		}
+
+		void compute(const float *in, const int *extent, float *out) const
+		{
+			const int sx = extent[0] + 2, sy = extent[1] + 2;
+			float values[27];
+			for (int k=0; k<extent[2]; k++)
+			{
+				for (int j=0; j<extent[1]; j++)
+				{
+					for (int i=0; i<extent[0]; i++)
+					{
+						int n = 0;
+						for (int c=0; c<3; c++)
+						{
+							for (int b=0; b<3; b++)
+							{
+								const float *row = in + ((k + c) * sy + j + b) * sx + i;
+								values[n++] = row[0];
+								values[n++] = row[1];
+								values[n++] = row[2];
+							}
+						}
+
+						// equal values are adjacent after sorting, each run is one outcome
+						std::sort(values, values + 27);
+						float sum = 0;
+						int run = 1;
+						for (n=1; n<=27; n++)
+						{
+							if (n < 27 && values[n] == values[n - 1])
+							{
+								run++;
+							}else
+							{
+								const float probability = run / 27.0f;
+								sum -= probability * std::log(probability);
+								run = 1;
+							}
+						}
+						*out++ = sum;
+					}
+				}
+			}
+		}
+	};
+
+	/**	@brief	A derived field computed per brick when it is read, cached under a memory budget
+	*
+	*	get() and gather() compute missing bricks one at a time, prefetch() computes the missing bricks of a box
+	*	on all threads. None of them may be called concurrently, a parallel consumer prefetches its box first
+	*	and then reads it, which does not change the cache as long as the box fits in the budget.
+	*	A store is a Field itself, so a field derived from another derived field (e.g. the second derivative
+	*	from the gradient magnitude) is a store over a store.
+	*/
+	class BrickStore : public Field
+	{
+	public:
+
+		/// the kernel and the source must outlive the store. budget is in bytes.
+		BrickStore(Field &source, const Kernel &kernel, const int brick_size = 32, const size_t budget = 64 << 20)
+			: source(source), kernel(kernel), brick_size(brick_size), budget(budget), resident_bytes(0), tick(0), last_brick(-1)
+		{
+			const int *volume_sizes = source.get_sizes();
+			std::copy(volume_sizes, volume_sizes + 3, sizes);
+			for (int a=0; a<3; a++)
+			{
+				brick_number[a] = (sizes[a] + brick_size - 1) / brick_size;
+			}
+			bricks.resize(brick_number[0] * brick_number[1] * brick_number[2]);
+			last_use.resize(bricks.size(), 0);
+		}
+
+		const int *get_sizes() const
+		{
+			return sizes;
+		}
+
+		/// the value at (x, y, z)
+		float get(const int x, const int y, const int z)
+		{
+			const int brick = (z / brick_size * brick_number[1] + y / brick_size) * brick_number[0] + x / brick_size;
+			if (brick != last_brick)
+			{
+				if (bricks[brick].empty())
+				{
+					load(brick);
+				}
+				last_use[brick] = ++tick;
+				last_brick = brick;
+				brick_extent(brick, last_extent);
+			}
+			const int i = x % brick_size, j = y % brick_size, k = z % brick_size;
+			return bricks[brick][(k * last_extent[1] + j) * last_extent[0] + i];
+		}
+
+		void gather(const int *origin, const int *extent, float *out)
+		{
+			for (int k=0; k<extent[2]; k++)
+			{
+				const int z = clamp(origin[2] + k, sizes[2]);
+				for (int j=0; j<extent[1]; j++)
+				{
+					const int y = clamp(origin[1] + j, sizes[1]);
+					for (int i=0; i<extent[0]; i++)
+					{
+						*out++ = get(clamp(origin[0] + i, sizes[0]), y, z);
+					}
+				}
+			}
+		}
+
+		void prefetch(const int *origin, const int *extent)
+		{
+			int lower[3], upper[3];
+			for (int a=0; a<3; a++)
+			{
+				lower[a] = clamp(origin[a], sizes[a]) / brick_size;
+				upper[a] = clamp(origin[a] + extent[a] - 1, sizes[a]) / brick_size;
+			}
+
+			std::vector<int> missing;
+			for (int bz=lower[2]; bz<=upper[2]; bz++)
+			{
+				for (int by=lower[1]; by<=upper[1]; by++)
+				{
+					for (int bx=lower[0]; bx<=upper[0]; bx++)
+					{
+						const int brick = (bz * brick_number[1] + by) * brick_number[0] + bx;
+						if (bricks[brick].empty())
+						{
+							missing.push_back(brick);
+						}else
+						{
+							last_use[brick] = ++tick;
+						}
+					}
+				}
+			}
+
+			if (missing.empty())
+			{
+				return;
+			}
+
+			// let a derived source compute its part of the box in parallel first
+			const int halo = kernel.get_halo();
+			int source_origin[3], source_extent[3];
+			for (int a=0; a<3; a++)
+			{
+				source_origin[a] = lower[a] * brick_size - halo;
+				source_extent[a] = std::min((upper[a] + 1) * brick_size, sizes[a]) + halo - source_origin[a];
+			}
+			source.prefetch(source_origin, source_extent);
+
+			// the sources are gathered in turn since the source may be a store itself, the kernels run in parallel
+			const int batch = 2 * parallel_utility::get_thread_number();
+			std::vector<std::vector<float> > inputs(batch), outputs(batch);
+			std::vector<int> extents(3 * batch);
+			for (size_t first=0; first<missing.size(); first+=batch)
+			{
+				const int n = static_cast<int>(std::min(missing.size() - first, static_cast<size_t>(batch)));
+				int b;
+				for (b=0; b<n; b++)
+				{
+					gather_input(missing[first + b], inputs[b]);
+					outputs[b].resize(brick_voxels(missing[first + b]));
+					brick_extent(missing[first + b], &extents[3 * b]);
+				}
+#pragma omp parallel for schedule(dynamic)
+				for (b=0; b<n; b++)
+				{
+					kernel.compute(&inputs[b][0], &extents[3 * b], &outputs[b][0]);
+				}
+				for (b=0; b<n; b++)
+				{
+					store(missing[first + b], outputs[b]);
+				}
+			}
+		}
+
+		/// drop all cached bricks
+		void clear()
+		{
+			for (size_t b=0; b<bricks.size(); b++)
+			{
+				std::vector<float>().swap(bricks[b]);
+			}
+			resident_bytes = 0;
+			last_brick = -1;
+		}
+
+		/// edge length of the bricks
+		int get_brick_size() const
+		{
+			return brick_size;
+		}
+
+		/// bytes held by the cached bricks
+		size_t get_resident_bytes() const
+		{
+			return resident_bytes;
+		}
+
+	private:
+		Field &source;
+		const Kernel &kernel;
+		int sizes[3];
+		int brick_size, brick_number[3];
+		size_t budget, resident_bytes;
+		std::vector<std::vector<float> > bricks;
+		/// the tick of the last read of each brick, for the least recently used eviction
+		std::vector<unsigned int> last_use;
+		unsigned int tick;
+		/// the brick read last and its extent
+		int last_brick, last_extent[3];
+
+		/// origin of a brick
+		void brick_origin(const int brick, int *origin) const
+		{
+			origin[0] = brick % brick_number[0] * brick_size;
+			origin[1] = brick / brick_number[0] % brick_number[1] * brick_size;
+			origin[2] = brick / brick_number[0] / brick_number[1] * brick_size;
+		}
+
+		/// extent of a brick, smaller than brick_size at the upper boundary
+		void brick_extent(const int brick, int *extent) const
+		{
+			int origin[3];
+			brick_origin(brick, origin);
+			for (int a=0; a<3; a++)
+			{
+				extent[a] = std::min(brick_size, sizes[a] - origin[a]);
+			}
+		}
+
+		/// number of voxels of a brick
+		size_t brick_voxels(const int brick) const
+		{
+			int extent[3];
+			brick_extent(brick, extent);
+			return static_cast<size_t>(extent[0]) * extent[1] * extent[2];
+		}
+
+		/// copy the source values of a brick and its halo
+		void gather_input(const int brick, std::vector<float> &input)
+		{
+			const int halo = kernel.get_halo();
+			int origin[3], extent[3], brick_sizes[3];
+			brick_origin(brick, origin);
+			brick_extent(brick, brick_sizes);
+			for (int a=0; a<3; a++)
+			{
+				extent[a] = brick_sizes[a] + 2 * halo;
+				origin[a] -= halo;
+			}
+			input.resize(static_cast<size_t>(extent[0]) * extent[1] * extent[2]);
+			source.gather(origin, extent, &input[0]);
+		}
+
+		/// compute one brick
+		void load(const int brick)
+		{
+			int extent[3];
+			brick_extent(brick, extent);
+			std::vector<float> input, output(brick_voxels(brick));
+			gather_input(brick, input);
+			kernel.compute(&input[0], extent, &output[0]);
+			store(brick, output);
+		}
+
+		/// cache a computed brick, evicting the least recently used bricks while over the budget
+		void store(const int brick, std::vector<float> &values)
+		{
+			const size_t bytes = values.size() * sizeof(float);
+			while (resident_bytes + bytes > budget && resident_bytes > 0)
+			{
+				int oldest = -1;
+				for (int b=0; b<static_cast<int>(bricks.size()); b++)
+				{
+					if (!bricks[b].empty() && (oldest < 0 || last_use[b] < last_use[oldest]))
+					{
+						oldest = b;
+					}
+				}
+				resident_bytes -= bricks[oldest].size() * sizeof(float);
+				std::vector<float>().swap(bricks[oldest]);
+				if (oldest == last_brick)
+				{
+					last_brick = -1;
+				}
+			}
+			bricks[brick].swap(values);
+			last_use[brick] = ++tick;
+			resident_bytes += bytes;
+		}
+	};
+}
+
+#endif // brick_utility_h
@@ -0,0 +1,200 @@
+/**	@file
+*	a header file for recursive Gaussian smoothing and derivative filters
+*/
+
+#ifndef gaussian_utility_h
+#define gaussian_utility_h
+
+#include <vector>
+#include <cmath>
+
+/**	@brief	Gaussian smoothing and derivatives at any scale with a constant cost per voxel
+*
+*	The Gaussian is approximated by the third order recursive filter of Young and van Vliet, run forward and
+*	backward along each axis. The backward pass starts from the boundary conditions of Triggs and Sdika, so the
+*	volume is extended by its boundary values as a convolution with clamped borders would do.
+*	The derivative along an axis is the central difference smoothed by the Gaussian.
+*	A line along y or z is filtered for a whole row of x at once, so the inner loops run over contiguous memory.
+*	Volumes are indexed as (z * sizes[1] + y) * sizes[0] + x, like in Volume and volume_utility.
+*/
+namespace gaussian_utility
+{
+	/**	@brief	The recursive filter of one Gaussian
+	*
+	*/
+	class RecursiveGaussian
+	{
+	public:
+
+		/// sigma should be at least 0.5
+		explicit RecursiveGaussian(const double sigma)
+		{
+			const double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1 - 0.26891 * sigma);
+			const double q2 = q * q, q3 = q2 * q;
+			const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+			const double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+			const double b2 = -(1.4281 * q2 + 1.26661 * q3);
+			const double b3 = 0.422205 * q3;
+			a[0] = b1 / b0;
+			a[1] = b2 / b0;
+			a[2] = b3 / b0;
+			gain = 1 - (a[0] + a[1] + a[2]);
+
+			// Triggs and Sdika: the backward state at the end of a line from the forward state, times the gain
+			const double a1 = a[0], a2 = a[1], a3 = a[2];
+			const double scale = gain / ((1 + a1 - a2 + a3) * (1 - a1 - a2 - a3) * (1 + a2 + (a1 - a3) * a3));
+			boundary[0][0] = scale * (-a3 * a1 + 1 - a3 * a3 - a2);
+			boundary[0][1] = scale * (a3 + a1) * (a2 + a3 * a1);
+			boundary[0][2] = scale * a3 * (a1 + a3 * a2);
+			boundary[1][0] = scale * (a1 + a3 * a2);
+			boundary[1][1] = -scale * (a2 - 1) * (a2 + a3 * a1);
+			boundary[1][2] = -scale * a3 * (a3 * a1 + a3 * a3 + a2 - 1);
+			boundary[2][0] = scale * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+			boundary[2][1] = scale * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3);
+			boundary[2][2] = scale * a3 * (a1 + a3 * a2);
+		}
+
+		/// filter n samples in place, sample t of line l is at lines[t * stride + l] for l in [0, width)
+		void filter(float *lines, const int n, const int stride, const int width) const
+		{
+			const float a1 = static_cast<float>(a[0]), a2 = static_cast<float>(a[1]), a3 = static_cast<float>(a[2]);
+			const float b = static_cast<float>(gain);
+			std::vector<float> last(lines + (n - 1) * stride, lines + (n - 1) * stride + width);
+			int t, l;
+
+			// forward, the line is extended by its first sample
+			// (w[0] = x[0] as the gain is 1 - (a1 + a2 + a3), so w[0] stands in for w[-1], w[-2] and w[-3])
+			for (t=1; t<n; t++)
+			{
+				float *w = lines + t * stride;
+				const float *w1 = w - stride;
+				const float *w2 = t >= 2 ? w - 2 * stride : lines;
+				const float *w3 = t >= 3 ? w - 3 * stride : lines;
+				for (l=0; l<width; l++)
+				{
+					w[l] = b * w[l] + a1 * w1[l] + a2 * w2[l] + a3 * w3[l];
+				}
+			}
+
+			// backward, started from y[n-1], y[n] and y[n+1] of the extension by the last sample
+			std::vector<float> extension(2 * width);
+			float *y = lines + (n - 1) * stride;
+			for (l=0; l<width; l++)
+			{
+				const float u = last[l];
+				const double d0 = y[l] - u;
+				const double d1 = (n >= 2 ? y[l - stride] : lines[l]) - u;
+				const double d2 = (n >= 3 ? y[l - 2 * stride] : lines[l]) - u;
+				y[l] = u + static_cast<float>(boundary[0][0] * d0 + boundary[0][1] * d1 + boundary[0][2] * d2);
+				extension[l] = u + static_cast<float>(boundary[1][0] * d0 + boundary[1][1] * d1 + boundary[1][2] * d2);
+				extension[width + l] = u + static_cast<float>(boundary[2][0] * d0 + boundary[2][1] * d1 + boundary[2][2] * d2);
+			}
+			for (t=n-2; t>=0; t--)
+			{
+				float *w = lines + t * stride;
+				const float *y1 = w + stride;
+				const float *y2 = t + 2 < n ? w + 2 * stride : &extension[0];
+				const float *y3 = t + 3 < n ? w + 3 * stride : &extension[(t + 3 - n) * width];
+				for (l=0; l<width; l++)
+				{
+					w[l] = b * w[l] + a1 * y1[l] + a2 * y2[l] + a3 * y3[l];
+				}
+			}
+		}
+
+	private:
+		/// feedback coefficients and gain of the recursion
+		double a[3], gain;
+		/// the Triggs and Sdika matrix
+		double boundary[3][3];
+	};
+
+	/// filter a volume in place along an axis (0 is x, 1 is y, 2 is z), the lines are distributed over the threads
+	inline void filter_axis(const RecursiveGaussian &gaussian, float *volume, const int *sizes, const int axis)
+	{
+		const int slice = sizes[0] * sizes[1];
+		int i;
+		if (axis == 0)
+		{
+			const int rows = sizes[1] * sizes[2];
+#pragma omp parallel for
+			for (i=0; i<rows; i++)
+			{
+				gaussian.filter(volume + i * sizes[0], sizes[0], 1, 1);
+			}
+		}else if (axis == 1)
+		{
+#pragma omp parallel for
+			for (i=0; i<sizes[2]; i++)
+			{
+				gaussian.filter(volume + i * slice, sizes[1], sizes[0], sizes[0]);
+			}
+		}else
+		{
+#pragma omp parallel for
+			for (i=0; i<sizes[1]; i++)
+			{
+				gaussian.filter(volume + i * sizes[0], sizes[2], slice, sizes[0]);
+			}
+		}
+	}
+
+	/// smooth a volume in place with a Gaussian of standard deviation sigma
+	inline void smooth(float *volume, const int *sizes, const double sigma)
+	{
+		const RecursiveGaussian gaussian(sigma);
+		for (int axis=0; axis<3; axis++)
+		{
+			filter_axis(gaussian, volume, sizes, axis);
+		}
+	}
+
+	/// out = (in[+1] - in[-1]) / 2 along an axis, one-sided at the boundary
+	inline void central_difference(const float *in, float *out, const int *sizes, const int axis)
+	{
+		const int step = axis == 0 ? 1 : (axis == 1 ? sizes[0] : sizes[0] * sizes[1]);
+		const int n = sizes[axis];
+		const int slices = sizes[2];
+		int z;
+#pragma omp parallel for
+		for (z=0; z<slices; z++)
+		{
+			for (int y=0; y<sizes[1]; y++)
+			{
+				const int row = (z * sizes[1] + y) * sizes[0];
+				const int position = axis == 0 ? 0 : (axis == 1 ? y : z);
+				const int lower = position > 0 ? step : 0;
+				const int upper = position < n - 1 ? step : 0;
+				for (int x=0; x<sizes[0]; x++)
+				{
+					const int index = row + x;
+					if (axis == 0)
+					{
+						const int left = x > 0 ? 1 : 0, right = x < n - 1 ? 1 : 0;
+						out[index] = 0.5f * (in[index + right] - in[index - left]);
+					}else
+					{
+						out[index] = 0.5f * (in[index + upper] - in[index - lower]);
+					}
+				}
+			}
+		}
+	}
+
+	/// the derivatives along x, y and z of the volume smoothed with a Gaussian of standard deviation sigma
+	inline void gradient(const float *volume, const int *sizes, const double sigma, float *dx, float *dy, float *dz)
+	{
+		const RecursiveGaussian gaussian(sigma);
+		float *derivatives[3] = {dx, dy, dz};
+		for (int d=0; d<3; d++)
+		{
+			central_difference(volume, derivatives[d], sizes, d);
+			for (int axis=0; axis<3; axis++)
+			{
+				filter_axis(gaussian, derivatives[d], sizes, axis);
+			}
+		}
+	}
+}
+
+#endif // gaussian_utility_h
@@ -0,0 +1,268 @@
+/**	@file
+*	a header file for derivative kernels on 8/16-bit volume data
+*/
+
+#ifndef gradient_utility_h
+#define gradient_utility_h
+
+#include <vector>
+
+#include "simd_utility.h"
+
+/**	@brief	Central differences and Sobel sums computed on the integer data
+*
+*	A central difference of 8-bit data fits in 16 bits and a Sobel sum (at most 16 * 255) too,
+*	so 8 voxels go through one SSE2 instruction; 16-bit data use 32-bit sums, 4 voxels at a time.
+*	The kernels work on one row of the volume (fixed i and j, k running), the caller converts
+*	the results to float only where they are normalized.
+*	The volume is indexed as ((i * sizes[1]) + j) * sizes[0] + k.
+*/
+namespace gradient_utility
+{
+	/// the integer type that holds differences and Sobel sums of T
+	template <class T>
+	struct difference
+	{
+		typedef int type;
+	};
+
+	template <>
+	struct difference<unsigned char>
+	{
+		typedef short type;
+	};
+
+	/// out = a
+	inline void widen(const unsigned char *a, short *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; k+16<=n; k+=16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_unpacklo_epi8(v, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k + 8), _mm_unpackhi_epi8(v, zero));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = a[k];
+		}
+	}
+
+	/// out = a
+	inline void widen(const unsigned short *a, int *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; k+8<=n; k+=8)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_unpacklo_epi16(v, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k + 4), _mm_unpackhi_epi16(v, zero));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = a[k];
+		}
+	}
+
+	/// out = a - b
+	inline void subtract(const unsigned char *a, const unsigned char *b, short *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; k+16<=n; k+=16)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k + 8), _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = static_cast<short>(a[k] - b[k]);
+		}
+	}
+
+	/// out = a - b
+	inline void subtract(const unsigned short *a, const unsigned short *b, int *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; k+8<=n; k+=8)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_sub_epi32(_mm_unpacklo_epi16(va, zero), _mm_unpacklo_epi16(vb, zero)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k + 4), _mm_sub_epi32(_mm_unpackhi_epi16(va, zero), _mm_unpackhi_epi16(vb, zero)));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = static_cast<int>(a[k]) - static_cast<int>(b[k]);
+		}
+	}
+
+	/// out = a - b
+	inline void subtract(const short *a, const short *b, short *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		for (; k+8<=n; k+=8)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_sub_epi16(va, vb));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = a[k] - b[k];
+		}
+	}
+
+	/// out = a - b
+	inline void subtract(const int *a, const int *b, int *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		for (; k+4<=n; k+=4)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_sub_epi32(va, vb));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = a[k] - b[k];
+		}
+	}
+
+	/// out = a + 2 * b + c, the [1 2 1] smoothing of the Sobel operator
+	inline void smooth(const short *a, const short *b, const short *c, short *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		for (; k+8<=n; k+=8)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + k));
+			__m128i vc = _mm_loadu_si128(reinterpret_cast<const __m128i *>(c + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_add_epi16(_mm_add_epi16(va, vc), _mm_slli_epi16(vb, 1)));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = a[k] + 2 * b[k] + c[k];
+		}
+	}
+
+	/// out = a + 2 * b + c, the [1 2 1] smoothing of the Sobel operator
+	inline void smooth(const int *a, const int *b, const int *c, int *out, const int n)
+	{
+		int k = 0;
+#ifdef SIMD_UTILITY_SSE2
+		for (; k+4<=n; k+=4)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + k));
+			__m128i vc = _mm_loadu_si128(reinterpret_cast<const __m128i *>(c + k));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_add_epi32(_mm_add_epi32(va, vc), _mm_slli_epi32(vb, 1)));
+		}
+#endif
+		for (; k<n; k++)
+		{
+			out[k] = a[k] + 2 * b[k] + c[k];
+		}
+	}
+
+	/// central differences of the row (i, j) along k, j and i, for the voxels 1 .. sizes[0]-2 of the row.
+	/// (i, j) must not be on the boundary, entries 0 and sizes[0]-1 of dk are not written.
+	template <class T>
+	void central_difference_row(const T *data, const int *sizes, const int i, const int j,
+		typename difference<T>::type *dk, typename difference<T>::type *dj, typename difference<T>::type *di)
+	{
+		const int width = sizes[0];
+		const int slice = sizes[0] * sizes[1];
+		const T *row = data + (i * sizes[1] + j) * width;
+		subtract(row + 2, row, dk + 1, width - 2);
+		subtract(row + width, row - width, dj, width);
+		subtract(row + slice, row - slice, di, width);
+	}
+
+	/**	@brief	Workspace and kernel of the 3D Sobel operator on one row
+	*
+	*	Each derivative is a central difference along its axis, smoothed with [1 2 1] along the other two.
+	*	The 3x3 neighbouring rows are widened once and shared by the three derivatives.
+	*/
+	template <class T>
+	class SobelRow
+	{
+	public:
+		typedef typename difference<T>::type D;
+
+		explicit SobelRow(const int width) : width(width), rows(9 * width), temp(4 * width)
+		{
+		}
+
+		/// Sobel sums of the row (i, j) along k, j and i, for the voxels 1 .. sizes[0]-2 of the row.
+		/// (i, j) must not be on the boundary, entries 0 and sizes[0]-1 are not written.
+		void operator()(const T *data, const int *sizes, const int i, const int j, D *dk, D *dj, D *di)
+		{
+			const int slice = sizes[0] * sizes[1];
+			const T *center = data + (i * sizes[1] + j) * width;
+			for (int a=0; a<3; a++)
+			{
+				for (int b=0; b<3; b++)
+				{
+					widen(center + (a - 1) * slice + (b - 1) * width, row(a, b), width);
+				}
+			}
+
+			D *t0 = &temp[0], *t1 = &temp[width], *t2 = &temp[2 * width], *t = &temp[3 * width];
+			const int n = width - 2;
+
+			// along i: difference of the slices, smoothed along j and k
+			subtract(row(2, 0), row(0, 0), t0, width);
+			subtract(row(2, 1), row(0, 1), t1, width);
+			subtract(row(2, 2), row(0, 2), t2, width);
+			smooth(t0, t1, t2, t, width);
+			smooth(t, t + 1, t + 2, di + 1, n);
+
+			// along j: difference of the rows, smoothed along i and k
+			subtract(row(0, 2), row(0, 0), t0, width);
+			subtract(row(1, 2), row(1, 0), t1, width);
+			subtract(row(2, 2), row(2, 0), t2, width);
+			smooth(t0, t1, t2, t, width);
+			smooth(t, t + 1, t + 2, dj + 1, n);
+
+			// along k: rows smoothed along j and i, then differenced
+			smooth(row(0, 0), row(0, 1), row(0, 2), t0, width);
+			smooth(row(1, 0), row(1, 1), row(1, 2), t1, width);
+			smooth(row(2, 0), row(2, 1), row(2, 2), t2, width);
+			smooth(t0, t1, t2, t, width);
+			subtract(t + 2, t, dk + 1, n);
+		}
+
+	private:
+		int width;
+		std::vector<D> rows;
+		std::vector<D> temp;
+
+		/// the widened row at offset (a-1, b-1) in (i, j)
+		D *row(const int a, const int b)
+		{
+			return &rows[(a * 3 + b) * width];
+		}
+	};
+}
+
+#endif // gradient_utility_h
@@ -0,0 +1,282 @@
+/**	@file
+*	a header file for half precision storage of derived volume attributes
+*/
+
+#ifndef half_utility_h
+#define half_utility_h
+
+#include <vector>
+#include <algorithm>
+
+#include "simd_utility.h"
+
+/**	@brief	Half precision (IEEE 754 binary16) conversion and storage
+*
+*	Derived attributes (gradient magnitude, derivatives, statistics) of 8-bit data are stored in 2 bytes per voxel
+*	and computed and accumulated in float. The bulk conversions use F16C instructions when the compiler
+*	targets them, the portable conversions round to nearest even like F16C does.
+*/
+namespace half_utility
+{
+	typedef unsigned short half;
+
+	/// the largest finite half value
+	const float HALF_MAX = 65504.0f;
+
+	/// bit pattern of a float
+	union FloatBits
+	{
+		float f;
+		unsigned int u;
+	};
+
+	/// convert a float to half, rounding to nearest even
+	inline half float_to_half(const float value)
+	{
+		FloatBits f;
+		f.f = value;
+		const unsigned int sign = f.u & 0x80000000u;
+		f.u ^= sign;
+
+		half h;
+		if (f.u >= (127u + 16u) << 23)
+		{
+			// overflow to infinity, NaN stays NaN
+			h = (f.u > 255u << 23) ? 0x7e00 : 0x7c00;
+		}else if (f.u < 113u << 23)
+		{
+			// subnormal or zero, let the float adder do the rounding
+			FloatBits magic;
+			magic.u = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+			f.f += magic.f;
+			h = static_cast<half>(f.u - magic.u);
+		}else
+		{
+			const unsigned int odd = (f.u >> 13) & 1u;
+			f.u += ((15u - 127u) << 23) + 0xfffu + odd;
+			h = static_cast<half>(f.u >> 13);
+		}
+		return static_cast<half>(h | (sign >> 16));
+	}
+
+	/// convert a half to float, exactly
+	inline float half_to_float(const half value)
+	{
+		const unsigned int shifted_exponent = 0x7c00u << 13;
+		FloatBits f;
+		f.u = (value & 0x7fffu) << 13;
+		const unsigned int exponent = shifted_exponent & f.u;
+		f.u += (127u - 15u) << 23;
+		if (exponent == shifted_exponent)
+		{
+			// infinity or NaN
+			f.u += (128u - 16u) << 23;
+		}else if (exponent == 0)
+		{
+			// subnormal
+			FloatBits magic;
+			magic.u = 113u << 23;
+			f.u += 1u << 23;
+			f.f -= magic.f;
+		}
+		f.u |= (value & 0x8000u) << 16;
+		return f.f;
+	}
+
+	/// convert n floats to half
+	inline void float_to_half(const float *in, half *out, const unsigned int n)
+	{
+		unsigned int i = 0;
+#ifdef SIMD_UTILITY_F16C
+		for (; i+8<=n; i+=8)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), 0));
+		}
+#endif
+		for (; i<n; i++)
+		{
+			out[i] = float_to_half(in[i]);
+		}
+	}
+
+	/// convert n halfs to float
+	inline void half_to_float(const half *in, float *out, const unsigned int n)
+	{
+		unsigned int i = 0;
+#ifdef SIMD_UTILITY_F16C
+		for (; i+8<=n; i+=8)
+		{
+			_mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+		}
+#endif
+		for (; i<n; i++)
+		{
+			out[i] = half_to_float(in[i]);
+		}
+	}
+
+	/**	@brief	A field of values per voxel stored as half where half is precise enough, else as float
+	*
+	*	Half keeps a relative precision of 2^-11, so the integers are exact up to 2048. Fields bounded by that,
+	*	like the derivatives of 8-bit data (8 * 255), are stored in 2 bytes per voxel. Fields of larger bound,
+	*	like the derivatives of 16-bit data, would be quantised in steps of 16 and more, and are stored as float.
+	*	Values below 2^-14 become subnormal and lose precision. Fields without a tight bound use FloatField.
+	*/
+	class HalfField
+	{
+	public:
+
+		/// the bound up to which the values are stored as half
+		static float half_bound() { return 2048.0f; }
+
+		/// allocate count values of magnitude up to bound, all set to 0. Return false if there is not enough memory.
+		bool allocate(const unsigned int count, const float bound)
+		{
+			clear();
+			try
+			{
+				if (bound > half_bound())
+				{
+					std::vector<float>(count, 0.0f).swap(full);
+				}else
+				{
+					std::vector<half>(count, 0).swap(values);
+				}
+			}catch (...)
+			{
+				clear();
+				return false;
+			}
+			return true;
+		}
+
+		/// free the values
+		void clear()
+		{
+			std::vector<half>().swap(values);
+			std::vector<float>().swap(full);
+		}
+
+		/// true if nothing is allocated
+		bool empty() const
+		{
+			return values.empty() && full.empty();
+		}
+
+		/// number of values
+		unsigned int size() const
+		{
+			return static_cast<unsigned int>(full.empty() ? values.size() : full.size());
+		}
+
+		/// store a value, a positive value never rounds to 0 so that it stays usable as a divisor
+		void set(const unsigned int index, const float value)
+		{
+			if (!full.empty())
+			{
+				full[index] = value;
+				return;
+			}
+			half h = float_to_half(value);
+			if (h == 0 && value > 0)
+			{
+				h = 1;
+			}
+			values[index] = h;
+		}
+
+		/// read a value
+		float get(const unsigned int index) const
+		{
+			return full.empty() ? half_to_float(values[index]) : full[index];
+		}
+
+		/// store n values starting at index
+		void set(const unsigned int index, const float *in, const unsigned int n)
+		{
+			if (full.empty())
+			{
+				float_to_half(in, &values[index], n);
+			}else
+			{
+				std::copy(in, in + n, full.begin() + index);
+			}
+		}
+
+		/// read n values starting at index
+		void get(const unsigned int index, float *out, const unsigned int n) const
+		{
+			if (full.empty())
+			{
+				half_to_float(&values[index], out, n);
+			}else
+			{
+				std::copy(full.begin() + index, full.begin() + index + n, out);
+			}
+		}
+
+	private:
+		std::vector<half> values;
+		/// the values if the bound is too large for half
+		std::vector<float> full;
+	};
+
+	/**	@brief	A field of values per voxel stored as float, with the interface of HalfField
+	*
+	*	For fields without a tight bound, e.g. elasticity and variance, where a scaled half would
+	*	flush the common small values to 0.
+	*/
+	class FloatField
+	{
+	public:
+
+		/// allocate count values, all set to 0. The bound is not needed. Return false if there is not enough memory.
+		bool allocate(const unsigned int count, const float /*bound*/)
+		{
+			try
+			{
+				std::vector<float>(count, 0.0f).swap(values);
+			}catch (...)
+			{
+				clear();
+				return false;
+			}
+			return true;
+		}
+
+		/// free the values
+		void clear()
+		{
+			std::vector<float>().swap(values);
+		}
+
+		/// true if nothing is allocated
+		bool empty() const
+		{
+			return values.empty();
+		}
+
+		/// number of values
+		unsigned int size() const
+		{
+			return static_cast<unsigned int>(values.size());
+		}
+
+		/// store a value
+		void set(const unsigned int index, const float value)
+		{
+			values[index] = value;
+		}
+
+		/// read a value
+		float get(const unsigned int index) const
+		{
+			return values[index];
+		}
+
+	private:
+		std::vector<float> values;
+	};
+}
+
+#endif // half_utility_h
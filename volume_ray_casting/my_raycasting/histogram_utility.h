@@ -0,0 +1,461 @@
+/**	@file
+*	a header file for building histograms and querying percentiles
+*/
+
+#ifndef histogram_utility_h
+#define histogram_utility_h
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "parallel_utility.h"
+#include "simd_utility.h"
+
+/**	@brief	Classes and functions for histograms of volume data
+*
+*/
+namespace histogram_utility
+{
+	/**	@brief	A histogram with its prefix sum
+	*
+	*	Each thread fills a private sub-histogram over its part of the volume, the sub-histograms
+	*	are merged afterwards. The prefix sum answers min, max and percentile queries with a binary search,
+	*	so the volume never has to be scanned again for them.
+	*/
+	class Histogram
+	{
+	public:
+
+		Histogram() : lower(0), upper(0), total(0)
+		{
+		}
+
+		/// build the histogram of 8/16-bit data, the components of a voxel are averaged.
+		/// bin_number is the number of values of T or a smaller power of 2.
+		/// The averaged voxel values are written into scalar_value if it is not NULL.
+		template <class T>
+		void build(const T *data, const unsigned int count, const unsigned int components, const unsigned int bin_number, float *scalar_value = NULL)
+		{
+			unsigned int shift = 0;
+			while (((1u << (8 * sizeof(T))) >> shift) > bin_number)
+			{
+				shift++;
+			}
+			lower = 0;
+			upper = static_cast<float>(1u << (8 * sizeof(T)));
+
+			const int thread_number = parallel_utility::get_thread_number();
+			std::vector<unsigned int> sub_histograms(thread_number * bin_number, 0);
+			const int n = static_cast<int>(count);
+
+#pragma omp parallel
+			{
+				unsigned int *sub = &sub_histograms[parallel_utility::get_thread_index() * bin_number];
+				int i;
+				if (components == 1)
+				{
+#pragma omp for
+					for (i=0; i<n; i++)
+					{
+						unsigned int temp = data[i];
+						sub[temp >> shift]++;
+						if (scalar_value)
+						{
+							scalar_value[i] = static_cast<float>(temp);
+						}
+					}
+				}else
+				{
+#pragma omp for
+					for (i=0; i<n; i++)
+					{
+						unsigned int temp = 0;
+						unsigned int index = i * components;
+						for (unsigned int j=0; j<components; j++)
+						{
+							temp += data[index + j];
+						}
+						temp = temp / components;
+						sub[temp >> shift]++;
+						if (scalar_value)
+						{
+							scalar_value[i] = static_cast<float>(temp);
+						}
+					}
+				}
+			}
+
+			merge(sub_histograms, thread_number, bin_number);
+		}
+
+		/// build the histogram of float data over [value_min, value_max], values outside go to the end bins
+		void build(const float *data, const unsigned int count, const unsigned int bin_number, const float value_min, const float value_max)
+		{
+			lower = value_min;
+			upper = value_max;
+			const float scale = (value_max > value_min) ? bin_number / (value_max - value_min) : 0;
+			const float last = static_cast<float>(bin_number - 1);
+
+			const int thread_number = parallel_utility::get_thread_number();
+			std::vector<unsigned int> sub_histograms(thread_number * bin_number, 0);
+			const int n = static_cast<int>(count);
+			const int blocks = n / 4;
+
+#pragma omp parallel
+			{
+				unsigned int *sub = &sub_histograms[parallel_utility::get_thread_index() * bin_number];
+				int i;
+
+				// compute the bins of 4 values at a time
+#pragma omp for
+				for (i=0; i<blocks; i++)
+				{
+#ifdef SIMD_UTILITY_SSE2
+					__m128 v = _mm_loadu_ps(data + i * 4);
+					v = _mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(value_min)), _mm_set1_ps(scale));
+					v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(last));
+					int bins[4];
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(bins), _mm_cvttps_epi32(v));
+					sub[bins[0]]++;
+					sub[bins[1]]++;
+					sub[bins[2]]++;
+					sub[bins[3]]++;
+#else
+					for (int j=i*4; j<i*4+4; j++)
+					{
+						sub[get_bin(data[j], value_min, scale, last)]++;
+					}
+#endif
+				}
+
+#pragma omp single
+				for (i=blocks*4; i<n; i++)
+				{
+					sub[get_bin(data[i], value_min, scale, last)]++;
+				}
+			}
+
+			merge(sub_histograms, thread_number, bin_number);
+		}
+
+		/// take over the counts of an existing histogram
+		void assign(const unsigned int *histogram, const unsigned int bin_number, const float value_min, const float value_max)
+		{
+			lower = value_min;
+			upper = value_max;
+			frequency.assign(histogram, histogram + bin_number);
+			accumulate();
+		}
+
+		/// number of bins
+		unsigned int get_bin_number() const
+		{
+			return static_cast<unsigned int>(frequency.size());
+		}
+
+		/// the counts of all the bins
+		const unsigned int *get_frequencies() const
+		{
+			return &frequency[0];
+		}
+
+		/// number of values in a bin
+		unsigned int get_frequency(const unsigned int bin) const
+		{
+			return frequency[bin];
+		}
+
+		/// number of values in the bins 0 to bin
+		unsigned int get_accumulation(const unsigned int bin) const
+		{
+			return accumulation[bin];
+		}
+
+		/// number of values in the histogram
+		unsigned int get_total() const
+		{
+			return total;
+		}
+
+		/// the first bin that is not empty
+		unsigned int get_min_bin() const
+		{
+			return clamp_bin(std::lower_bound(accumulation.begin(), accumulation.end(), 1u) - accumulation.begin());
+		}
+
+		/// the last bin that is not empty
+		unsigned int get_max_bin() const
+		{
+			return clamp_bin(std::lower_bound(accumulation.begin(), accumulation.end(), total) - accumulation.begin());
+		}
+
+		/// the first bin where the accumulated count reaches the fraction p of the total
+		unsigned int get_percentile_bin(const double p) const
+		{
+			const unsigned int amount = static_cast<unsigned int>(total * p);
+			return clamp_bin(std::lower_bound(accumulation.begin(), accumulation.end(), amount) - accumulation.begin());
+		}
+
+		/// the last bin where the count accumulated from the top reaches the fraction p of the total
+		unsigned int get_percentile_bin_from_top(const double p) const
+		{
+			const unsigned int amount = static_cast<unsigned int>(total * p);
+			return clamp_bin(std::upper_bound(accumulation.begin(), accumulation.end(), total - amount) - accumulation.begin());
+		}
+
+		/// the lower edge of a bin in the data domain
+		float get_bin_value(const unsigned int bin) const
+		{
+			return lower + (upper - lower) * bin / get_bin_number();
+		}
+
+		/// the value below which the fraction p of the data lies
+		float get_percentile(const double p) const
+		{
+			return get_bin_value(get_percentile_bin(p));
+		}
+
+	private:
+
+		/// the counts
+		std::vector<unsigned int> frequency;
+		/// the prefix sum of the counts
+		std::vector<unsigned int> accumulation;
+		/// the range of values covered by the bins
+		float lower, upper;
+		/// number of values
+		unsigned int total;
+
+		/// the bin of a float value
+		static unsigned int get_bin(const float value, const float value_min, const float scale, const float last)
+		{
+			float t = (value - value_min) * scale;
+			t = t < 0 ? 0 : (t > last ? last : t);
+			return static_cast<unsigned int>(t);
+		}
+
+		/// keep a search result inside the bins
+		unsigned int clamp_bin(const size_t bin) const
+		{
+			return static_cast<unsigned int>(std::min(bin, frequency.size() - 1));
+		}
+
+		/// sum up the sub-histograms of the threads
+		void merge(const std::vector<unsigned int> &sub_histograms, const int thread_number, const unsigned int bin_number)
+		{
+			frequency.assign(bin_number, 0);
+			const int n = static_cast<int>(bin_number);
+			int i;
+#pragma omp parallel for
+			for (i=0; i<n; i++)
+			{
+				unsigned int sum = 0;
+				for (int t=0; t<thread_number; t++)
+				{
+					sum += sub_histograms[t * bin_number + i];
+				}
+				frequency[i] = sum;
+			}
+			accumulate();
+		}
+
+		/// compute the prefix sum
+		void accumulate()
+		{
+			accumulation.resize(frequency.size());
+			unsigned int sum = 0;
+			for (size_t i=0; i<frequency.size(); i++)
+			{
+				sum += frequency[i];
+				accumulation[i] = sum;
+			}
+			total = sum;
+		}
+	};
+
+	/**	@brief	A 2D histogram of attribute pairs
+	*
+	*	The pairs are binned once on the CPU with private per-thread histograms, and the result is turned into
+	*	an RGBA image that can be shown with a single textured quad, so redrawing it does not depend on the volume size.
+	*	An optional color per pair is averaged in each bin.
+	*/
+	class JointHistogram
+	{
+	public:
+
+		JointHistogram() : width(0), height(0), max_frequency(0)
+		{
+		}
+
+		/// bin the pairs (x[i], y[i]) with x in [0, x_max] and y in [0, y_max] into width*height bins.
+		/// color holds 3 floats per pair and may be NULL.
+		void build(const float *x, const float *y, const unsigned int count, const unsigned int width, const unsigned int height,
+			const float x_max, const float y_max, const float *color = NULL)
+		{
+			this->width = width;
+			this->height = height;
+			const unsigned int bin_number = width * height;
+			const float x_scale = x_max > 0 ? width / x_max : 0;
+			const float y_scale = y_max > 0 ? height / y_max : 0;
+			const float x_last = static_cast<float>(width - 1);
+			const float y_last = static_cast<float>(height - 1);
+
+			const int thread_number = parallel_utility::get_thread_number();
+			std::vector<unsigned int> sub_histograms(thread_number * bin_number, 0);
+			std::vector<float> sub_colors(color ? thread_number * bin_number * 3 : 0, 0);
+			const int n = static_cast<int>(count);
+
+#pragma omp parallel
+			{
+				const int t = parallel_utility::get_thread_index();
+				unsigned int *sub = &sub_histograms[t * bin_number];
+				float *sub_color = color ? &sub_colors[t * bin_number * 3] : NULL;
+				int i;
+#pragma omp for
+				for (i=0; i<n; i++)
+				{
+					float u = x[i] * x_scale;
+					float v = y[i] * y_scale;
+					u = u < 0 ? 0 : (u > x_last ? x_last : u);
+					v = v < 0 ? 0 : (v > y_last ? y_last : v);
+					const unsigned int bin = static_cast<unsigned int>(v) * width + static_cast<unsigned int>(u);
+					sub[bin]++;
+					if (sub_color)
+					{
+						sub_color[bin * 3] += color[i * 3];
+						sub_color[bin * 3 + 1] += color[i * 3 + 1];
+						sub_color[bin * 3 + 2] += color[i * 3 + 2];
+					}
+				}
+			}
+
+			// merge the sub-histograms
+			frequency.assign(bin_number, 0);
+			colors.assign(color ? bin_number * 3 : 0, 0);
+			const int m = static_cast<int>(bin_number);
+			int i;
+#pragma omp parallel for
+			for (i=0; i<m; i++)
+			{
+				unsigned int sum = 0;
+				float r = 0, g = 0, b = 0;
+				for (int t=0; t<thread_number; t++)
+				{
+					sum += sub_histograms[t * bin_number + i];
+					if (color)
+					{
+						r += sub_colors[(t * bin_number + i) * 3];
+						g += sub_colors[(t * bin_number + i) * 3 + 1];
+						b += sub_colors[(t * bin_number + i) * 3 + 2];
+					}
+				}
+				frequency[i] = sum;
+				if (color && sum > 0)
+				{
+					colors[i * 3] = r / sum;
+					colors[i * 3 + 1] = g / sum;
+					colors[i * 3 + 2] = b / sum;
+				}
+			}
+			max_frequency = frequency.empty() ? 0 : *std::max_element(frequency.begin(), frequency.end());
+		}
+
+		/// number of bins along x
+		unsigned int get_width() const
+		{
+			return width;
+		}
+
+		/// number of bins along y
+		unsigned int get_height() const
+		{
+			return height;
+		}
+
+		/// number of pairs in the bin (i, j)
+		unsigned int get_frequency(const unsigned int i, const unsigned int j) const
+		{
+			return frequency[j * width + i];
+		}
+
+		/// write the histogram as RGBA bytes, row by row from y = 0.
+		/// The density is log scaled, log(1 + n) / log(1 + max), so sparse bins stay visible next to the peaks.
+		/// Without colors the bins are gray, otherwise the mean color is normalized to its brightest component.
+		void get_image(std::vector<unsigned char> &rgba) const
+		{
+			const int m = static_cast<int>(frequency.size());
+			rgba.assign(m * 4, 0);
+			if (max_frequency == 0)
+			{
+				return;
+			}
+			const float log_max = std::log(1.0f + max_frequency);
+			int i;
+#pragma omp parallel for
+			for (i=0; i<m; i++)
+			{
+				if (frequency[i] == 0)
+				{
+					continue;
+				}
+				const float density = std::log(1.0f + frequency[i]) / log_max;
+				float r = 1, g = 1, b = 1;
+				if (!colors.empty())
+				{
+					const float brightest = std::max(colors[i * 3], std::max(colors[i * 3 + 1], colors[i * 3 + 2]));
+					if (brightest > 0)
+					{
+						r = colors[i * 3] / brightest;
+						g = colors[i * 3 + 1] / brightest;
+						b = colors[i * 3 + 2] / brightest;
+					}
+				}
+				rgba[i * 4] = static_cast<unsigned char>(255 * r * density);
+				rgba[i * 4 + 1] = static_cast<unsigned char>(255 * g * density);
+				rgba[i * 4 + 2] = static_cast<unsigned char>(255 * b * density);
+				rgba[i * 4 + 3] = static_cast<unsigned char>(255 * density);
+			}
+		}
+
+	private:
+
+		/// the counts, row by row
+		std::vector<unsigned int> frequency;
+		/// the mean color of each bin, empty if no colors were given
+		std::vector<float> colors;
+		/// the size of the histogram
+		unsigned int width, height;
+		/// the largest count
+		unsigned int max_frequency;
+	};
+
+	/// find the minimum and maximum of float data in one parallel pass
+	inline void find_min_max(const float *data, const unsigned int count, float &value_min, float &value_max)
+	{
+		const int thread_number = parallel_utility::get_thread_number();
+		std::vector<float> mins(thread_number, data[0]), maxs(thread_number, data[0]);
+		const int n = static_cast<int>(count);
+
+#pragma omp parallel
+		{
+			const int t = parallel_utility::get_thread_index();
+			float a = mins[t], b = maxs[t];
+			int i;
+#pragma omp for
+			for (i=0; i<n; i++)
+			{
+				a = std::min(a, data[i]);
+				b = std::max(b, data[i]);
+			}
+			mins[t] = a;
+			maxs[t] = b;
+		}
+
+		value_min = *std::min_element(mins.begin(), mins.end());
+		value_max = *std::max_element(maxs.begin(), maxs.end());
+	}
+}
+
+#endif // histogram_utility_h
@@ -35,13 +35,24 @@ static bool pruneTest(			// test whether to prune candidate
     KMcenter		closeCand,		// closest candidate
     KMorthRect		&bnd_box);		// bounding box
 
+template <typename Coord>		// a point or a sum of points
 static void postNeigh(			// assign neighbors to center
     KCptr		p,			// the node posting
-    KMpoint		sum,			// the sum of coordinates
+    const Coord		*sum,			// the sum of coordinates
     double		sumSq,			// the sum of squares
     int			n_data,			// number of points
     KMctrIdx		ctrIdx);		// center index
 
+//----------------------------------------------------------------------
+//  KCsubtree - a subtree left to the threads by buildKcTreeTop()
+//----------------------------------------------------------------------
+struct KCsubtree {			// a subtree to build
+    KMdatIdxArray	pidx;		// point indices of the subtree
+    int			n;		// number of points
+    KMorthRect		*bnd_box;	// bounding box of the subtree
+    KCptr		*node;		// where to store the subtree
+};
+
 //----------------------------------------------------------------------
 //  KCtree constructors
 //	There is a skeleton kc-tree constructor which does (almost)
@@ -101,11 +112,20 @@ void KCtree::skeletonTree(		// construct skeleton tree
 // 	In the case of construction, these are initialized before
 // 	calling buildKcTree.  They are used in getNeighbors() and by
 // 	sampleCtr().
+//
+// 	Each thread has its own copy, so that several threads may
+// 	traverse the tree at once (see KMfilterCenters::swapBestCenter).
+// 	The threads building the subtrees get the values of the
+// 	constructing thread.  Every traversal (getNeighbors(),
+// 	getAssignments() and sampleCtr()) sets them from the tree on
+// 	entry, so no value is carried over from an earlier parallel
+// 	region.
 //----------------------------------------------------------------------
 
 int		kcDim;			// dimension of space
 int		kcDataSize;		// number of data points
 KMdataArray	kcPoints;		// data points
+#pragma omp threadprivate(kcDim, kcDataSize, kcPoints)
 
 //----------------------------------------------------------------------
 //  initBasicGlobals - initialize basic globals
@@ -159,14 +179,106 @@ KCtree::KCtree(			// construct from point array
     skeletonTree(pa, n, dd, n_max, bb_lo, bb_hi, NULL);
     initBasicGlobals(dd, n, pa);	// initialize globals
 
-    root = buildKcTree(pa, pidx, n, dd, bnd_box);
+    vector<KCsubtree> subtrees;		// split the top of the tree
+    vector<KCsplit*> top;
+    buildKcTreeTop(pa, pidx, n, dd, bnd_box, KC_PAR_DEPTH, root,
+    		subtrees, top);
+
+    int nSub = (int) subtrees.size();
+    int s;
+    					// build and sum the subtrees
+#pragma omp parallel for schedule(dynamic) copyin(kcDim, kcDataSize, kcPoints)
+    for (s = 0; s < nSub; s++) {
+	KCsubtree &sub = subtrees[s];
+	KCptr node = buildKcTree(pa, sub.pidx, sub.n, dd, *sub.bnd_box);
+	int ignoreMe1;			// ignore results of call
+	KMsumPoint ignoreMe2;
+	double ignoreMe3;
+	node->makeSums(ignoreMe1, ignoreMe2, ignoreMe3);
+	*sub.node = node;
+	delete sub.bnd_box;
+    }
+    					// sum the top nodes
+    for (int i = 0; i < (int) top.size(); i++) {
+	sumTopNode(top[i]);
+    }
+    assert(root->n_data == n);		// should be all the points
+}
+
+//----------------------------------------------------------------------
+//  buildKcTreeTop - split the top of the kc-tree
+//	Splits the points like buildKcTree(), but stops at depth
+//	KC_PAR_DEPTH and at nodes with fewer than KC_PAR_MIN_PTS points.
+//	Each of these is returned as a subtree to be built later, along
+//	with a copy of its bounding box and the child pointer that will
+//	hold it.  The splitting nodes are created before their children
+//	(their bounding box is the one given here) and are listed in
+//	postorder, so their sums can be computed bottom up.
+//----------------------------------------------------------------------
+
+void KCtree::buildKcTreeTop(	// split the top of the kc-tree
+    KMdataArray		pa,		// point array
+    KMdatIdxArray	pidx,		// point indices to store in subtree
+    int			n,		// number of points
+    int			dim,		// dimension of space
+    KMorthRect		&bnd_box,	// bounding box for current node
+    int			depth,		// remaining depth of top splits
+    KCptr		&node,		// the node (returned)
+    vector<KCsubtree>	&subtrees,	// subtrees to build (returned)
+    vector<KCsplit*>	&top)		// top nodes in postorder (returned)
+{
+    if (n <= 1 || depth == 0 || n < KC_PAR_MIN_PTS) {
+	KCsubtree sub;			// leave it to the threads
+	sub.pidx = pidx;
+	sub.n = n;
+	sub.bnd_box = new KMorthRect(dim, bnd_box);
+	sub.node = &node;
+	subtrees.push_back(sub);
+	node = NULL;
+	return;
+    }
+    int cd;				// cutting dimension
+    KMcoord cv;				// cutting value
+    int n_lo;				// number on low side of cut
+
+					// invoke splitting procedure
+    sl_midpt_split(pa, pidx, bnd_box, n, dim, cd, cv, n_lo);
+
+    KMcoord lv = bnd_box.lo[cd];	// save bounds for cutting dimension
+    KMcoord hv = bnd_box.hi[cd];
+					// create the splitting node
+    KCsplit *ptr = new KCsplit(dim, bnd_box, cd, cv, lv, hv);
+    node = ptr;
+
+    bnd_box.hi[cd] = cv;		// modify bounds for left subtree
+    buildKcTreeTop(pa, pidx, n_lo, dim, bnd_box, depth-1,
+    		ptr->child[KM_LO], subtrees, top);
+    bnd_box.hi[cd] = hv;		// restore bounds
 
-    int ignoreMe1;			// ignore results of call
-    KMpoint ignoreMe2;
-    double ignoreMe3;
-    					// compute sums
-    root->makeSums(ignoreMe1, ignoreMe2, ignoreMe3);
-    assert(ignoreMe1 == n);		// should be all the points
+    bnd_box.lo[cd] = cv;		// modify bounds for right subtree
+    buildKcTreeTop(pa, pidx + n_lo, n-n_lo, dim, bnd_box, depth-1,
+    		ptr->child[KM_HI], subtrees, top);
+    bnd_box.lo[cd] = lv;		// restore bounds
+
+    top.push_back(ptr);			// after its children
+}
+
+//----------------------------------------------------------------------
+//  sumTopNode - sums of a splitting node whose children are summed
+//	This is KCsplit::makeSums() without the recursion.
+//----------------------------------------------------------------------
+
+void KCtree::sumTopNode(KCsplit *p)
+{
+    p->n_data = 0;
+    for (int i = KM_LO; i <= KM_HI; i++) {
+	KCptr c = p->child[i];
+	p->n_data += c->n_data;
+	for (int d = 0; d < dim; d++) {
+	    p->sum[d] += c->sum[d];
+	}
+	p->sumSq += c->sumSq;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -271,12 +383,12 @@ KMpoint KCleaf::getPoint()		// get data point
 
 void KCsplit::makeSums(
     int			&n,			// number of points (returned)
-    KMpoint		&theSum,		// sum (returned)
+    KMsumPoint		&theSum,		// sum (returned)
     double		&theSumSq)		// sum of squares (returned)
 {
     assert(sum != NULL);			// should already be allocated
     int n_child = 0;				// n_data of child
-    KMpoint s_child = NULL;			// sum of child
+    KMsumPoint s_child = NULL;			// sum of child
     double ssq_child = 0;			// sum of squares for child
 
     n_data = 0;					// initialize no. points
@@ -298,7 +410,7 @@ void KCsplit::makeSums(
 //----------------------------------------------------------------------
 void KCleaf::makeSums(
     int			&n,			// number of points (returned)
-    KMpoint		&theSum,		// sum (returned)
+    KMsumPoint		&theSum,		// sum (returned)
     double		&theSumSq)		// sum of squares (returned)
 {
     assert(sum != NULL);			// should already be allocated
@@ -306,7 +418,7 @@ void KCleaf::makeSums(
     sumSq = 0;
     for (int i = 0; i < n_data; i++) {		// compute sum
 	for (int d = 0; d < kcDim; d++) {
-	    KMcoord theCoord = kcPoints[bkt[i]][d];
+	    KMsum theCoord = kcPoints[bkt[i]][d];
 	    sum[d] += theCoord;
 	    sumSq += theCoord * theCoord;
 	}
@@ -338,7 +450,7 @@ KCtree::~KCtree()		// tree destructor
 
 KCnode::~KCnode()		// node destructor
 {
-    if (sum != NULL) kmDeallocPt(sum);	// deallocate sum
+    if (sum != NULL) kmDeallocSum(sum);	// deallocate sum
 }
 
 //----------------------------------------------------------------------
@@ -440,7 +552,7 @@ void KCsplit::print(		// print splitting node
     *kmOut << "Split"			// print without address
         << " cd=" << cut_dim << " cv=" << setw(6) << cut_val
        	<< " nd=" << n_data
-       	<< " sm=";  kmPrintPt(sum, kcDim, true);
+       	<< " sm=";  kmPrintSum(sum, kcDim, true);
     *kmOut << " ss=" << sumSq << "\n";
     					// print low child
     child[KM_LO]->print(level+1);
@@ -462,7 +574,7 @@ void KCleaf::print(			// print leaf node
 	if (j < n_data-1) *kmOut << ",";
     }
     *kmOut << ">"
-       	<< " sm=";  kmPrintPt(sum, kcDim, true);
+       	<< " sm=";  kmPrintSum(sum, kcDim, true);
     *kmOut << " ss=" << sumSq << "\n";
 }
 
@@ -489,7 +601,9 @@ void KCtree::print(			// print entire tree
 // DistGlobals - globals used in computing distortions
 // 	To prevent long argument lists in the computation of
 // 	distortions, we store a number of common global variables here.
-// 	These are initialized in KCtree::getNeighbors.
+// 	These are initialized in KCtree::getNeighbors and
+// 	KCtree::getAssignments, after the basic globals.  Like the basic
+// 	globals they are private to each thread.
 //
 // 	Note: kcDim and kcPoints (from Basic Globals) are used as well.
 //----------------------------------------------------------------------
@@ -497,10 +611,12 @@ void KCtree::print(			// print entire tree
 int		kcKCtrs;		// number of centers
 int*		kcWeights;		// weights of each point
 KMpointArray	kcCenters;		// the center points
-KMpointArray	kcSums;			// sums
+KMsumArray	kcSums;			// sums
 double*		kcSumSqs;		// sum of squares
 double*		kcDists;		// distortions
 KMpoint		kcBoxMidpt;		// bounding-box midpoint
+#pragma omp threadprivate(kcKCtrs, kcWeights, kcCenters, kcSums)
+#pragma omp threadprivate(kcSumSqs, kcDists, kcBoxMidpt)
 
 //----------------------------------------------------------------------
 //  initDistGlobals - initialize distortion globals
@@ -509,7 +625,7 @@ KMpoint		kcBoxMidpt;		// bounding-box midpoint
 static void initDistGlobals(		// initialize distortion globals
     KMfilterCenters& ctrs)			// the centers
 {
-    initBasicGlobals(ctrs.getDim(), ctrs.getNPts(), ctrs.getDataPts());
+    assert(ctrs.getDim() == kcDim);		// basic globals already set
     kcKCtrs	= ctrs.getK();
     kcCenters	= ctrs.getCtrPts();		// get ptrs to KMcenter arrays
     kcWeights	= ctrs.getWeights(false);
@@ -564,7 +680,8 @@ static void deleteDistGlobals()		// delete distortion globals
 void KCtree::getNeighbors(		// compute neighbors for centers
     KMfilterCenters& ctrs)			// the centers
 {
-    initDistGlobals(ctrs);			// initialize globals
+    initBasicGlobals(dim, n_pts, pts);		// initialize globals
+    initDistGlobals(ctrs);
     int *candIdx = new int[kcKCtrs];		// allocate center indices
     for (int j = 0; j < kcKCtrs; j++) {		// initialize everything
     	candIdx[j] = j;				// initialize indices
@@ -649,7 +766,8 @@ void KCtree::getAssignments(		// compute assignments for points
     KMctrIdxArray 	closeCtr,		// closest center per point
     double*	 	sqDist)			// sq'd distance to center
 {
-    initDistGlobals(ctrs);			// initialize globals
+    initBasicGlobals(dim, n_pts, pts);		// initialize globals
+    initDistGlobals(ctrs);
 
     int *candIdx = new int[kcKCtrs];		// allocate center indices
     for (int j = 0; j < kcKCtrs; j++) {		// initialize everything
@@ -814,9 +932,10 @@ static bool pruneTest(
 //	only if tracing.
 //----------------------------------------------------------------------
 
+template <typename Coord>
 static void postNeigh(
     KCptr		p,			// the node posting
-    KMpoint		sum,			// the sum of coordinates
+    const Coord		*sum,			// the sum of coordinates
     double		sumSq,			// the sum of squares
     int			n_data,			// number of points
     KMctrIdx		ctrIdx)			// center index
@@ -23,9 +23,23 @@
 
 #include "KMeans.h"				// all k-means includes
 #include "KCutil.h"				// kc-tree utilities
+#include <vector>				// subtrees for the threads
 
 class KMfilterCenters;				// see KMfilterCenters.h
 
+//----------------------------------------------------------------------
+//  Parallel construction
+//	The top of the tree is split on one thread, until the nodes are
+//	at depth KC_PAR_DEPTH or hold fewer than KC_PAR_MIN_PTS points.
+//	The subtrees below these nodes are built and summed on all
+//	threads (with OpenMP), and the sums of the top nodes are then
+//	computed from their children.  The splits do not depend on the
+//	order in which the subtrees are built, so the tree is the same as
+//	the one built on a single thread.
+//----------------------------------------------------------------------
+const int KC_PAR_DEPTH = 8;			// max depth of the top splits
+const int KC_PAR_MIN_PTS = 4096;		// min points of a top split
+
 //----------------------------------------------------------------------
 //  kc-tree - the k-center tree.
 //	This is a stripped-down modification of the kd-tree of the ANN
@@ -51,6 +65,8 @@ class KMfilterCenters;				// see KMfilterCenters.h
 //	computes the candidates for each node in the tree.
 //----------------------------------------------------------------------
 class KCnode;
+class KCsplit;
+struct KCsubtree;
 typedef KCnode	*KCptr;			// pointer to kc-node
 
 class KCtree {
@@ -85,6 +101,19 @@ protected:
 	int		dim,		// dimension of space
 	KMorthRect	&bnd_box);	// bounding box for current node
 
+    void buildKcTreeTop(		// split the top of the kc-tree
+	KMdataArray	pa,		// point array
+	KMdatIdxArray	pidx,		// point indices to store in subtree
+	int		n,		// number of points
+	int		dim,		// dimension of space
+	KMorthRect	&bnd_box,	// bounding box for current node
+	int		depth,		// remaining depth of top splits
+	KCptr		&node,		// the node (returned)
+	vector<KCsubtree> &subtrees,	// subtrees to build (returned)
+	vector<KCsplit*> &top);		// top nodes in postorder (returned)
+
+    void sumTopNode(KCsplit *p);	// sums of a node from its children
+
 public:
     KCtree(				// build from point array
 	KMdataArray	pa,			// point array
@@ -137,7 +166,7 @@ class KCnode {			// generic kc-tree node
 protected:
     const int		multCand;	// multiple candidate flag
     int			n_data;		// number of data points
-    KMpoint		sum;		// sum of points
+    KMsumPoint		sum;		// sum of points
     double		sumSq;		// sum of squares
     KMorthRect		bnd_box;	// bounding box for cell
 public:
@@ -145,7 +174,7 @@ public:
 	int		dim,		// dimension
 	KMorthRect	&bb)		// bounding box
 	: multCand(-1), bnd_box(dim, bb)// create bounding box
-    {  sum = kmAllocPt(dim, 0); sumSq = 0; }
+    {  sum = kmAllocSum(dim); sumSq = 0; }
     	
     virtual ~KCnode();		// destructor
 
@@ -156,7 +185,7 @@ public:
 
     virtual void makeSums(		// compute sums of points
 	int		&n,			// number of points (returned)
-	KMpoint		&theSum,		// sum (returned)
+	KMsumPoint	&theSum,		// sum (returned)
 	double		&theSumSq) = 0;		// sum of squares (returned)
 
     virtual void getNeighbors(		// compute neighbors for centers
@@ -208,7 +237,7 @@ public:
 
     virtual void makeSums(		// compute sums
 	int		&n,			// number of points (returned)
-	KMpoint		&theSum,		// sum (returned)
+	KMsumPoint	&theSum,		// sum (returned)
 	double		&theSumSq);		// sum of squares (returned)
 
     virtual void getNeighbors(		// compute neighbors for centers
@@ -273,7 +302,7 @@ public:
 
     virtual void makeSums(	// compute sums
 	int		&n,			// number of points (returned)
-	KMpoint		&theSum,		// sum (returned)
+	KMsumPoint	&theSum,		// sum (returned)
 	double		&theSumSq);		// sum of squares (returned)
 
     virtual void getNeighbors(		// compute neighbors for centers
@@ -291,6 +320,8 @@ public:
 
 					// print node
     virtual void print(int level);
+
+    friend class KCtree;			// allow kc-tree to access us
 };
 
 //----------------------------------------------------------------------
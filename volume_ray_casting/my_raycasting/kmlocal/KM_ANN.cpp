@@ -38,8 +38,8 @@ KMdist kmDist(			// interpoint squared distance
     KMpoint		q)
 {
     register int d;
-    register KMcoord diff;
-    register KMcoord dist;
+    register KMdist diff;
+    register KMdist dist;
 
     dist = 0;
     for (d = 0; d < dim; d++) {
@@ -95,6 +95,37 @@ void kmDeallocPts(KMpointArray &pa)	// deallocate points
     delete [] pa;				// dealloc points
     pa = NULL;
 }
+
+KMsumPoint kmAllocSum(int dim)		// allocate a sum
+{
+    KMsumPoint s = new KMsum[dim];
+    for (int i = 0; i < dim; i++) s[i] = 0;
+    return s;
+}
+
+void kmDeallocSum(KMsumPoint &s)	// deallocate one sum
+{
+    delete [] s;
+    s = NULL;
+}
+
+KMsumArray kmAllocSums(int n, int dim)	// allocate n sums in dim
+{
+    KMsumArray sa = new KMsumPoint[n];		// allocate sums
+    KMsumPoint s  = new KMsum[n*dim];		// allocate space for coords
+    for (int i = 0; i < n*dim; i++) s[i] = 0;
+    for (int i = 0; i < n; i++) {
+	sa[i] = &(s[i*dim]);
+    }
+    return sa;
+}
+
+void kmDeallocSums(KMsumArray &sa)	// deallocate sums
+{
+    delete [] sa[0];				// dealloc coordinate storage
+    delete [] sa;				// dealloc sums
+    sa = NULL;
+}
    
 //----------------------------------------------------------------------
 //  Point and other type copying:
@@ -144,6 +175,29 @@ KMpointArray kmAllocCopyPts(		// allocate and copy point array
     return dest;
 }
 
+void kmCopySums(			// copy sums w/o allocation
+    int			n,			// number of sums
+    int			dim,			// dimension
+    const KMsumArray	source,			// source sums
+    KMsumArray		dest)			// destination sums
+{
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < dim; i++) {
+	    dest[j][i] = source[j][i];
+	}
+    }
+}
+
+KMsumArray kmAllocCopySums(		// allocate and copy sums
+    int			n,			// number of sums
+    int			dim,			// dimension
+    const KMsumArray	source)			// source sums
+{
+    KMsumArray dest = kmAllocSums(n, dim);
+    kmCopySums(n, dim, source, dest);
+    return dest;
+}
+
 //----------------------------------------------------------------------
 //  Methods for orthogonal rectangles:
 //	kmAssignRect() assigns the coordinates of one rectangle to
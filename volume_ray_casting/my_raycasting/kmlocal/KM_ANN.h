@@ -84,6 +84,15 @@
 //	Then KMcoordPrec = KMcoordBits/(log_2 10) where log_2 10
 //	is the base 2 logarithm of 10.
 //
+//	Defining KM_FLOAT_COORD makes KMcoord a float (KMdist and KMsum
+//	stay double).  This halves the memory of the points and the
+//	centers, and allows KMdata to use an existing array of single
+//	precision points without a copy.
+//
+//	KMsum is the type of the sums of coordinates kept in the kc-tree
+//	nodes and the centers.  A sum over many points needs more digits
+//	than the points themselves.
+//
 //	KMidx is a point index.  When the data structure is built,
 //	the points are given as an array.  Nearest neighbor results are
 //	returned as an index into this array.  To make it clearer when
@@ -91,14 +100,21 @@
 //		
 //----------------------------------------------------------------------
 
+#ifdef KM_FLOAT_COORD
+typedef	float	KMcoord;		// coordinate data type
+#else
 typedef	double	KMcoord;		// coordinate data type
+#endif
 typedef	double	KMdist;			// distance data type
+typedef	double	KMsum;			// sum of coordinates data type
 typedef int	KMidx;			// point index
 
 					// largest possible distance
 const KMdist	KM_DIST_INF	=  DBL_MAX;
 
-#ifdef DSIGNIF				// number of sig. digits in KMcoord
+#if defined(KM_FLOAT_COORD)		// number of sig. digits in KMcoord
+    const int	 KMcoordPrec	= FLT_DIG;
+#elif defined(DSIGNIF)
     const int	 KMcoordPrec	= DBL_DIG;
 #else
     const int	 KMcoordPrec	= 15;	// default precision
@@ -224,6 +240,8 @@ const KMdist	KM_DIST_INF	=  DBL_MAX;
 
 typedef KMcoord		*KMpoint;		// a point
 typedef KMpoint 	*KMpointArray;		// an array of points 
+typedef KMsum		*KMsumPoint;		// a sum of points
+typedef KMsumPoint	*KMsumArray;		// an array of sums of points
 typedef KMdist  	*KMdistArray;		// an array of distances 
 typedef KMidx		*KMidxArray;		// an array of point indices
 
@@ -259,6 +277,11 @@ typedef KMidx		*KMidxArray;		// an array of point indices
 //
 // 	kmDeallocPts(pa)
 //	  Deallocates points allocated by kmAllocPts().
+//
+//	kmAllocSum(dim), kmDeallocSum(s), kmAllocSums(n, dim),
+//	kmDeallocSums(sa)
+//	  The same for sums of points.  kmAllocSums() sets the sums
+//	  to 0.
 //----------------------------------------------------------------------
    
 KMdist kmDist(				// compute squared distance
@@ -285,6 +308,19 @@ KMpointArray kmAllocPts(		// allocate point array
 void kmDeallocPts(			// deallocate a point array
     KMpointArray	&pa);			// the array
 
+KMsumPoint kmAllocSum(			// allocate a sum set to 0
+    int			dim);			// dimension
+
+void kmDeallocSum(			// deallocate a sum
+    KMsumPoint		&s);
+
+KMsumArray kmAllocSums(			// allocate sums set to 0
+    int			n,			// number of sums
+    int			dim);			// dimension
+
+void kmDeallocSums(			// deallocate an array of sums
+    KMsumArray		&sa);			// the array
+
 //----------------------------------------------------------------------
 //  Point and other type copying:
 //
@@ -300,6 +336,10 @@ void kmDeallocPts(			// deallocate a point array
 //	dest = kmAllocCopyPts(n, dim, source)
 //	  Allocates storage for and copies a point array source to dest.
 //
+//	kmCopySums(n, dim, source, dest)
+//	dest = kmAllocCopySums(n, dim, source)
+//	  The same for arrays of sums.
+//
 //	kmCopy(n, source, dest)
 //	  A generic copy routine for any time for which "=" is defined.
 //
@@ -328,6 +368,17 @@ KMpointArray kmAllocCopyPts(		// allocate and copy point array
     int			dim,			// dimension
     const KMpointArray	source);		// source point
 
+void kmCopySums(			// copy sums w/o allocation
+    int			n,			// number of sums
+    int			dim,			// dimension
+    const KMsumArray	source,			// source sums
+    KMsumArray		dest);			// destination sums
+
+KMsumArray kmAllocCopySums(		// allocate and copy sums
+    int			n,			// number of sums
+    int			dim,			// dimension
+    const KMsumArray	source);		// source sums
+
 template <typename Object>
 void kmCopy(				// copy anything without allocation
     int			n,			// number of object
@@ -24,14 +24,35 @@
 					// standard constructor
 KMdata::KMdata(int d, int n) : dim(d), maxPts(n), nPts(n) {
     pts = kmAllocPts(n, d);
+    ownCoords = true;
+    kcTree = NULL;
+}
+
+					// points in an external array
+KMdata::KMdata(int d, int n, KMcoord *coords) : dim(d), maxPts(n), nPts(n) {
+    pts = new KMpoint[n];			// only the point pointers
+    for (int i = 0; i < n; i++) {
+	pts[i] = &(coords[i*d]);
+    }
+    ownCoords = false;
     kcTree = NULL;
 }
 
 KMdata::~KMdata() {			// destructor
-    kmDeallocPts(pts);				// deallocate point array
+    deallocPts();				// deallocate point array
     delete kcTree;				// deallocate kc-tree
 }
 
+void KMdata::deallocPts() {		// deallocate the points
+    if (ownCoords) {
+	kmDeallocPts(pts);			// coordinates and pointers
+    }
+    else {
+	delete [] pts;				// just the pointers
+	pts = NULL;
+    }
+}
+
 void KMdata::buildKcTree() {		// build kc-tree for points
     if (kcTree != NULL) delete kcTree;		// destroy existing tree
     kcTree = new KCtree(pts, nPts, dim);	// construct the tree
@@ -41,8 +62,9 @@ void KMdata::resize(int d, int n) {	// resize point array
     if (d != dim || n != nPts) {		// size change?
 	dim = d;
 	nPts = n;
-	kmDeallocPts(pts);			// deallocate old points
+	deallocPts();				// deallocate old points
 	pts = kmAllocPts(nPts, dim);
+	ownCoords = true;
     }
     if (kcTree != NULL) {			// kc-tree exists?
 	delete kcTree;				// deallocate kc-tree
@@ -44,6 +44,12 @@
 // 	assignments.  If you want to resuse the structure, the only way
 // 	to do so is to first apply resize(), which destroys the kc-tree
 // 	(if it exists), and then assign to it a new set of points.
+//
+// 	The points may also live in an externally owned array of n*d
+// 	coordinates (point i at coords[i*d]).  Only the array of point
+// 	pointers is allocated then, and the coordinates are neither
+// 	copied nor deallocated.  A later resize() allocates its own
+// 	storage.
 //----------------------------------------------------------------------
 
 class KMdata {
@@ -52,7 +58,9 @@ private:
     int			maxPts;		// max number of points
     int			nPts;		// number of data points
     KMdataArray		pts;		// the data points
+    bool		ownCoords;	// are the coordinates ours?
     KCtree*		kcTree;		// kc-tree for the points
+    void deallocPts();			// deallocate the points
 private:				// copy functions (not implemented)
     KMdata(const KMdata& p)		// copy constructor
       { assert(false); }
@@ -60,6 +68,8 @@ private:				// copy functions (not implemented)
       { assert(false);  return *this; }
 public:
     KMdata(int d, int n);		// standard constructor
+    KMdata(int d, int n,		// points in an external array
+	KMcoord		*coords);		// n*d coordinates (not copied)
 
     int getDim() const {		// get dimension
 	return dim;
@@ -53,6 +53,19 @@ void kmPrintPt(				// print a point
     if (fancy) *kmOut << " ]";
 }
 
+void kmPrintSum(			// print a sum of points
+    KMsumPoint		s,			// the sum
+    int			dim,			// the dimension
+    bool		fancy)			// print plain or fancy?
+{
+    if (fancy) *kmOut << "[ ";
+    for (int i = 0; i < dim; i++) {
+	*kmOut << setw(8) << s[i];
+	if (i < dim-1) *kmOut << " ";
+    }
+    if (fancy) *kmOut << " ]";
+}
+
 void kmPrintPts(			// print points
     string		title,			// name of point set
     KMpointArray	pa,			// the point array
@@ -125,6 +125,11 @@ void kmPrintPt(				// print a point
     int			dim,			// the dimension
     bool		fancy = true);		// print plain or fancy?
 
+void kmPrintSum(			// print a sum of points
+    KMsumPoint		s,			// the sum
+    int			dim,			// the dimension
+    bool		fancy = true);		// print plain or fancy?
+
 void kmPrintPts(			// print points
     string		title,			// name of point set
     KMpointArray	pa,			// the point array
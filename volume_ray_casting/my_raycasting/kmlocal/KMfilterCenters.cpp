@@ -28,7 +28,7 @@ KMfilterCenters::KMfilterCenters(int k, KMdata& p, double df)
       kmError("Building kc-tree", KMwarn);
       p.buildKcTree();			// build it now
     }
-    sums	= kmAllocPts(kCtrs, getDim());
+    sums	= kmAllocSums(kCtrs, getDim());
     sumSqs	= new double[kCtrs];
     weights	= new int[kCtrs];
     dists	= new double[kCtrs];
@@ -39,7 +39,7 @@ KMfilterCenters::KMfilterCenters(int k, KMdata& p, double df)
 					// copy constructor
 KMfilterCenters::KMfilterCenters(const KMfilterCenters& s)
 	: KMcenters(s) {
-    sums	= kmAllocCopyPts(kCtrs, getDim(), s.sums);
+    sums	= kmAllocCopySums(kCtrs, getDim(), s.sums);
     sumSqs	= kmAllocCopy(kCtrs, s.sumSqs);
     weights	= kmAllocCopy(kCtrs, s.weights);
     dists	= kmAllocCopy(kCtrs, s.dists);
@@ -52,12 +52,12 @@ KMfilterCenters& KMfilterCenters::operator=(const KMfilterCenters& s) {
     if (this != &s) {			// avoid self copy (x=x)
 					// different sizes?
 	if (kCtrs != s.kCtrs || getDim() != s.getDim()) {
-	    kmDeallocPts(sums);		// deallocate old storage
+	    kmDeallocSums(sums);		// deallocate old storage
 	    delete [] sumSqs;
 	    delete [] weights;
 	    delete [] dists;
 	    				// allocate new storage
-	    sums    = kmAllocPts(s.kCtrs, s.getDim());
+	    sums    = kmAllocSums(s.kCtrs, s.getDim());
 	    sumSqs  = new double[s.kCtrs];
 	    weights = new int[s.kCtrs];
 	    dists   = new double[s.kCtrs];
@@ -65,7 +65,7 @@ KMfilterCenters& KMfilterCenters::operator=(const KMfilterCenters& s) {
 	KMcenters& base = *this;	
 	base.operator=(s);		// copy base class
 					// copy array contents
-	kmCopyPts(kCtrs, getDim(), s.sums, sums);
+	kmCopySums(kCtrs, getDim(), s.sums, sums);
 	kmCopy(kCtrs, s.sumSqs, sumSqs);
 	kmCopy(kCtrs, s.weights, weights);
 	kmCopy(kCtrs, s.dists, dists);
@@ -77,7 +77,7 @@ KMfilterCenters& KMfilterCenters::operator=(const KMfilterCenters& s) {
 }
     					// virtual destructor
 KMfilterCenters::~KMfilterCenters() {
-    kmDeallocPts(sums);
+    kmDeallocSums(sums);
     delete [] sumSqs;
     delete [] weights;
 	delete [] dists;
@@ -179,8 +179,8 @@ void KMfilterCenters::moveToCentroid()	// move center to cluster centroid
 	int wgt = weights[j];			// weight of this center
 	if (wgt > 0) {				// update only if weight > 0
 	    for (int d = 0; d < getDim(); d++) {
-    		ctrs[j][d] = (1 - dampFactor) * ctrs[j][d] +
-				dampFactor * sums[j][d]/wgt;
+    		ctrs[j][d] = (KMcoord) ((1 - dampFactor) * ctrs[j][d] +
+				dampFactor * sums[j][d]/wgt);
 	    }
 	}
     }
@@ -223,6 +223,46 @@ void KMfilterCenters::swapOneCenter(		// swap one center
     invalidate();				// distortions now invalid
 }
 
+//----------------------------------------------------------------------
+//  swapBestCenter
+//	Tries nCands swaps of one center point with a sample point and
+//	keeps the swap of lowest distortion.  The swaps are sampled one
+//	after the other by swapOneCenter() on copies of the centers.
+//	Their distortions are then computed in parallel, each thread
+//	traversing the shared kc-tree, which is only read.  The lowest
+//	index wins ties, so the result does not depend on the number of
+//	threads.  The distortions of the kept swap remain valid.
+//----------------------------------------------------------------------
+
+void KMfilterCenters::swapBestCenter(	// swap best of several centers
+    int nCands)					// number of candidate swaps
+{
+    KMfilterCenters** cands = new KMfilterCenters*[nCands];
+    double* candDists = new double[nCands];
+    int c;
+    for (c = 0; c < nCands; c++) {		// sample the swaps
+	cands[c] = new KMfilterCenters(*this);
+	cands[c]->swapOneCenter();
+    }
+#pragma omp parallel for schedule(dynamic)
+    for (c = 0; c < nCands; c++) {		// compute their distortions
+	candDists[c] = cands[c]->getDist();
+    }
+    int bestC = 0;				// candidate of least distortion
+    for (c = 1; c < nCands; c++) {
+	if (candDists[c] < candDists[bestC]) bestC = c;
+    }
+    *this = *cands[bestC];			// keep the best swap
+    if (kmStatLev >= STEP) {			// output choice
+        *kmOut << "\tkeeping swap " << bestC << " of " << nCands << "\n";
+    }
+    for (c = 0; c < nCands; c++) {
+	delete cands[c];
+    }
+    delete [] cands;
+    delete [] candDists;
+}
+
 //----------------------------------------------------------------------
 //  print centers and distortions
 //----------------------------------------------------------------------
@@ -42,6 +42,9 @@
 //		associated neighborhoods.
 //	getAssignments()
 //		Computes the assignment of points to the closest center.
+//	swap1Stage()
+//		Swaps a center with a sample point.  Given a number of
+//		candidate swaps, it keeps the one of lowest distortion.
 //
 //	These functions are not computed independently.  In particular,
 //	for a given set of centers, they can each be computed very
@@ -104,7 +107,7 @@
 
 class KMfilterCenters : public KMcenters{
 protected:			// intermediates
-    KMpointArray	sums;		// vector sum of points
+    KMsumArray		sums;		// vector sum of points
     double*		sumSqs;		// sum of squares
     int*		weights;	// the weight of each center
 protected:			// distortion data
@@ -117,6 +120,8 @@ protected:			// local utilities
     void moveToCentroid();		// move centers to cluster centroids
     					// swap one center
     void swapOneCenter(bool allowDuplicate = true);
+    					// swap best of several
+    void swapBestCenter(int nCands);
     void validate()			// make valid
       { valid = true; }
     void invalidate() {			// make invalid
@@ -135,7 +140,7 @@ public:
 
 public:					// public accessors
     					// returns sums
-    KMpointArray getSums(bool autoUpdate = true) {
+    KMsumArray getSums(bool autoUpdate = true) {
 	if (autoUpdate && !valid) computeDistortion();
 	return sums;
     }
@@ -176,8 +181,10 @@ public:					// public accessors
     void lloyd1Stage() {		// one stage of LLoyd's algorithm
 	moveToCentroid();
     }
-    void swap1Stage() {			// one stage of swap heuristic
-	swapOneCenter();
+    void swap1Stage(			// one stage of swap heuristic
+	int nCands = 1) {			// number of candidate swaps
+	if (nCands > 1) swapBestCenter(nCands);
+	else swapOneCenter();
     }
     virtual void print(			// print centers
         bool fancy = true);
@@ -39,7 +39,7 @@ KMfilterCenters KMlocal::execute()		// execute the algorithm
 		curr.lloyd1Stage();
 		break;
 	    case SWAP:				// swap heuristic
-		curr.swap1Stage();
+		curr.swap1Stage(swapCands);
 		break;
 	    case RANDOM:			// get random centers
 		curr.genRandom();
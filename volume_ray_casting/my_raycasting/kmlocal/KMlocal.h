@@ -99,6 +99,15 @@ typedef KMlocal* KMlocalPtr;			// generic algorithm pointer
 //	--------------------
 //	maxTotStage
 //		Maximum number of stages total.
+//
+//	Parallel Swaps
+//	--------------
+//	By default a swap stage makes one random swap.  After a call to
+//	setSwapCands(c), each swap stage samples c swaps, computes their
+//	distortions in parallel, and applies the swap of lowest
+//	distortion (see KMfilterCenters::swapBestCenter).  The run
+//	and acceptance logic is unchanged.  For the swap based methods
+//	a good choice of c is the number of threads.
 //------------------------------------------------------------------------
 
 class KMlocal {				// generic local search
@@ -109,6 +118,7 @@ protected:
     int			dim;			// dimension
     KMterm		term;			// termination conditions
     int			maxTotStage;		// max total stages (from term)
+    int			swapCands;		// candidate swaps per stage
 					// varying quantities
     int			stageNo;		// current stage number
     int			runInitStage;		// stage at which run started
@@ -132,6 +142,7 @@ public:
 	dim     = sol.getDim();
 	stageNo = 0;
 	maxTotStage = term.getMaxTotStage(kCtrs, nPts);
+	swapCands = 1;
     }
 
     virtual ~KMlocal() { }			// virtual destructor
@@ -141,6 +152,10 @@ public:
       return stageNo;
     }
 
+    void setSwapCands(int c) {			// set candidate swaps per stage
+      swapCands = (c < 1 ? 1 : c);
+    }
+
 protected:					// overridden by subclasses
     virtual void reset() {			// reset everything
 	stageNo = 0;
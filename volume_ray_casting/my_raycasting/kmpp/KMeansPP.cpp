@@ -41,7 +41,7 @@ static double GetSeconds() {
 // Performs one full execution of k-means, logging any relevant information, and tracking meta
 // statistics for the run. If min or max values are negative, they are treated as unset.
 // best_centers and best_assignment can be 0, in which case they are not set.
-static void RunKMeansOnce(const KmTree &tree, int n, int k, int d, Scalar *points, Scalar *centers,
+static void RunKMeansOnce(const KmTree &tree, int n, int k, int d, Scalar *centers,
                           Scalar *min_cost, Scalar *max_cost, Scalar *total_cost,
                           double start_time, double *min_time, double *max_time,
                           double *total_time, Scalar *best_centers, int *best_assignment) {
@@ -127,7 +127,7 @@ Scalar RunKMeans(int n, int k, int d, Scalar *points, int attempts,
     }
     
     // Run k-means
-    RunKMeansOnce(tree, n, k, d, points, centers, &min_cost, &max_cost, &total_cost, start_time,
+    RunKMeansOnce(tree, n, k, d, centers, &min_cost, &max_cost, &total_cost, start_time,
                   &min_time, &max_time, &total_time, ret_centers, ret_assignment);
   }
   LogMetaStats(min_cost, max_cost, total_cost, min_time, max_time, total_time, attempts);
@@ -147,6 +147,14 @@ Scalar RunKMeansPlusPlus(int n, int k, int d, Scalar *points, int attempts,
   LOG(false, "Running k-means++..." << endl);
   KmTree tree(n, d, points);
   LOG(false, "Done preprocessing..." << endl);
+  return RunKMeansPlusPlus(tree, k, attempts, ret_centers, ret_assignment);
+}
+
+// See KMeans.h
+Scalar RunKMeansPlusPlus(const KmTree &tree, int k, int attempts, Scalar *ret_centers,
+                         int *ret_assignment) {
+  KM_ASSERT(k >= 1);
+  int n = tree.GetNumPoints(), d = tree.GetDimension();
 
   // Initialization
   Scalar *centers = (Scalar*)malloc(sizeof(Scalar)*k*d);
@@ -162,7 +170,7 @@ Scalar RunKMeansPlusPlus(int n, int k, int d, Scalar *points, int attempts,
     tree.SeedKMeansPlusPlus(k, centers);
     
     // Run k-means
-    RunKMeansOnce(tree, n, k, d, points, centers, &min_cost, &max_cost, &total_cost, start_time,
+    RunKMeansOnce(tree, n, k, d, centers, &min_cost, &max_cost, &total_cost, start_time,
                   &min_time, &max_time, &total_time, ret_centers, ret_assignment);
   }
   LogMetaStats(min_cost, max_cost, total_cost, min_time, max_time, total_time, attempts);
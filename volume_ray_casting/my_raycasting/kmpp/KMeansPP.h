@@ -12,6 +12,8 @@
 #include "KmUtils.h"
 #include <iostream>
 
+class KmTree;
+
 // Sets preferences for how much logging is done and where it is outputted, when k-means is run.
 void ClearKMeansLogging();
 void AddKMeansLogging(std::ostream *out, bool verbose);
@@ -38,4 +40,9 @@ Scalar RunKMeans(int n, int k, int d, Scalar *points, int attempts,
 Scalar RunKMeansPlusPlus(int n, int k, int d, Scalar *points, int attempts,
                          Scalar *centers, int *assignments);
 
+// Runs k-means++ on a tree that was already built over the data set, so the same tree can be
+// reused for several values of k and several rounds of attempts. See RunKMeans for the parameters.
+Scalar RunKMeansPlusPlus(const KmTree &tree, int k, int attempts, Scalar *centers,
+                         int *assignments);
+
 #endif
@@ -8,37 +8,36 @@
 #include <stdlib.h>
 using namespace std;
 
-KmTree::KmTree(int n, int d, Scalar *points): n_(n), d_(d), points_(points) {
+KmTree::KmTree(int n, int d, Scalar *points): n_(n), d_(d), points_(points), float_points_(0) {
+  Initialize();
+}
+
+KmTree::KmTree(int n, int d, const float *points): n_(n), d_(d), points_(0), float_points_(points) {
+  Initialize();
+}
+
+void KmTree::Initialize() {
   // Initialize memory
   int node_size = sizeof(Node) + d_ * 3 * sizeof(Scalar);
-  node_data_ = (char*)malloc((2*n-1) * node_size);
-  point_indices_ = (int*)malloc(n * sizeof(int));
-  for (int i = 0; i < n; i++)
+  node_data_ = (char*)malloc((2*n_-1) * node_size);
+  point_indices_ = (int*)malloc(n_ * sizeof(int));
+  for (int i = 0; i < n_; i++)
     point_indices_[i] = i;
   KM_ASSERT(node_data_ != 0 && point_indices_ != 0);
 
-  // Calculate the bounding box for the points
-  Scalar *bound_v1 = PointAllocate(d_);
-  Scalar *bound_v2 = PointAllocate(d_);
-  KM_ASSERT(bound_v1 != 0 && bound_v2 != 0);
-  PointCopy(bound_v1, points, d_);
-  PointCopy(bound_v2, points, d_);
-  for (int i = 1; i < n; i++)
-  for (int j = 0; j < d; j++) {
-    if (bound_v1[j] > points[i*d_ + j]) bound_v1[j] = points[i*d_ + j];
-    if (bound_v2[j] < points[i*d_ + j]) bound_v1[j] = points[i*d_ + j];
-  }
-
   // Build the tree
   char *temp_node_data = node_data_;
-  top_node_ = BuildNodes(points, 0, n-1, &temp_node_data);
+  top_node_ = BuildNodes(0, n_-1, &temp_node_data);
 
-  // Cleanup
-  PointFree(bound_v1);
-  PointFree(bound_v2);
+  // Split it into subtrees for the threads
+  subtrees_ = (const Node**)malloc((1 << kSubtreeDepth) * sizeof(Node*));
+  KM_ASSERT(subtrees_ != 0);
+  num_subtrees_ = 0;
+  CollectSubtrees(top_node_, 0);
 }
 
 KmTree::~KmTree() {
+  free(subtrees_);
   free(point_indices_);
   free(node_data_);
 }
@@ -59,9 +58,31 @@ Scalar KmTree::DoKMeansStep(int k, Scalar *centers, int *assignment) const {
   if (memcmp(centers + i*d_, bad_center, d_ * sizeof(Scalar)) != 0)
     candidates[num_candidates++] = i;
 
-  // Find nodes
-  Scalar result = DoKMeansStepAtNode(top_node_, num_candidates, candidates, centers, sums,
-                                     counts, assignment);
+  // Find nodes, each subtree with its own sums and counts
+  Scalar *subtree_sums = (Scalar*)calloc(num_subtrees_ * k * d_, sizeof(Scalar));
+  int *subtree_counts = (int*)calloc(num_subtrees_ * k, sizeof(int));
+  Scalar *subtree_costs = (Scalar*)malloc(num_subtrees_ * sizeof(Scalar));
+  KM_ASSERT(subtree_sums != 0 && subtree_counts != 0 && subtree_costs != 0);
+  int s;
+#pragma omp parallel for schedule(dynamic)
+  for (s = 0; s < num_subtrees_; s++) {
+    subtree_costs[s] = DoKMeansStepAtNode(subtrees_[s], num_candidates, candidates, centers,
+                                          subtree_sums + s*k*d_, subtree_counts + s*k,
+                                          assignment);
+  }
+
+  // Combine the subtrees in order
+  Scalar result = 0;
+  for (s = 0; s < num_subtrees_; s++) {
+    result += subtree_costs[s];
+    for (int i = 0; i < k; i++) {
+      PointAdd(sums + i*d_, subtree_sums + (s*k + i)*d_, d_);
+      counts[i] += subtree_counts[s*k + i];
+    }
+  }
+  free(subtree_costs);
+  free(subtree_counts);
+  free(subtree_sums);
 
   // Set the new centers
   for (int i = 0; i < k; i++) {
@@ -84,9 +105,18 @@ Scalar KmTree::DoKMeansStep(int k, Scalar *centers, int *assignment) const {
 // Helper functions for constructor
 // ================================
 
+// Lists the nodes at depth kSubtreeDepth and the leaves above it from left to right
+void KmTree::CollectSubtrees(const Node *node, int depth) {
+  if (depth == kSubtreeDepth || node->lower_node == 0) {
+    subtrees_[num_subtrees_++] = node;
+    return;
+  }
+  CollectSubtrees(node->lower_node, depth + 1);
+  CollectSubtrees(node->upper_node, depth + 1);
+}
+
 // Build a kd tree from the given set of points
-KmTree::Node *KmTree::BuildNodes(Scalar *points, int first_index, int last_index,
-                                 char **next_node_data) {
+KmTree::Node *KmTree::BuildNodes(int first_index, int last_index, char **next_node_data) {
   // Allocate the node
   Node *node = (Node*)(*next_node_data);
   (*next_node_data) += sizeof(Node);
@@ -102,15 +132,15 @@ KmTree::Node *KmTree::BuildNodes(Scalar *points, int first_index, int last_index
   node->first_point_index = first_index;
 
   // Calculate the bounding box
-  Scalar *first_point = points + point_indices_[first_index] * d_;
+  int first_point = point_indices_[first_index];
   Scalar *bound_p1 = PointAllocate(d_);
   Scalar *bound_p2 = PointAllocate(d_);
   KM_ASSERT(bound_p1 != 0 && bound_p2 != 0);
-  PointCopy(bound_p1, first_point, d_);
-  PointCopy(bound_p2, first_point, d_);
+  CopyPoint(bound_p1, first_point);
+  CopyPoint(bound_p2, first_point);
   for (int i = first_index+1; i <= last_index; i++)
   for (int j = 0; j < d_; j++) {
-    Scalar c = points[point_indices_[i]*d_ + j];
+    Scalar c = GetCoordinate(point_indices_[i], j);
     if (bound_p1[j] > c) bound_p1[j] = c;
     if (bound_p2[j] < c) bound_p2[j] = c;
   }
@@ -132,7 +162,7 @@ KmTree::Node *KmTree::BuildNodes(Scalar *points, int first_index, int last_index
   // If the max spread is 0, make this a leaf node
   if (max_radius == 0) {
     node->lower_node = node->upper_node = 0;
-    PointCopy(node->sum, first_point, d_);
+    CopyPoint(node->sum, first_point);
     if (last_index != first_index)
       PointScale(node->sum, Scalar(last_index - first_index + 1), d_);
     node->opt_cost = 0;
@@ -145,8 +175,8 @@ KmTree::Node *KmTree::BuildNodes(Scalar *points, int first_index, int last_index
   Scalar split_pos = node->median[split_d];
   int i1 = first_index, i2 = last_index, size1 = 0;
   while (i1 <= i2) {
-    bool is_i1_good = (points[point_indices_[i1]*d_ + split_d] < split_pos);
-    bool is_i2_good = (points[point_indices_[i2]*d_ + split_d] >= split_pos);
+    bool is_i1_good = (GetCoordinate(point_indices_[i1], split_d) < split_pos);
+    bool is_i2_good = (GetCoordinate(point_indices_[i2], split_d) >= split_pos);
     if (!is_i1_good && !is_i2_good) {
       int temp = point_indices_[i1];
       point_indices_[i1] = point_indices_[i2];
@@ -164,8 +194,8 @@ KmTree::Node *KmTree::BuildNodes(Scalar *points, int first_index, int last_index
 
   // Create the child nodes
   KM_ASSERT(size1 >= 1 && size1 <= last_index - first_index);
-  node->lower_node = BuildNodes(points, first_index, first_index + size1 - 1, next_node_data);
-  node->upper_node = BuildNodes(points, first_index + size1, last_index, next_node_data);
+  node->lower_node = BuildNodes(first_index, first_index + size1 - 1, next_node_data);
+  node->upper_node = BuildNodes(first_index + size1, last_index, next_node_data);
 
   // Calculate the new sum and opt cost
   PointCopy(node->sum, node->lower_node->sum, d_);
@@ -285,34 +315,65 @@ Scalar KmTree::SeedKMeansPlusPlus(int k, Scalar *centers) const {
   Scalar *dist_sq = (Scalar*)malloc(n_ * sizeof(Scalar));
   KM_ASSERT(dist_sq != 0);
 
+  // The cost of the points of each subtree. dist_sq is indexed like point_indices_, so the points
+  // of a subtree are contiguous.
+  Scalar *subtree_costs = (Scalar*)malloc(num_subtrees_ * sizeof(Scalar));
+  KM_ASSERT(subtree_costs != 0);
+  int s;
+
   // Choose an initial center uniformly at random
   SeedKmppSetClusterIndex(top_node_, 0);
   int i = GetRandom(n_);
-  memcpy(centers, points_ + point_indices_[i]*d_, d_*sizeof(Scalar));
-  Scalar total_cost = 0;
-  for (int j = 0; j < n_; j++) {
-    dist_sq[j] = PointDistSq(points_ + point_indices_[j]*d_, centers, d_);
-    total_cost += dist_sq[j];
+  CopyPoint(centers, point_indices_[i]);
+#pragma omp parallel for schedule(dynamic)
+  for (s = 0; s < num_subtrees_; s++) {
+    const Node *node = subtrees_[s];
+    Scalar cost = 0;
+    for (int j = node->first_point_index; j < node->first_point_index + node->num_points; j++) {
+      dist_sq[j] = PointDistSqTo(point_indices_[j], centers);
+      cost += dist_sq[j];
+    }
+    subtree_costs[s] = cost;
   }
+  Scalar total_cost = 0;
+  for (s = 0; s < num_subtrees_; s++)
+    total_cost += subtree_costs[s];
 
   // Repeatedly choose more centers
   for (int new_cluster = 1; new_cluster < k; new_cluster++) {
     while (1) {
+      // Find the subtree first, then the point inside it
       Scalar cutoff = (rand() / Scalar(RAND_MAX)) * total_cost;
       Scalar cur_cost = 0;
-      for (i = 0; i < n_; i++) {
+      for (s = 0; s < num_subtrees_ - 1; s++) {
+        if (cur_cost + subtree_costs[s] >= cutoff)
+          break;
+        cur_cost += subtree_costs[s];
+      }
+      int last_index = subtrees_[s]->first_point_index + subtrees_[s]->num_points;
+      for (i = subtrees_[s]->first_point_index; i < last_index; i++) {
         cur_cost += dist_sq[i];
         if (cur_cost >= cutoff)
           break;
       }
-      if (i < n_)
+      if (i < last_index)
         break;
     }
-    memcpy(centers + new_cluster*d_, points_ + point_indices_[i]*d_, d_*sizeof(Scalar));
-    total_cost = SeedKmppUpdateAssignment(top_node_, new_cluster, centers, dist_sq);
+    CopyPoint(centers + new_cluster*d_, point_indices_[i]);
+
+    // Update the subtrees on all threads, then the nodes above them
+#pragma omp parallel for schedule(dynamic)
+    for (s = 0; s < num_subtrees_; s++) {
+      subtree_costs[s] = SeedKmppUpdateAssignment(subtrees_[s], new_cluster, centers, dist_sq);
+    }
+    SeedKmppMergeClusterIndex(top_node_, 0);
+    total_cost = 0;
+    for (s = 0; s < num_subtrees_; s++)
+      total_cost += subtree_costs[s];
   }
 
   // Clean up and return
+  free(subtree_costs);
   free(dist_sq);
   return total_cost;
 }
@@ -339,7 +400,7 @@ Scalar KmTree::SeedKmppUpdateAssignment(const Node *node, int new_cluster, Scala
                        node->kmpp_cluster_index)) {
       SeedKmppSetClusterIndex(node, new_cluster);
       for (int i = node->first_point_index; i < node->first_point_index + node->num_points; i++)
-        dist_sq[i] = PointDistSq(points_ + point_indices_[i]*d_, centers + new_cluster*d_, d_);
+        dist_sq[i] = PointDistSqTo(point_indices_[i], centers + new_cluster*d_);
       return GetNodeCost(node, centers + new_cluster*d_);
     }
     
@@ -358,3 +419,18 @@ Scalar KmTree::SeedKmppUpdateAssignment(const Node *node, int new_cluster, Scala
     node->kmpp_cluster_index = -1;
   return cost;
 }
+
+// Recomputes kmpp_cluster_index for the nodes above the subtrees after the subtrees were updated.
+// Updating the subtrees separately gives the same assignment as updating from the top node: if
+// every point in a box is closer to one center than to another, so is every point in a sub-box.
+void KmTree::SeedKmppMergeClusterIndex(const Node *node, int depth) const {
+  if (depth == kSubtreeDepth || node->lower_node == 0)
+    return;
+  SeedKmppMergeClusterIndex(node->lower_node, depth + 1);
+  SeedKmppMergeClusterIndex(node->upper_node, depth + 1);
+  int i1 = node->lower_node->kmpp_cluster_index, i2 = node->upper_node->kmpp_cluster_index;
+  if (i1 == i2 && i1 != -1)
+    node->kmpp_cluster_index = i1;
+  else
+    node->kmpp_cluster_index = -1;
+}
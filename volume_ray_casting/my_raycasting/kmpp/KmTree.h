@@ -14,6 +14,10 @@
 //     some cluster centers as being too far away from every single point in that bounding box.
 //     Once only one cluster is left, all points in the node can be assigned to that cluster in
 //     batch.
+//   - The nodes at depth kSubtreeDepth (and the leaves above it) split the tree into independent
+//     subtrees. k-means steps and k-means++ updates process these subtrees on all threads (with
+//     OpenMP), each with its own sums, and combine them in subtree order. The result is therefore
+//     the same for any number of threads.
 //
 // Author: David Arthur (darthur@gmail.com), 2009
 
@@ -28,8 +32,16 @@ class KmTree {
  public:
   // Constructs a tree out of the given n data points living in R^d.
   KmTree(int n, int d, Scalar *points);
+
+  // Constructs a tree directly over n single-precision points, without copying them to Scalar.
+  // The points are read in place, so they must outlive the tree. Node statistics and centers are
+  // still kept as Scalar.
+  KmTree(int n, int d, const float *points);
   ~KmTree();
 
+  int GetNumPoints() const { return n_; }
+  int GetDimension() const { return d_; }
+
   // Given k cluster centers, this runs a full k-means iterations, choosing the next set of
   // centers and returning the cost function for this set of centers. If assignment is not null,
   // it should be an array of size n that will be filled with the index of the cluster (0 - k-1)
@@ -52,8 +64,13 @@ class KmTree {
     mutable int kmpp_cluster_index; // The cluster these points are assigned to or -1 if variable
   };
 
+  // The depth of the roots of the subtrees that are processed in parallel, up to 2^kSubtreeDepth
+  static const int kSubtreeDepth = 8;
+
   // Helper functions for constructor
-  Node *BuildNodes(Scalar *points, int first_index, int last_index, char **next_node_data);
+  void Initialize();
+  Node *BuildNodes(int first_index, int last_index, char **next_node_data);
+  void CollectSubtrees(const Node *node, int depth);
   Scalar GetNodeCost(const Node *node, Scalar *center) const;
 
   // Helper functions for DoKMeans step
@@ -62,14 +79,33 @@ class KmTree {
   bool ShouldBePruned(Scalar *box_median, Scalar *box_radius, Scalar *centers, int best_index,
                       int test_index) const;
 
+  // Coordinate j of point i, read from whichever point array the tree was built over
+  Scalar GetCoordinate(int i, int j) const {
+    return float_points_ != 0? Scalar(float_points_[i*d_ + j]) : points_[i*d_ + j];
+  }
+  void CopyPoint(Scalar *p, int i) const {
+    for (int j = 0; j < d_; j++)
+      p[j] = GetCoordinate(i, j);
+  }
+  Scalar PointDistSqTo(int i, const Scalar *p) const {
+    Scalar result = 0;
+    for (int j = 0; j < d_; j++)
+      result += (GetCoordinate(i, j) - p[j]) * (GetCoordinate(i, j) - p[j]);
+    return result;
+  }
+
   // Helper functions for SeedKMeansPlusPlus
   void SeedKmppSetClusterIndex(const Node *node, int index) const;
   Scalar SeedKmppUpdateAssignment(const Node *node, int new_cluster, Scalar *centers,
                                   Scalar *dist_sq) const;
+  void SeedKmppMergeClusterIndex(const Node *node, int depth) const;
 
   int n_, d_;
   Scalar *points_;
+  const float *float_points_;
   Node *top_node_;
+  const Node **subtrees_;
+  int num_subtrees_;
   char *node_data_;
   int *point_indices_;
 };
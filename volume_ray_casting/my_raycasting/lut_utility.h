@@ -0,0 +1,140 @@
+/**	@file
+*	a header file for lookup tables of transcendental functions
+*/
+
+#ifndef lut_utility_h
+#define lut_utility_h
+
+#include <vector>
+#include <cmath>
+
+/**	@brief	Lookup tables that replace log, sqrt, exp and pow in the per-voxel loops
+*
+*	Volume data are 8 or 16 bit, so a function of a data value has at most 65536 different results
+*	and can be read from a table. Functions of bounded float values are sampled and interpolated.
+*	The tables are built once, before the parallel loops that read them.
+*/
+namespace lut_utility
+{
+	/// the natural logarithm, 0 is replaced by a small positive value
+	struct Logarithm
+	{
+		double zero;
+		explicit Logarithm(const double zero_value) : zero(zero_value) {}
+		double operator()(const double x) const
+		{
+			return std::log(x > 0 ? x : zero);
+		}
+	};
+
+	/// the square root, 0 is replaced by a small positive value
+	struct SquareRoot
+	{
+		double zero;
+		explicit SquareRoot(const double zero_value) : zero(zero_value) {}
+		double operator()(const double x) const
+		{
+			return std::sqrt(x > 0 ? x : zero);
+		}
+	};
+
+	/**	@brief	A function tabulated at the integers 0 .. size-1
+	*
+	*	operator[] reads the table for 8/16-bit data values,
+	*	operator() reads the table for integral values in range and evaluates the function precisely otherwise.
+	*/
+	template <class Function>
+	class IntegerTable
+	{
+	public:
+
+		IntegerTable(const Function &function, const unsigned int size) : function(function), values(size)
+		{
+			const int n = static_cast<int>(size);
+			int i;
+#pragma omp parallel for
+			for (i=0; i<n; i++)
+			{
+				values[i] = static_cast<float>(function(static_cast<double>(i)));
+			}
+		}
+
+		/// the function value of an integer in the table
+		float operator[](const unsigned int i) const
+		{
+			return values[i];
+		}
+
+		/// the function value of any float
+		float operator()(const float x) const
+		{
+			if (x >= 0 && x < static_cast<float>(values.size()))
+			{
+				const unsigned int i = static_cast<unsigned int>(x);
+				if (static_cast<float>(i) == x)
+				{
+					return values[i];
+				}
+			}
+			return static_cast<float>(function(x));
+		}
+
+		/// number of entries
+		unsigned int size() const
+		{
+			return static_cast<unsigned int>(values.size());
+		}
+
+	private:
+		Function function;
+		std::vector<float> values;
+	};
+
+	/**	@brief	A function sampled on [lower, upper] with linear interpolation in between
+	*
+	*	Outside the interval the value at the nearer end is returned, so use it for functions
+	*	that become constant there, e.g. exp(-t) for large t once the result goes to 8-bit opacity.
+	*/
+	template <class Function>
+	class IntervalTable
+	{
+	public:
+
+		IntervalTable(const Function &function, const double lower, const double upper, const unsigned int samples)
+			: lower(static_cast<float>(lower)), values(samples + 1)
+		{
+			scale = static_cast<float>(samples / (upper - lower));
+			const int n = static_cast<int>(samples);
+			int i;
+#pragma omp parallel for
+			for (i=0; i<=n; i++)
+			{
+				values[i] = static_cast<float>(function(lower + (upper - lower) * i / samples));
+			}
+		}
+
+		/// the interpolated function value
+		float operator()(const float x) const
+		{
+			const float t = (x - lower) * scale;
+			if (!(t > 0))
+			{
+				return values.front();
+			}
+			// +inf and values beyond the table would overflow the conversion
+			if (!(t < values.size() - 1))
+			{
+				return values.back();
+			}
+			const unsigned int i = static_cast<unsigned int>(t);
+			const float f = t - i;
+			return values[i] + (values[i + 1] - values[i]) * f;
+		}
+
+	private:
+		float lower, scale;
+		std::vector<float> values;
+	};
+}
+
+#endif // lut_utility_h
@@ -0,0 +1,244 @@
+/**	@file
+*	a header file for foreground masks that let the analysis passes skip background voxels
+*/
+
+#ifndef mask_utility_h
+#define mask_utility_h
+
+#include <vector>
+#include <algorithm>
+
+#include "histogram_utility.h"
+
+/**	@brief	A foreground mask stored as a bitmask and as spans of foreground voxels per row
+*
+*	The mask is thresholded from the data, cleaned up by morphological opening (removing isolated noise)
+*	and closing (filling small holes) on the bitmask, 32 voxels per operation, and converted to spans.
+*	A pass over the foreground visits the spans of each row instead of testing every voxel.
+*	Volumes are indexed as (z * sizes[1] + y) * sizes[0] + x, a row is a line along x.
+*/
+namespace mask_utility
+{
+	/// the voxels [begin, end) of a row
+	struct Span
+	{
+		int begin, end;
+	};
+
+	/// the threshold below which the fraction p of the values lies
+	inline float percentile_threshold(const float *values, const unsigned int count, const double p)
+	{
+		float value_min, value_max;
+		histogram_utility::find_min_max(values, count, value_min, value_max);
+		histogram_utility::Histogram histogram;
+		histogram.build(values, count, 4096, value_min, value_max);
+		return histogram.get_percentile(p);
+	}
+
+	class ForegroundMask
+	{
+	public:
+
+		ForegroundMask() : words_per_row(0), foreground_count(0)
+		{
+			sizes[0] = sizes[1] = sizes[2] = 0;
+		}
+
+		/// the voxels whose value is at least threshold are foreground
+		void build(const float *values, const int *volume_sizes, const float threshold)
+		{
+			std::copy(volume_sizes, volume_sizes + 3, sizes);
+			words_per_row = (sizes[0] + 31) / 32;
+			const int rows = sizes[1] * sizes[2];
+			bits.assign(rows * words_per_row, 0);
+			int row;
+#pragma omp parallel for
+			for (row=0; row<rows; row++)
+			{
+				const float *v = values + row * sizes[0];
+				unsigned int *word = &bits[row * words_per_row];
+				for (int x=0; x<sizes[0]; x++)
+				{
+					if (v[x] >= threshold)
+					{
+						word[x >> 5] |= 1u << (x & 31);
+					}
+				}
+			}
+			update_spans();
+		}
+
+		/// remove foreground structures thinner than 2 * radius + 1 voxels
+		void open(const int radius)
+		{
+			for (int r=0; r<radius; r++) morph(false);
+			for (int r=0; r<radius; r++) morph(true);
+			update_spans();
+		}
+
+		/// fill background holes thinner than 2 * radius + 1 voxels
+		void close(const int radius)
+		{
+			for (int r=0; r<radius; r++) morph(true);
+			for (int r=0; r<radius; r++) morph(false);
+			update_spans();
+		}
+
+		/// grow the foreground by radius voxels
+		void dilate(const int radius)
+		{
+			for (int r=0; r<radius; r++) morph(true);
+			update_spans();
+		}
+
+		/// true if the voxel at index is foreground
+		bool contains(const unsigned int index) const
+		{
+			const unsigned int row = index / sizes[0], x = index % sizes[0];
+			return (bits[row * words_per_row + (x >> 5)] >> (x & 31)) & 1;
+		}
+
+		/// true if nothing has been built
+		bool empty() const
+		{
+			return bits.empty();
+		}
+
+		/// number of foreground voxels
+		unsigned int get_foreground_count() const
+		{
+			return foreground_count;
+		}
+
+		/// the spans [first, last) of the row (y, z)
+		void get_spans(const int y, const int z, const Span *&first, const Span *&last) const
+		{
+			const int row = z * sizes[1] + y;
+			first = spans.empty() ? NULL : &spans[0] + row_offsets[row];
+			last = spans.empty() ? NULL : &spans[0] + row_offsets[row + 1];
+		}
+
+		/// the indices of the foreground voxels in increasing order
+		void get_indices(std::vector<unsigned int> &indices) const
+		{
+			indices.clear();
+			indices.reserve(foreground_count);
+			const int rows = sizes[1] * sizes[2];
+			for (int row=0; row<rows; row++)
+			{
+				for (unsigned int s=row_offsets[row]; s<row_offsets[row + 1]; s++)
+				{
+					for (int x=spans[s].begin; x<spans[s].end; x++)
+					{
+						indices.push_back(row * sizes[0] + x);
+					}
+				}
+			}
+		}
+
+	private:
+		int sizes[3], words_per_row;
+		/// one bit per voxel, each row starts at a new word
+		std::vector<unsigned int> bits;
+		/// the spans of all rows, the spans of a row start at its offset
+		std::vector<Span> spans;
+		std::vector<unsigned int> row_offsets;
+		unsigned int foreground_count;
+
+		/// the bits past the end of a row
+		unsigned int tail_mask() const
+		{
+			const int used = sizes[0] & 31;
+			return used == 0 ? ~0u : (1u << used) - 1;
+		}
+
+		/// erode (dilate = false) or dilate the mask with the 6-neighbourhood.
+		/// Neighbours outside the volume count as the voxel itself.
+		void morph(const bool dilate)
+		{
+			const std::vector<unsigned int> source(bits);
+			const int n = words_per_row;
+			const unsigned int tail = tail_mask();
+			int z;
+#pragma omp parallel for
+			for (z=0; z<sizes[2]; z++)
+			{
+				for (int y=0; y<sizes[1]; y++)
+				{
+					const int row = z * sizes[1] + y;
+					const unsigned int *center = &source[row * n];
+					const unsigned int *neighbours[4] = {
+						y > 0 ? center - n : center,
+						y < sizes[1] - 1 ? center + n : center,
+						z > 0 ? center - sizes[1] * n : center,
+						z < sizes[2] - 1 ? center + sizes[1] * n : center};
+					unsigned int *out = &bits[row * n];
+					for (int w=0; w<n; w++)
+					{
+						const unsigned int c = center[w];
+						// the left neighbour of bit x is bit x - 1, at the row start the voxel itself
+						const unsigned int left = (c << 1) | (w > 0 ? center[w - 1] >> 31 : c & 1);
+						const unsigned int next = w < n - 1 ? center[w + 1] & 1 : 0;
+						unsigned int right = (c >> 1) | (next << 31);
+						if (w == n - 1)
+						{
+							// the right neighbour of the last voxel is the voxel itself
+							const int last = (sizes[0] - 1) & 31;
+							right = (right & ~(1u << last)) | (c & (1u << last));
+						}
+						unsigned int result = c;
+						if (dilate)
+						{
+							result |= left | right | neighbours[0][w] | neighbours[1][w] | neighbours[2][w] | neighbours[3][w];
+						}else
+						{
+							result &= left & right & neighbours[0][w] & neighbours[1][w] & neighbours[2][w] & neighbours[3][w];
+						}
+						out[w] = w == n - 1 ? result & tail : result;
+					}
+				}
+			}
+		}
+
+		/// convert the bitmask to spans
+		void update_spans()
+		{
+			const int rows = sizes[1] * sizes[2];
+			spans.clear();
+			row_offsets.assign(rows + 1, 0);
+			foreground_count = 0;
+			for (int row=0; row<rows; row++)
+			{
+				const unsigned int *word = &bits[row * words_per_row];
+				int x = 0;
+				while (x < sizes[0])
+				{
+					// skip whole background words
+					if ((x & 31) == 0 && word[x >> 5] == 0)
+					{
+						x += 32;
+						continue;
+					}
+					if ((word[x >> 5] >> (x & 31)) & 1)
+					{
+						Span span;
+						span.begin = x;
+						while (x < sizes[0] && ((word[x >> 5] >> (x & 31)) & 1))
+						{
+							x += ((x & 31) == 0 && word[x >> 5] == ~0u) ? 32 : 1;
+						}
+						span.end = std::min(x, sizes[0]);
+						spans.push_back(span);
+						foreground_count += span.end - span.begin;
+					}else
+					{
+						x++;
+					}
+				}
+				row_offsets[row + 1] = static_cast<unsigned int>(spans.size());
+			}
+		}
+	};
+}
+
+#endif // mask_utility_h
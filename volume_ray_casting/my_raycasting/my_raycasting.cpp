@@ -82,6 +82,8 @@ GLuint histogram_buffer;
 
 /// buffer for the gradient histogram
 GLuint histogram_gradient_buffer;
+/// the binned gradient histogram, drawn into histogram_gradient_buffer
+GLuint histogram_gradient_texture = 0;
 GLuint final_image;
 
 /// the volume texture from files
@@ -140,6 +142,19 @@ const float GRADIENT_SAMPLE_THRESHOLD_MAX = 5;
 const float GRADIENT_SAMPLE_THRESHOLD_MIN = 0;
 const float GRADIENT_SAMPLE_THRESHOLD_INC = 0.05;
 
+/// scale of the gradient estimation for noisy data, 0 for the Sobel operator
+float gradient_sigma = 0;
+
+/// bilateral grid denoising in front of clustering and gradient estimation, in voxels and in data units, 0 disables
+float denoise_sigma_spatial = 0;
+float denoise_sigma_range = 0;
+
+/// the percentile of the scalar values below which voxels are background and not clustered, 0 clusters all voxels
+float foreground_percentile = 0;
+
+/// the clustering routine, a volume_utility::Clustering_Method
+int clustering_method = volume_utility::K_MEANS_PP_GENERIC;
+
 /// for linear interpolation of alpha in the transfer function
 GLuint loc_alpha_opacity;
 float alpha_opacity = 0;
@@ -179,6 +194,7 @@ GLuint loc_clip;
 bool ui_on = true;
 #define MAX_KEYS 256
 #define WINDOW_SIZE 800
+#define HISTOGRAM_BIN_NUMBER 256
 #define VOLUME_TEX_SIZE 128
 bool gKeys[MAX_KEYS];
 
@@ -1022,7 +1038,7 @@ void cluster(const T *data, const unsigned int count)
 	unsigned char *label_ptr = new unsigned char[count];
 	int k = static_cast<int>(cluster_quantity);
 
-	volume_utility::cluster<T, TYPE_SIZE>(data, count, (unsigned int)color_component_number, k, label_ptr, sizes[0], sizes[1], sizes[2]);
+	volume_utility::cluster<T, TYPE_SIZE>(data, count, (unsigned int)color_component_number, k, label_ptr, sizes[0], sizes[1], sizes[2], denoise_sigma_spatial, denoise_sigma_range, foreground_percentile, clustering_method);
 
 	char label_filename[MAX_STR_SIZE];
 	sprintf(label_filename, "%s.%d.txt", volume_filename, k);
@@ -1085,20 +1101,25 @@ void load_cluster_labels_from_file(const unsigned int count)
 	delete [] label_ptr;
 }
 
+void draw_fullscreen_quad();
+
 /// render the histogram
 template <class T, int TYPE_SIZE>
 void render_histograms(const T *data, const unsigned int count, const unsigned int components)
 {
-	unsigned int histogram[TYPE_SIZE] = {0};
 	vector<float> scalar_value(count); // the scalar data in const T *data
 	vector<nv::vec3f> gradient(count);
 	vector<float> gradient_magnitude(count);
 	vector<nv::vec3f> second_derivative(count);
 	vector<float> second_derivative_magnitude(count);
 	float max_gradient_magnitude, max_second_derivative_magnitude;
-	volume_utility::generate_scalar_histogram<T, TYPE_SIZE>(data, count, components, histogram, scalar_value);
-	volume_utility::find_min_max_scalar_in_histogram<T, TYPE_SIZE>(count, histogram, scalar_min_normalized, scalar_max_normalized);
-	volume_utility::generate_gradient(sizes, count, components, scalar_value, gradient, gradient_magnitude, max_gradient_magnitude, second_derivative, second_derivative_magnitude, max_second_derivative_magnitude);
+
+	// one pass builds the histogram, the min and max for equalization come from its prefix sum
+	histogram_utility::Histogram histogram;
+	histogram.build(data, count, components, TYPE_SIZE, &scalar_value[0]);
+	scalar_min_normalized = static_cast<float>(histogram.get_percentile_bin(0.023)) / TYPE_SIZE;
+	scalar_max_normalized = static_cast<float>(histogram.get_percentile_bin_from_top(0.023)) / TYPE_SIZE;
+	volume_utility::generate_gradient(data, sizes, count, components, scalar_value, gradient, gradient_magnitude, max_gradient_magnitude, second_derivative, second_derivative_magnitude, max_second_derivative_magnitude);
 
 	// draw scalar histogram
 	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, histogram_buffer, 0);
@@ -1113,7 +1134,7 @@ void render_histograms(const T *data, const unsigned int count, const unsigned i
 	for (unsigned int i = 0; i<TYPE_SIZE; i++)
 	{
 		x = float(i) / TYPE_SIZE;
-		y = float(histogram[i]) / height;
+		y = float(histogram.get_frequency(i)) / height;
 		glColor3f(x, x, x);
 		glColor3f(1.0, 1.0, 1.0);
 		glVertex2f(x, 0);
@@ -1125,24 +1146,41 @@ void render_histograms(const T *data, const unsigned int count, const unsigned i
 	// draw gradient histogram
 	if (max_gradient_magnitude > 0)
 	{
-		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, histogram_gradient_buffer, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-		glLoadIdentity();
-		glEnable(GL_POINT_SMOOTH);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		// bin (scalar, gradient magnitude) once, colored by the mean gradient direction
+		vector<float> gradient_direction(count * 3);
+		int i;
+#pragma omp parallel for
+		for (i=0; i<(int)count; i++)
+		{
+			gradient_direction[i * 3] = abs(gradient[i].x);
+			gradient_direction[i * 3 + 1] = abs(gradient[i].y);
+			gradient_direction[i * 3 + 2] = abs(gradient[i].z);
+		}
+		histogram_utility::JointHistogram joint_histogram;
+		joint_histogram.build(&scalar_value[0], &gradient_magnitude[0], count, HISTOGRAM_BIN_NUMBER, HISTOGRAM_BIN_NUMBER, TYPE_SIZE, max_gradient_magnitude, &gradient_direction[0]);
+		vector<unsigned char> image;
+		joint_histogram.get_image(image);
 
-		// draw points to make a gradient histogram
-		glBegin(GL_POINTS);
-		for (unsigned int i = 0; i<count; i++)
+		if (histogram_gradient_texture == 0)
 		{
-			x = scalar_value[i] / TYPE_SIZE;
-			y = gradient_magnitude[i] / max_gradient_magnitude;
-			glColor3f(abs(gradient[i].x/max_gradient_magnitude), abs(gradient[i].y/max_gradient_magnitude), abs(gradient[i].z/max_gradient_magnitude));
-			glVertex2f(x, y);
+			glGenTextures(1, &histogram_gradient_texture);
 		}
-		glEnd();
-		glDisable(GL_BLEND);
+		glBindTexture(GL_TEXTURE_2D, histogram_gradient_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, joint_histogram.get_width(), joint_histogram.get_height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
+
+		// draw the texture with one quadrangle
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, histogram_gradient_buffer, 0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+		glLoadIdentity();
+		glEnable(GL_TEXTURE_2D);
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		draw_fullscreen_quad();
+		glDisable(GL_TEXTURE_2D);
 	}
 
 	glEnable(GL_DEPTH_TEST);
@@ -1199,18 +1237,32 @@ void load_gradient_texture()
 	vector<nv::vec3f> gradient(count);
 	std::cout<<"Scalar histogram..."<<std::endl;
 
+	histogram_utility::Histogram histogram;
+	// the integer Sobel path reads the raw data, a denoised volume goes through the float path
+	const bool denoise = denoise_sigma_spatial > 0 && denoise_sigma_range > 0;
 	if (gl_type == GL_UNSIGNED_SHORT)
 	{
-		unsigned int histogram[65536] = {0};
-		volume_utility::generate_scalar_histogram<unsigned short, 65536>((unsigned short*)*data_ptr, count, (unsigned int)color_component_number, histogram, scalar_value);
+		histogram.build((unsigned short*)*data_ptr, count, (unsigned int)color_component_number, 65536, &scalar_value[0]);
+		if (gradient_sigma == 0 && !denoise)
+			volume_utility::estimate_gradient(gradient_data, (unsigned short*)*data_ptr, sizes, count, (unsigned int)color_component_number, scalar_value, gradient);
 	}
 	else
 	{
-		unsigned int histogram[256] = {0};
-		volume_utility::generate_scalar_histogram<unsigned char, 256>((unsigned char*)*data_ptr, count, (unsigned int)color_component_number, histogram, scalar_value);
+		histogram.build((unsigned char*)*data_ptr, count, (unsigned int)color_component_number, 256, &scalar_value[0]);
+		if (gradient_sigma == 0 && !denoise)
+			volume_utility::estimate_gradient(gradient_data, (unsigned char*)*data_ptr, sizes, count, (unsigned int)color_component_number, scalar_value, gradient);
+	}
+	if (denoise)
+	{
+		std::cout<<"Bilateral filter..."<<std::endl;
+		volume_utility::bilateral_filter(scalar_value, sizes, denoise_sigma_spatial, denoise_sigma_range);
+		if (gradient_sigma == 0)
+			volume_utility::estimate_gradient(gradient_data, sizes, count, scalar_value, gradient);
+	}
+	if (gradient_sigma > 0)
+	{
+		volume_utility::estimate_gradient_gaussian(gradient_data, sizes, count, scalar_value, gradient_sigma, gradient);
 	}
-
-	volume_utility::estimate_gradient(gradient_data, sizes, count, scalar_value, gradient);
 
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glGenTextures(1, &gradient_texture);
@@ -0,0 +1,52 @@
+/**	@file
+*	a header file for running volume passes on several threads
+*/
+
+#ifndef parallel_utility_h
+#define parallel_utility_h
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#include <ctime>
+#endif
+
+/**	@brief	Functions for multithreading
+*
+*	The passes over the volume are parallelized with OpenMP (/openmp in the project settings).
+*	When OpenMP is disabled the pragmas are ignored and these functions report a single thread.
+*/
+namespace parallel_utility
+{
+	/// the number of threads a parallel region is going to use
+	inline int get_thread_number()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	/// the index of the calling thread in the current parallel region
+	inline int get_thread_index()
+	{
+#ifdef _OPENMP
+		return omp_get_thread_num();
+#else
+		return 0;
+#endif
+	}
+
+	/// the wall clock time in seconds, for timing parallel passes
+	inline double get_time()
+	{
+#ifdef _OPENMP
+		return omp_get_wtime();
+#else
+		return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+#endif
+	}
+}
+
+#endif // parallel_utility_h
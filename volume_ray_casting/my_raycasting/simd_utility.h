@@ -0,0 +1,21 @@
+/**	@file
+*	a header file for SIMD instruction support
+*/
+
+#ifndef simd_utility_h
+#define simd_utility_h
+
+/// SSE2 is always available on x64 and on the x86 machines we run on,
+/// code using the intrinsics keeps a scalar fallback for other targets
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define SIMD_UTILITY_SSE2
+#include <emmintrin.h>
+#endif
+
+/// F16C converts between half and float, it comes with AVX2 (/arch:AVX2) or is enabled explicitly (-mf16c)
+#if defined(__F16C__) || defined(__AVX2__)
+#define SIMD_UTILITY_F16C
+#include <immintrin.h>
+#endif
+
+#endif // simd_utility_h
@@ -0,0 +1,205 @@
+/**	@file
+*	a header file for numerically stable statistics of volume attributes
+*/
+
+#ifndef statistics_utility_h
+#define statistics_utility_h
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/**	@brief	Count, mean, central moments, minimum and maximum in one parallel pass
+*
+*	The values are split into blocks of a fixed size. Each block sums the powers of its values shifted by the
+*	first value of the block, which is exact enough in double for a few thousand values, and converts the
+*	sums into central moments. The blocks are then merged pairwise with the formulas of Chan et al.
+*	The blocks and the merge tree depend only on the number of values, not on the number of threads,
+*	so the result is the same for every run. Sums of a billion floats do not lose the small values either.
+*/
+namespace statistics_utility
+{
+	/// the number of values summed directly
+	const int MOMENTS_BLOCK_SIZE = 4096;
+
+	/**	@brief	The moments of a set of values, m2, m3 and m4 are the sums of the powers of the deviations
+	*
+	*/
+	struct Moments
+	{
+		double count, mean, m2, m3, m4, min, max;
+
+		Moments() : count(0), mean(0), m2(0), m3(0), m4(0), min(0), max(0)
+		{
+		}
+
+		/// add one value (Welford)
+		void add(const double x)
+		{
+			Moments one;
+			one.count = 1;
+			one.mean = one.min = one.max = x;
+			merge(one);
+		}
+
+		/// add the moments of another set of values (Chan et al.)
+		void merge(const Moments &b)
+		{
+			if (b.count == 0)
+			{
+				return;
+			}
+			if (count == 0)
+			{
+				*this = b;
+				return;
+			}
+			const double na = count, nb = b.count, n = na + nb;
+			const double delta = b.mean - mean, delta_n = delta / n;
+			const double delta_n2 = delta_n * delta_n, term = delta * delta_n * na * nb;
+			m4 += b.m4 + term * delta_n2 * (na * na - na * nb + nb * nb) + 6 * delta_n2 * (na * na * b.m2 + nb * nb * m2) + 4 * delta_n * (na * b.m3 - nb * m3);
+			m3 += b.m3 + term * delta_n * (na - nb) + 3 * delta_n * (na * b.m2 - nb * m2);
+			m2 += b.m2 + term;
+			mean += delta_n * nb;
+			count = n;
+			min = std::min(min, b.min);
+			max = std::max(max, b.max);
+		}
+
+		/// the population variance
+		double variance() const
+		{
+			return count > 0 ? m2 / count : 0;
+		}
+
+		double standard_deviation() const
+		{
+			return std::sqrt(variance());
+		}
+
+		double skewness() const
+		{
+			return m2 > 0 ? std::sqrt(count) * m3 / std::pow(m2, 1.5) : 0;
+		}
+
+		/// the kurtosis minus 3, 0 for a normal distribution
+		double excess_kurtosis() const
+		{
+			return m2 > 0 ? count * m4 / (m2 * m2) - 3 : 0;
+		}
+	};
+
+	/// the moments of n values read by attribute(i), i in [first, first + n)
+	template <class A>
+	Moments block_moments(const A &attribute, const unsigned int first, const int n)
+	{
+		Moments result;
+		if (n <= 0)
+		{
+			return result;
+		}
+		const double shift = attribute(first);
+		double s1 = 0, s2 = 0, s3 = 0, s4 = 0, lower = shift, upper = shift;
+		for (int i=0; i<n; i++)
+		{
+			const double x = attribute(first + i);
+			const double d = x - shift, d2 = d * d;
+			s1 += d;
+			s2 += d2;
+			s3 += d2 * d;
+			s4 += d2 * d2;
+			lower = std::min(lower, x);
+			upper = std::max(upper, x);
+		}
+		const double mu = s1 / n, mu2 = mu * mu;
+		result.count = n;
+		result.mean = shift + mu;
+		result.m2 = std::max(s2 - n * mu2, 0.0);
+		result.m3 = s3 - 3 * mu * s2 + 2 * n * mu2 * mu;
+		result.m4 = std::max(s4 - 4 * mu * s3 + 6 * mu2 * s2 - 3 * n * mu2 * mu2, 0.0);
+		result.min = lower;
+		result.max = upper;
+		return result;
+	}
+
+	/// merge the parts pairwise in order, the parts are overwritten
+	inline Moments reduce(std::vector<Moments> &parts)
+	{
+		if (parts.empty())
+		{
+			return Moments();
+		}
+		for (size_t step=1; step<parts.size(); step*=2)
+		{
+			for (size_t i=0; i+step<parts.size(); i+=2*step)
+			{
+				parts[i].merge(parts[i + step]);
+			}
+		}
+		return parts[0];
+	}
+
+	/// the moments of count values read by attribute(i), i in [0, count)
+	template <class A>
+	Moments compute(const A &attribute, const unsigned int count)
+	{
+		const int blocks = static_cast<int>((count + MOMENTS_BLOCK_SIZE - 1) / MOMENTS_BLOCK_SIZE);
+		std::vector<Moments> parts(blocks);
+		int b;
+#pragma omp parallel for
+		for (b=0; b<blocks; b++)
+		{
+			const unsigned int first = static_cast<unsigned int>(b) * MOMENTS_BLOCK_SIZE;
+			parts[b] = block_moments(attribute, first, static_cast<int>(std::min<unsigned int>(MOMENTS_BLOCK_SIZE, count - first)));
+		}
+		return reduce(parts);
+	}
+
+	/// read the values of an array
+	template <class T>
+	struct ArrayAttribute
+	{
+		const T *values;
+
+		explicit ArrayAttribute(const T *values) : values(values)
+		{
+		}
+
+		double operator()(const unsigned int index) const
+		{
+			return static_cast<double>(values[index]);
+		}
+	};
+
+	/// read the values of a field with a get(index) member, like half_utility::HalfField
+	template <class F>
+	struct FieldAttribute
+	{
+		const F *field;
+
+		explicit FieldAttribute(const F &field) : field(&field)
+		{
+		}
+
+		double operator()(const unsigned int index) const
+		{
+			return static_cast<double>(field->get(index));
+		}
+	};
+
+	/// the moments of an array
+	template <class T>
+	Moments compute_array(const T *values, const unsigned int count)
+	{
+		return compute(ArrayAttribute<T>(values), count);
+	}
+
+	/// the moments of the first count values of a field
+	template <class F>
+	Moments compute_field(const F &field, const unsigned int count)
+	{
+		return compute(FieldAttribute<F>(field), count);
+	}
+}
+
+#endif // statistics_utility_h
@@ -0,0 +1,271 @@
+/**	@file
+*	a header file for Hessian and structure tensor analysis of volume data
+*/
+
+#ifndef tensor_utility_h
+#define tensor_utility_h
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "gaussian_utility.h"
+
+/**	@brief	Symmetric 3x3 tensor fields, their eigenvalues and the shape features derived from them
+*
+*	The 6 unique components of a tensor field are stored as separate volumes, each one computed with
+*	separable filters (finite differences followed by the recursive Gaussian of gaussian_utility).
+*	The eigenvalues are computed in closed form, in batches over the structure of arrays,
+*	so the loop bodies have no branches on the data other than the degenerate diagonal case.
+*	Volumes are indexed as (z * sizes[1] + y) * sizes[0] + x.
+*/
+namespace tensor_utility
+{
+	/**	@brief	The components xx, xy, xz, yy, yz, zz of a symmetric tensor per voxel
+	*
+	*/
+	struct TensorField
+	{
+		std::vector<float> xx, xy, xz, yy, yz, zz;
+
+		void resize(const unsigned int count)
+		{
+			xx.resize(count);
+			xy.resize(count);
+			xz.resize(count);
+			yy.resize(count);
+			yz.resize(count);
+			zz.resize(count);
+		}
+
+		unsigned int size() const
+		{
+			return static_cast<unsigned int>(xx.size());
+		}
+	};
+
+	/// out = in[+1] - 2 * in + in[-1] along an axis, the volume is extended by its boundary values
+	inline void second_difference(const float *in, float *out, const int *sizes, const int axis)
+	{
+		const int step = axis == 0 ? 1 : (axis == 1 ? sizes[0] : sizes[0] * sizes[1]);
+		const int n = sizes[axis];
+		int z;
+#pragma omp parallel for
+		for (z=0; z<sizes[2]; z++)
+		{
+			for (int y=0; y<sizes[1]; y++)
+			{
+				const int row = (z * sizes[1] + y) * sizes[0];
+				for (int x=0; x<sizes[0]; x++)
+				{
+					const int position = axis == 0 ? x : (axis == 1 ? y : z);
+					const int index = row + x;
+					const float lower = position > 0 ? in[index - step] : in[index];
+					const float upper = position < n - 1 ? in[index + step] : in[index];
+					out[index] = upper - 2 * in[index] + lower;
+				}
+			}
+		}
+	}
+
+	/// smooth in place with a Gaussian, sigma 0 leaves the volume as it is
+	inline void smooth(float *volume, const int *sizes, const double sigma)
+	{
+		if (sigma > 0)
+		{
+			gaussian_utility::smooth(volume, sizes, std::max(sigma, 0.5));
+		}
+	}
+
+	/// the Hessian of the volume smoothed with a Gaussian of standard deviation sigma (0 for plain differences)
+	inline void hessian(const float *volume, const int *sizes, const double sigma, TensorField &h)
+	{
+		const unsigned int count = sizes[0] * sizes[1] * sizes[2];
+		h.resize(count);
+		std::vector<float> temp(count);
+
+		second_difference(volume, &h.xx[0], sizes, 0);
+		second_difference(volume, &h.yy[0], sizes, 1);
+		second_difference(volume, &h.zz[0], sizes, 2);
+
+		gaussian_utility::central_difference(volume, &temp[0], sizes, 0);
+		gaussian_utility::central_difference(&temp[0], &h.xy[0], sizes, 1);
+		gaussian_utility::central_difference(&temp[0], &h.xz[0], sizes, 2);
+		gaussian_utility::central_difference(volume, &temp[0], sizes, 1);
+		gaussian_utility::central_difference(&temp[0], &h.yz[0], sizes, 2);
+
+		float *components[6] = {&h.xx[0], &h.xy[0], &h.xz[0], &h.yy[0], &h.yz[0], &h.zz[0]};
+		for (int c=0; c<6; c++)
+		{
+			smooth(components[c], sizes, sigma);
+		}
+	}
+
+	/// the structure tensor: the outer product of the gradient at scale sigma, averaged at scale rho
+	inline void structure_tensor(const float *volume, const int *sizes, const double sigma, const double rho, TensorField &s)
+	{
+		const unsigned int count = sizes[0] * sizes[1] * sizes[2];
+		s.resize(count);
+		std::vector<float> dx(count), dy(count), dz(count);
+		if (sigma > 0)
+		{
+			gaussian_utility::gradient(volume, sizes, std::max(sigma, 0.5), &dx[0], &dy[0], &dz[0]);
+		}else
+		{
+			gaussian_utility::central_difference(volume, &dx[0], sizes, 0);
+			gaussian_utility::central_difference(volume, &dy[0], sizes, 1);
+			gaussian_utility::central_difference(volume, &dz[0], sizes, 2);
+		}
+
+		const int n = static_cast<int>(count);
+		int i;
+#pragma omp parallel for
+		for (i=0; i<n; i++)
+		{
+			s.xx[i] = dx[i] * dx[i];
+			s.xy[i] = dx[i] * dy[i];
+			s.xz[i] = dx[i] * dz[i];
+			s.yy[i] = dy[i] * dy[i];
+			s.yz[i] = dy[i] * dz[i];
+			s.zz[i] = dz[i] * dz[i];
+		}
+
+		float *components[6] = {&s.xx[0], &s.xy[0], &s.xz[0], &s.yy[0], &s.yz[0], &s.zz[0]};
+		for (int c=0; c<6; c++)
+		{
+			smooth(components[c], sizes, rho);
+		}
+	}
+
+	/// the number of voxels solved together, small enough for the batch to stay in the L1 cache
+	const int EIGEN_BATCH_SIZE = 256;
+
+	/// eigenvalues of n symmetric tensors in closed form (the trigonometric solution of the characteristic cubic),
+	/// in descending order: e1 >= e2 >= e3
+	inline void eigenvalues_batch(const float *xx, const float *xy, const float *xz, const float *yy, const float *yz, const float *zz,
+		const int n, float *e1, float *e2, float *e3)
+	{
+		const float third = 1.0f / 3.0f;
+		const float two_pi_third = 2.0943951f;
+		for (int i=0; i<n; i++)
+		{
+			const float q = (xx[i] + yy[i] + zz[i]) * third;
+			const float off = xy[i] * xy[i] + xz[i] * xz[i] + yz[i] * yz[i];
+			const float a = xx[i] - q, b = yy[i] - q, c = zz[i] - q;
+			const float p2 = a * a + b * b + c * c + 2 * off;
+			const float p = std::sqrt(p2 * (1.0f / 6.0f));
+			const float inverse = p > 0 ? 1 / p : 0;
+
+			// r = det((A - q I) / p) / 2, clamped against rounding
+			const float det = a * (b * c - yz[i] * yz[i]) - xy[i] * (xy[i] * c - yz[i] * xz[i]) + xz[i] * (xy[i] * yz[i] - b * xz[i]);
+			float r = 0.5f * det * inverse * inverse * inverse;
+			r = r < -1 ? -1 : (r > 1 ? 1 : r);
+
+			const float phi = std::acos(r) * third;
+			e1[i] = q + 2 * p * std::cos(phi);
+			e3[i] = q + 2 * p * std::cos(phi + two_pi_third);
+			e2[i] = 3 * q - e1[i] - e3[i];
+		}
+	}
+
+	/// eigenvalues of a tensor field in descending order, in batches distributed over the threads
+	inline void eigenvalues(const TensorField &t, float *e1, float *e2, float *e3)
+	{
+		const int count = static_cast<int>(t.size());
+		const int batches = (count + EIGEN_BATCH_SIZE - 1) / EIGEN_BATCH_SIZE;
+		int b;
+#pragma omp parallel for
+		for (b=0; b<batches; b++)
+		{
+			const int first = b * EIGEN_BATCH_SIZE;
+			const int n = std::min(EIGEN_BATCH_SIZE, count - first);
+			eigenvalues_batch(&t.xx[first], &t.xy[first], &t.xz[first], &t.yy[first], &t.yz[first], &t.zz[first], n, e1 + first, e2 + first, e3 + first);
+		}
+	}
+
+	/// order three eigenvalues by magnitude, |l1| <= |l2| <= |l3|
+	inline void sort_by_magnitude(const float e1, const float e2, const float e3, float &l1, float &l2, float &l3)
+	{
+		l1 = e1;
+		l2 = e2;
+		l3 = e3;
+		if (std::fabs(l1) > std::fabs(l2)) std::swap(l1, l2);
+		if (std::fabs(l2) > std::fabs(l3)) std::swap(l2, l3);
+		if (std::fabs(l1) > std::fabs(l2)) std::swap(l1, l2);
+	}
+
+	/**	@brief	Shape measures of bright structures from the Hessian eigenvalues
+	*
+	*	With |l1| <= |l2| <= |l3|: a tube has l1 ~ 0 and l2 ~ l3 << 0, a sheet has l1 ~ l2 ~ 0 and l3 << 0.
+	*	alpha and beta weigh the eigenvalue ratios, c the structureness S = |H| so that noise is suppressed,
+	*	c is usually half of the largest S of the volume.
+	*/
+	struct ShapeMeasure
+	{
+		float alpha, beta, c;
+
+		ShapeMeasure(const float alpha = 0.5f, const float beta = 0.5f, const float c = 1) : alpha(alpha), beta(beta), c(c)
+		{
+		}
+
+		/// the vesselness of Frangi et al.
+		float vesselness(const float l1, const float l2, const float l3) const
+		{
+			if (l2 >= 0 || l3 >= 0)
+			{
+				return 0;
+			}
+			const float ra = std::fabs(l2) / std::fabs(l3);
+			const float rb = std::fabs(l1) / std::sqrt(std::fabs(l2 * l3));
+			const float s2 = l1 * l1 + l2 * l2 + l3 * l3;
+			return (1 - std::exp(-ra * ra / (2 * alpha * alpha))) * std::exp(-rb * rb / (2 * beta * beta)) * (1 - std::exp(-s2 / (2 * c * c)));
+		}
+
+		/// the sheetness measure of Descoteaux et al.
+		float planarness(const float l1, const float l2, const float l3) const
+		{
+			if (l3 >= 0)
+			{
+				return 0;
+			}
+			const float rs = std::fabs(l2) / std::fabs(l3);
+			const float s2 = l1 * l1 + l2 * l2 + l3 * l3;
+			return std::exp(-rs * rs / (2 * alpha * alpha)) * (1 - std::exp(-s2 / (2 * c * c)));
+		}
+	};
+
+	/// the largest structureness sqrt(e1^2 + e2^2 + e3^2) of count voxels
+	inline float max_structureness(const float *e1, const float *e2, const float *e3, const unsigned int count)
+	{
+		float result = 0;
+		for (unsigned int i=0; i<count; i++)
+		{
+			result = std::max(result, e1[i] * e1[i] + e2[i] * e2[i] + e3[i] * e3[i]);
+		}
+		return std::sqrt(result);
+	}
+
+	/// vesselness and planarness of count voxels from the Hessian eigenvalues, either output may be NULL
+	inline void shape_features(const float *e1, const float *e2, const float *e3, const unsigned int count, const ShapeMeasure &measure,
+		float *vesselness, float *planarness)
+	{
+		const int n = static_cast<int>(count);
+		int i;
+#pragma omp parallel for
+		for (i=0; i<n; i++)
+		{
+			float l1, l2, l3;
+			sort_by_magnitude(e1[i], e2[i], e3[i], l1, l2, l3);
+			if (vesselness)
+			{
+				vesselness[i] = measure.vesselness(l1, l2, l3);
+			}
+			if (planarness)
+			{
+				planarness[i] = measure.planarness(l1, l2, l3);
+			}
+		}
+	}
+}
+
+#endif // tensor_utility_h
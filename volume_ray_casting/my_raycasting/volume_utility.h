@@ -14,7 +14,19 @@
 //#include "K_Means_Local.h"
 //#include "K_Means_PlusPlus.h"
 #include "K_Means_PP_Generic.h"
+#include "K_Means_Bounded.h"
+#include "K_Means_Coreset.h"
+#include "K_Means_Mini_Batch.h"
+#include "K_Means_Filtering.h"
+#include "K_Means_Supervoxel.h"
 #include "Fuzzy_CMeans.h"
+#include "Fuzzy_CMeans_Streaming.h"
+#include "histogram_utility.h"
+#include "gradient_utility.h"
+#include "gaussian_utility.h"
+#include "bilateral_utility.h"
+#include "mask_utility.h"
+#include "parallel_utility.h"
 
 /**	@brief	Classes and functions for volume manipulation
 *	
@@ -25,6 +37,56 @@ namespace volume_utility
 	//#define _DEBUG_OUTPUT
 	//#endif
 
+	/// the clustering routines of cluster()
+	enum Clustering_Method
+	{
+		/// k-means++ seeds and the Lloyd iteration (K_Means_PP_Generic)
+		K_MEANS_PP_GENERIC,
+		/// k-means++ seeds and the iteration accelerated by the triangle inequality (K_Means_Bounded)
+		K_MEANS_BOUNDED,
+		/// fuzzy c-means (Fuzzy_CMeans)
+		FUZZY_C_MEANS,
+		/// k-means on the weighted means of the quantized features (K_Means_Coreset)
+		K_MEANS_CORESET,
+		/// k-means on random mini-batches of the features and one final assignment (K_Means_Mini_Batch)
+		K_MEANS_MINI_BATCH,
+		/// k-means++ with the kd-tree filtering algorithm over the features in place (K_Means_Filtering)
+		K_MEANS_FILTERING,
+		/// fuzzy c-means with memberships computed on the fly, m = 2 (Fuzzy_CMeans_Streaming)
+		FUZZY_C_MEANS_STREAMING,
+		/// k-means on the means of 3D SLIC supervoxels, spatially coherent without the bandwagon filter (K_Means_Supervoxel)
+		SUPERVOXEL_K_MEANS
+	};
+
+	/// cluster the feature vectors v into k clusters with the given method
+	void cluster_features(const int method, const std::vector<nv::vec3f> &v, const int k, unsigned char *& label_ptr)
+	{
+		switch (method)
+		{
+		case K_MEANS_BOUNDED:
+			clustering::K_Means_Bounded::k_means(v, k, label_ptr, clustering::K_Means_PP_Generic::get_distance<nv::vec3f>, clustering::K_Means_PP_Generic::get_centroid<nv::vec3f>);
+			break;
+		case FUZZY_C_MEANS:
+			clustering::Fuzzy_CMeans::k_means(v, k, label_ptr);
+			break;
+		case FUZZY_C_MEANS_STREAMING:
+			clustering::Fuzzy_CMeans_Streaming::k_means(v, k, label_ptr);
+			break;
+		case K_MEANS_CORESET:
+			clustering::K_Means_Coreset::k_means(v, k, label_ptr);
+			break;
+		case K_MEANS_FILTERING:
+			clustering::K_Means_Filtering::k_means(v, k, label_ptr);
+			break;
+		case K_MEANS_MINI_BATCH:
+			clustering::K_Means_Mini_Batch::k_means(v, k, label_ptr, clustering::K_Means_PP_Generic::get_distance<nv::vec3f>, clustering::K_Means_PP_Generic::get_centroid<nv::vec3f>);
+			break;
+		default:
+			clustering::K_Means_PP_Generic::k_means(v, k, label_ptr, clustering::K_Means_PP_Generic::get_distance<nv::vec3f>, clustering::K_Means_PP_Generic::get_centroid<nv::vec3f>);
+			break;
+		}
+	}
+
 	/// convert a char to a hex number, the cluster number is represented in 0~9 and a~f
 	unsigned char char_to_number(unsigned char c)
 	{
@@ -168,6 +230,19 @@ namespace volume_utility
 		}
 	}
 
+	/// edge preserving smoothing of scalar values with a bilateral grid,
+	/// sigma_spatial in voxels and sigma_range in scalar units, nothing is done if either is 0
+	void bilateral_filter(vector<float> &scalar_value, const int *sizes, const float sigma_spatial, const float sigma_range)
+	{
+		if (sigma_spatial <= 0 || sigma_range <= 0)
+		{
+			return;
+		}
+		vector<float> scalar_value_before(scalar_value);
+		bilateral_utility::BilateralGrid grid(sigma_spatial, sigma_range);
+		grid.filter(&scalar_value_before[0], &scalar_value[0], sizes);
+	}
+
 	/// shift the cluster labels into the range of 0 to 255
 	void shift_labels(const int k, const unsigned int count, unsigned char *& label_ptr)
 	{
@@ -189,11 +264,59 @@ namespace volume_utility
 		}
 	}
 
+	/// cluster the voxels through SLIC supervoxels of the scalar value, gradient magnitude and second derivative magnitude.
+	/// If indices is not empty, only these voxels are foreground: the supervoxels are weighted by their foreground voxels,
+	/// which get the labels 1 to k - 1, and the other voxels get 0.
+	void cluster_supervoxels(const int *sizes, const vector<float> &scalar_value, const vector<float> &gradient_magnitude, const vector<float> &second_derivative_magnitude,
+		const vector<unsigned int> &indices, const int k, unsigned char *label_ptr)
+	{
+		const unsigned int count = static_cast<unsigned int>(scalar_value.size());
+		clustering::Feature_Set features;
+		features.resize(count, 3);
+		std::copy(scalar_value.begin(), scalar_value.end(), features.component(0));
+		std::copy(gradient_magnitude.begin(), gradient_magnitude.end(), features.component(1));
+		std::copy(second_derivative_magnitude.begin(), second_derivative_magnitude.end(), features.component(2));
+
+		// with a mask the supervoxels cover the background too, but their means and weights only count the foreground
+		const bool masked = !indices.empty();
+		vector<unsigned char> foreground;
+		if (masked)
+		{
+			foreground.assign(count, 0);
+			for (unsigned int n=0; n<indices.size(); n++)
+			{
+				foreground[indices[n]] = 1;
+			}
+		}
+
+		std::cout<<"Supervoxels..."<<std::endl;
+		clustering::Feature_Set means;
+		vector<float> weights;
+		vector<unsigned int> supervoxels;
+		const unsigned int m = clustering::K_Means_Supervoxel::build(features, sizes, clustering::Supervoxel_Options(), means, weights, supervoxels,
+			masked ? &foreground[0] : NULL);
+
+		vector<float> centroids;
+		vector<int> supervoxel_labels(m);
+		clustering::K_Means_Seeding::seed_plus_plus(means, masked ? k - 1 : k, centroids, static_cast<unsigned long long>(time(NULL)), &weights[0]);
+		clustering::K_Means_Lloyd::run(means, masked ? k - 1 : k, centroids, &supervoxel_labels[0], clustering::Lloyd_Options(), &weights[0]);
+
+		for (unsigned int i=0; i<count; i++)
+		{
+			const int label = supervoxel_labels[supervoxels[i]];
+			label_ptr[i] = static_cast<unsigned char>(masked ? (foreground[i] ? label + 1 : 0) : label);
+		}
+	}
+
 	/// calculate the gradient and derivatives and do clustering on voxels
+	/// the scalar values are smoothed by bilateral_filter first if denoise_sigma_spatial and denoise_sigma_range are given.
+	/// If foreground_percentile is given, the voxels below that percentile of the scalar values are background and get the label 0,
+	/// only the foreground voxels are clustered into the labels 1 to k - 1.
+	/// method is a Clustering_Method
 	template <class T, int TYPE_SIZE>
-	void cluster(const T *data, const unsigned int count, const unsigned int components, const int k, unsigned char *& label_ptr, int width, int height, int depth)
+	void cluster(const T *data, const unsigned int count, const unsigned int components, const int k, unsigned char *& label_ptr, int width, int height, int depth,
+		const float denoise_sigma_spatial = 0, const float denoise_sigma_range = 0, const float foreground_percentile = 0, const int method = K_MEANS_PP_GENERIC)
 	{
-		unsigned int histogram[TYPE_SIZE] = {0};
 		vector<float> scalar_value(count); // the scalar data in const T *data
 		vector<nv::vec3f> gradient(count);
 		vector<float> gradient_magnitude(count);
@@ -207,10 +330,29 @@ namespace volume_utility
 		//median_filter(scalar_value_before, scalar_value, width, height, depth);
 
 		std::cout<<"Scalar histogram..."<<std::endl;
-		generate_scalar_histogram<T, TYPE_SIZE>(data, count, components, histogram, scalar_value);
+		histogram_utility::Histogram histogram;
+		histogram.build(data, count, components, TYPE_SIZE, &scalar_value[0]);
+		if (denoise_sigma_spatial > 0 && denoise_sigma_range > 0)
+		{
+			std::cout<<"Bilateral filter..."<<std::endl;
+			const int volume_sizes[3] = {width, height, depth};
+			bilateral_filter(scalar_value, volume_sizes, denoise_sigma_spatial, denoise_sigma_range);
+		}
+
+		// the foreground is separated before the derivatives, which are then only computed on it
+		mask_utility::ForegroundMask foreground;
+		if (foreground_percentile > 0 && k > 1)
+		{
+			std::cout<<"Foreground mask..."<<std::endl;
+			const int volume_sizes[3] = {width, height, depth};
+			foreground.build(&scalar_value[0], volume_sizes, mask_utility::percentile_threshold(&scalar_value[0], count, foreground_percentile));
+			foreground.open(1);
+			foreground.close(1);
+		}
 
 		std::cout<<"Gradients and second derivatives..."<<std::endl;
-		generate_gradient(sizes, count, components, scalar_value, gradient, gradient_magnitude, max_gradient_magnitude, second_derivative, second_derivative_magnitude, max_second_derivative_magnitude);
+		generate_gradient(sizes, count, components, scalar_value, gradient, gradient_magnitude, max_gradient_magnitude, second_derivative, second_derivative_magnitude, max_second_derivative_magnitude,
+			foreground.empty() ? NULL : &foreground);
 
 		//// by Ben for statistical based clustering
 		//vector<float> average(count);
@@ -219,14 +361,24 @@ namespace volume_utility
 
 		unsigned char *label_ptr_before_filter = new unsigned char[count];
 
+		// the indices of the voxels to cluster, all of them without a foreground mask
+		vector<unsigned int> indices;
+		if (!foreground.empty())
+		{
+			foreground.get_indices(indices);
+		}
+		const bool masked = !indices.empty();
+		const unsigned int cluster_count = masked ? static_cast<unsigned int>(indices.size()) : count;
+
 		// wrap for K_Means_PP_Generic::k_means()
-		std::vector<nv::vec3f> v(count);
+		std::vector<nv::vec3f> v(cluster_count);
 		//std::vector<nv::vec2f> v(count);
-		for (unsigned int i=0; i<count; i++)
+		for (unsigned int n=0; n<cluster_count; n++)
 		{
-			v[i].x = scalar_value[i];
-			v[i].y = gradient_magnitude[i];
-			v[i].z = second_derivative_magnitude[i];
+			const unsigned int i = masked ? indices[n] : n;
+			v[n].x = scalar_value[i];
+			v[n].y = gradient_magnitude[i];
+			v[n].z = second_derivative_magnitude[i];
 
 			//v[i].w = scalar_value[i];
 			//v[i].x = gradient[i].x;
@@ -237,11 +389,36 @@ namespace volume_utility
 			//v[i].y = variation[i];
 		}
 
+#ifdef _DEBUG_OUTPUT
+		// the time and the quality of mini-batches against the Lloyd iteration on these features
+		clustering::Feature_Set benchmark_features;
+		benchmark_features.assign(v);
+		clustering::K_Means_Mini_Batch::benchmark(benchmark_features, masked ? k - 1 : k, static_cast<unsigned long long>(time(NULL)));
+#endif
+
 		// call the clustering routine
 		std::cout<<"Clustering..."<<std::endl;
 
 		//clustering::K_Means_PP_DIY::k_means(count, scalar_value, gradient_magnitude, second_derivative_magnitude, k, label_ptr_before);
-		clustering::K_Means_PP_Generic::k_means(v, k, label_ptr_before_filter, clustering::K_Means_PP_Generic::get_distance<nv::vec3f>, clustering::K_Means_PP_Generic::get_centroid<nv::vec3f>);
+		if (method == SUPERVOXEL_K_MEANS)
+		{
+			const int volume_sizes[3] = {width, height, depth};
+			cluster_supervoxels(volume_sizes, scalar_value, gradient_magnitude, second_derivative_magnitude, indices, k, label_ptr_before_filter);
+		}else if (masked)
+		{
+			// the background is cluster 0, the foreground clusters follow
+			unsigned char *foreground_label_ptr = new unsigned char[cluster_count];
+			cluster_features(method, v, k - 1, foreground_label_ptr);
+			memset(label_ptr_before_filter, 0, count);
+			for (unsigned int n=0; n<cluster_count; n++)
+			{
+				label_ptr_before_filter[indices[n]] = foreground_label_ptr[n] + 1;
+			}
+			delete[] foreground_label_ptr;
+		}else
+		{
+			cluster_features(method, v, k, label_ptr_before_filter);
+		}
 
 		//// by Ben for statistical based clustering
 		//clustering::K_Means_PP_Generic::k_means(v, k, label_ptr_before_filter, clustering::K_Means_PP_Generic::get_distance<nv::vec2f>, clustering::K_Means_PP_Generic::get_centroid<nv::vec2f>);
@@ -255,8 +432,15 @@ namespace volume_utility
 		//}
 
 		// the bandwagon effect filter
-		std::cout<<"Filtering..."<<std::endl;
-		bandwagon_effect_filter(k, label_ptr_before_filter, label_ptr, width, height, depth);
+		if (method == SUPERVOXEL_K_MEANS)
+		{
+			// the labels of supervoxels are coherent already
+			memcpy(label_ptr, label_ptr_before_filter, count);
+		}else
+		{
+			std::cout<<"Filtering..."<<std::endl;
+			bandwagon_effect_filter(k, label_ptr_before_filter, label_ptr, width, height, depth);
+		}
 		delete[] label_ptr_before_filter;
 
 		//std::ofstream label_file("d:/label.txt");
@@ -274,51 +458,20 @@ namespace volume_utility
 	template <class T, int TYPE_SIZE>
 	void generate_scalar_histogram(const T *data, const unsigned int count, const unsigned int components, unsigned int *histogram, vector<float> &scalar_value)
 	{
-		for (unsigned int i=0; i<count; i++)
-		{
-			unsigned int temp = 0;
-			unsigned int index = i * components;
-			for (unsigned int j=0; j<components; j++)
-			{
-				temp += data[index + j];
-			}
-			temp = temp / components;
-			histogram[temp]++;
-			scalar_value[i] = temp;
-		}
+		histogram_utility::Histogram h;
+		h.build(data, count, components, TYPE_SIZE, &scalar_value[0]);
+		memcpy(histogram, h.get_frequencies(), sizeof(unsigned int) * TYPE_SIZE);
 	}
 
 	/// find the min and max scalar value for histogram equalization in shaders
 	template <class T, int TYPE_SIZE>
 	void find_min_max_scalar_in_histogram(const unsigned int count, const unsigned int *histogram, float &scalar_min, float &scalar_max)
 	{
-		const unsigned int min_amount = static_cast<unsigned int>(count * 0.023);
-		unsigned int amount = min_amount;
-		unsigned int min_index = 0;
-		for (unsigned int i=0; i<TYPE_SIZE; i++)
-		{
-			if (histogram[i] >= amount)
-			{
-				min_index = i;
-				break;
-			}else
-			{
-				amount -= histogram[i];
-			}
-		}
-		amount = min_amount;
-		unsigned int max_index = TYPE_SIZE - 1;
-		for (unsigned int i=TYPE_SIZE-1; i>=0; i--)
-		{
-			if (histogram[i] >= amount)
-			{
-				max_index = i;
-				break;
-			}else
-			{
-				amount -= histogram[i];
-			}
-		}
+		// 2.3% of the voxels are cut off at both ends
+		histogram_utility::Histogram h;
+		h.assign(histogram, TYPE_SIZE, 0, TYPE_SIZE);
+		unsigned int min_index = h.get_percentile_bin(0.023);
+		unsigned int max_index = h.get_percentile_bin_from_top(0.023);
 		scalar_min = static_cast<float>(min_index) / TYPE_SIZE;
 		scalar_max = static_cast<float>(max_index) / TYPE_SIZE;
 
@@ -328,57 +481,158 @@ namespace volume_utility
 #endif
 	}
 
-	/// calculate the gradients and the second derivatives
-	void generate_gradient(const int *sizes, const unsigned int count, const unsigned int components, const vector<float> &scalar_value, vector<nv::vec3f> &gradient, vector<float> &gradient_magnitude, float &max_gradient_magnitude, vector<nv::vec3f> &second_derivative, vector<float> &second_derivative_magnitude, float &max_second_derivative_magnitude)
+	void generate_second_derivative(const int *sizes, const vector<nv::vec3f> &gradient, vector<nv::vec3f> &second_derivative, vector<float> &second_derivative_magnitude, float &max_second_derivative_magnitude,
+		const mask_utility::ForegroundMask *foreground = NULL);
+
+	/// calculate the gradients and the second derivatives, only on the foreground if a mask is given
+	void generate_gradient(const int *sizes, const unsigned int count, const unsigned int components, const vector<float> &scalar_value, vector<nv::vec3f> &gradient, vector<float> &gradient_magnitude, float &max_gradient_magnitude, vector<nv::vec3f> &second_derivative, vector<float> &second_derivative_magnitude, float &max_second_derivative_magnitude,
+		const mask_utility::ForegroundMask *foreground = NULL)
 	{
 		unsigned int index;
 		int boundary[3] = {sizes[0]-1, sizes[1]-1, sizes[2]-1};
 		int width = sizes[0], height = sizes[1], depth = sizes[2];
+		const mask_utility::Span whole_row = {0, width};
+		const mask_utility::Span *span, *last;
+
+		// the second derivatives of the foreground read the gradients one voxel beyond it
+		mask_utility::ForegroundMask grown;
+		if (foreground)
+		{
+			grown = *foreground;
+			grown.dilate(1);
+		}
 
-		max_second_derivative_magnitude = max_gradient_magnitude = -1;
+		max_gradient_magnitude = -1;
 		for (int i=0; i<depth; i++)
 		{
 			for (int j=0; j<height; j++)
 			{
-				for (int k=0; k<width; k++)
+				span = &whole_row;
+				last = &whole_row + 1;
+				if (foreground)
 				{
-					index = ((i) * height + j) * width + k;
-					if (k==0 || j==0 || i==0 || k==boundary[0] || j==boundary[1] || i==boundary[2])
-					{
-						gradient_magnitude[index] = gradient[index].x = gradient[index].y = gradient[index].z = 0;
-					}else
+					grown.get_spans(j, i, span, last);
+				}
+				for (; span!=last; span++)
+				{
+					for (int k=span->begin; k<span->end; k++)
 					{
-						gradient[index].z = scalar_value[((i + 1) * height + j) * width + k] - scalar_value[((i - 1) * height + j) * width + k];
-						gradient[index].y = scalar_value[((i) * height + j + 1) * width + k] - scalar_value[((i) * height + j - 1) * width + k];
-						gradient[index].x = scalar_value[((i) * height + j) * width + k + 1] - scalar_value[((i) * height + j) * width + k - 1];
-						gradient_magnitude[index] = length(gradient[index]);
-						max_gradient_magnitude = std::max(gradient_magnitude[index], max_gradient_magnitude);
+						index = ((i) * height + j) * width + k;
+						if (k==0 || j==0 || i==0 || k==boundary[0] || j==boundary[1] || i==boundary[2])
+						{
+							gradient_magnitude[index] = gradient[index].x = gradient[index].y = gradient[index].z = 0;
+						}else
+						{
+							gradient[index].z = scalar_value[((i + 1) * height + j) * width + k] - scalar_value[((i - 1) * height + j) * width + k];
+							gradient[index].y = scalar_value[((i) * height + j + 1) * width + k] - scalar_value[((i) * height + j - 1) * width + k];
+							gradient[index].x = scalar_value[((i) * height + j) * width + k + 1] - scalar_value[((i) * height + j) * width + k - 1];
+							gradient_magnitude[index] = length(gradient[index]);
+							max_gradient_magnitude = std::max(gradient_magnitude[index], max_gradient_magnitude);
+						}
 					}
 				}
 			}
 		}
 
+		generate_second_derivative(sizes, gradient, second_derivative, second_derivative_magnitude, max_second_derivative_magnitude, foreground);
+	}
+
+	/// calculate the second derivatives from the gradients, only on the foreground if a mask is given
+	void generate_second_derivative(const int *sizes, const vector<nv::vec3f> &gradient, vector<nv::vec3f> &second_derivative, vector<float> &second_derivative_magnitude, float &max_second_derivative_magnitude,
+		const mask_utility::ForegroundMask *foreground)
+	{
+		unsigned int index;
+		int boundary[3] = {sizes[0]-1, sizes[1]-1, sizes[2]-1};
+		int width = sizes[0], height = sizes[1], depth = sizes[2];
+		const mask_utility::Span whole_row = {0, width};
+		const mask_utility::Span *span, *last;
+
+		max_second_derivative_magnitude = -1;
 		for (int i=0; i<depth; i++)
 		{
 			for (int j=0; j<height; j++)
 			{
-				for (int k=0; k<width; k++)
+				span = &whole_row;
+				last = &whole_row + 1;
+				if (foreground)
 				{
-					index = ((i) * height + j) * width + k;
-					if (k==0 || j==0 || i==0 || k==boundary[0] || j==boundary[1] || i==boundary[2])
+					foreground->get_spans(j, i, span, last);
+				}
+				for (; span!=last; span++)
+				{
+					for (int k=span->begin; k<span->end; k++)
 					{
-						second_derivative_magnitude[index] = 0;
-					}else
+						index = ((i) * height + j) * width + k;
+						if (k==0 || j==0 || i==0 || k==boundary[0] || j==boundary[1] || i==boundary[2])
+						{
+							second_derivative_magnitude[index] = 0;
+						}else
+						{
+							second_derivative[index].z = gradient[((i + 1) * height + j) * width + k].x - gradient[((i - 1) * height + j) * width + k].x;
+							second_derivative[index].y = gradient[((i) * height + j + 1) * width + k].y - gradient[((i) * height + j - 1) * width + k].y;
+							second_derivative[index].x = gradient[((i) * height + j) * width + k + 1].z - gradient[((i) * height + j) * width + k - 1].z;
+							second_derivative_magnitude[index] = length(second_derivative[index]);
+							max_second_derivative_magnitude = std::max(second_derivative_magnitude[index], max_second_derivative_magnitude);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/// calculate the gradients and the second derivatives of 8/16-bit data.
+	/// The gradients of single component data are central differences of the integers, converted to float once.
+	template <class T>
+	void generate_gradient(const T *data, const int *sizes, const unsigned int count, const unsigned int components, const vector<float> &scalar_value, vector<nv::vec3f> &gradient, vector<float> &gradient_magnitude, float &max_gradient_magnitude, vector<nv::vec3f> &second_derivative, vector<float> &second_derivative_magnitude, float &max_second_derivative_magnitude)
+	{
+		if (components != 1)
+		{
+			generate_gradient(sizes, count, components, scalar_value, gradient, gradient_magnitude, max_gradient_magnitude, second_derivative, second_derivative_magnitude, max_second_derivative_magnitude);
+			return;
+		}
+
+		typedef typename gradient_utility::difference<T>::type D;
+		int boundary[3] = {sizes[0]-1, sizes[1]-1, sizes[2]-1};
+		int width = sizes[0], height = sizes[1], depth = sizes[2];
+		vector<float> max_magnitudes(parallel_utility::get_thread_number(), -1);
+
+#pragma omp parallel
+		{
+			vector<D> dk(width), dj(width), di(width);
+			float max_magnitude = -1;
+			int i;
+#pragma omp for
+			for (i=0; i<depth; i++)
+			{
+				for (int j=0; j<height; j++)
+				{
+					unsigned int index = (i * height + j) * width;
+					bool boundary_row = (j==0 || i==0 || j==boundary[1] || i==boundary[2]);
+					if (!boundary_row)
 					{
-						second_derivative[index].z = gradient[((i + 1) * height + j) * width + k].x - gradient[((i - 1) * height + j) * width + k].x;
-						second_derivative[index].y = gradient[((i) * height + j + 1) * width + k].y - gradient[((i) * height + j - 1) * width + k].y;
-						second_derivative[index].x = gradient[((i) * height + j) * width + k + 1].z - gradient[((i) * height + j) * width + k - 1].z;
-						second_derivative_magnitude[index] = length(second_derivative[index]);
-						max_second_derivative_magnitude = std::max(second_derivative_magnitude[index], max_second_derivative_magnitude);
+						gradient_utility::central_difference_row(data, sizes, i, j, &dk[0], &dj[0], &di[0]);
+					}
+					for (int k=0; k<width; k++, index++)
+					{
+						if (boundary_row || k==0 || k==boundary[0])
+						{
+							gradient_magnitude[index] = gradient[index].x = gradient[index].y = gradient[index].z = 0;
+						}else
+						{
+							gradient[index].x = dk[k];
+							gradient[index].y = dj[k];
+							gradient[index].z = di[k];
+							gradient_magnitude[index] = length(gradient[index]);
+							max_magnitude = std::max(gradient_magnitude[index], max_magnitude);
+						}
 					}
 				}
 			}
+			max_magnitudes[parallel_utility::get_thread_index()] = max_magnitude;
 		}
+		max_gradient_magnitude = *std::max_element(max_magnitudes.begin(), max_magnitudes.end());
+
+		generate_second_derivative(sizes, gradient, second_derivative, second_derivative_magnitude, max_second_derivative_magnitude);
 	}
 
 	/// get a 1D index from a 3D index
@@ -451,6 +705,19 @@ namespace volume_utility
 		}
 	}
 
+	/// store normalized gradients as unsigned short triples
+	void pack_gradient(unsigned short *gradient_data, const unsigned int count, const vector<nv::vec3f> &gradient)
+	{
+		for (unsigned int i=0; i<count; i++)
+		{
+			nv::vec3f g = gradient[i];
+			unsigned int j = i * 3;
+			gradient_data[j]   = (unsigned short)(g.x * 65535);
+			gradient_data[j+1] = (unsigned short)(g.y * 65535);
+			gradient_data[j+2] = (unsigned short)(g.z * 65535);
+		}
+	}
+
 	/// gradient estimation by Sobel 3D operator
 	void estimate_gradient(unsigned short *gradient_data, const int *sizes, const unsigned int count, const vector<float> &scalar_value, vector<nv::vec3f> &gradient)
 	{
@@ -484,11 +751,11 @@ namespace volume_utility
 						gradient[index].y
 							= 4.0 * (scalar_value[get_index(i, j+1, k, sizes)] - scalar_value[get_index(i, j-1, k, sizes)])
 							+ 2.0 * (scalar_value[get_index(i-1, j+1, k, sizes)] - scalar_value[get_index(i-1, j-1, k, sizes)])
-							+ 2.0 * (scalar_value[get_index(i+1, j+1, k, sizes)] - scalar_value[get_index(1+1, j-1, k, sizes)])
+							+ 2.0 * (scalar_value[get_index(i+1, j+1, k, sizes)] - scalar_value[get_index(i+1, j-1, k, sizes)])
 							+ 2.0 * (scalar_value[get_index(i, j+1, k-1, sizes)] - scalar_value[get_index(i, j-1, k-1, sizes)])
 							+ 2.0 * (scalar_value[get_index(i, j+1, k+1, sizes)] - scalar_value[get_index(i, j-1, k+1, sizes)])
 							+ (scalar_value[get_index(i-1, j+1, k-1, sizes)] - scalar_value[get_index(i-1, j-1, k-1, sizes)])
-							+ (scalar_value[get_index(i+1, j+1, k+1, sizes)] - scalar_value[get_index(1+1, j-1, k+1, sizes)])
+							+ (scalar_value[get_index(i+1, j+1, k+1, sizes)] - scalar_value[get_index(i+1, j-1, k+1, sizes)])
 							+ (scalar_value[get_index(i+1, j+1, k-1, sizes)] - scalar_value[get_index(i+1, j-1, k-1, sizes)])
 							+ (scalar_value[get_index(i-1, j+1, k+1, sizes)] - scalar_value[get_index(i-1, j-1, k+1, sizes)]);
 
@@ -509,14 +776,78 @@ namespace volume_utility
 			}
 		}
 
-		for (unsigned int i=0; i<count; i++)
+		pack_gradient(gradient_data, count, gradient);
+	}
+
+	/// gradient estimation by Sobel 3D operator for 8/16-bit data.
+	/// Single component data are summed up as integers and converted to float only to be normalized.
+	template <class T>
+	void estimate_gradient(unsigned short *gradient_data, const T *data, const int *sizes, const unsigned int count, const unsigned int components, const vector<float> &scalar_value, vector<nv::vec3f> &gradient)
+	{
+		if (components != 1)
 		{
-			nv::vec3f g = gradient[i];
-			unsigned int j = i * 3;
-			gradient_data[j]   = (unsigned short)(g.x * 65535);
-			gradient_data[j+1] = (unsigned short)(g.y * 65535);
-			gradient_data[j+2] = (unsigned short)(g.z * 65535);
+			estimate_gradient(gradient_data, sizes, count, scalar_value, gradient);
+			return;
+		}
+
+		typedef typename gradient_utility::difference<T>::type D;
+		int boundary[3] = {sizes[0]-1, sizes[1]-1, sizes[2]-1};
+		int width = sizes[0], height = sizes[1], depth = sizes[2];
+
+#pragma omp parallel
+		{
+			gradient_utility::SobelRow<T> sobel(width);
+			vector<D> dk(width), dj(width), di(width);
+			int i;
+#pragma omp for
+			for (i=0; i<depth; i++)
+			{
+				for (int j=0; j<height; j++)
+				{
+					unsigned int index = get_index(i, j, 0, sizes);
+					bool boundary_row = (j==0 || i==0 || j==boundary[1] || i==boundary[2]);
+					if (!boundary_row)
+					{
+						sobel(data, sizes, i, j, &dk[0], &dj[0], &di[0]);
+					}
+					for (int k=0; k<width; k++, index++)
+					{
+						if (boundary_row || k==0 || k==boundary[0])
+						{
+							gradient[index].x = gradient[index].y = gradient[index].z =  0;
+						}else
+						{
+							gradient[index].x = di[k];
+							gradient[index].y = dj[k];
+							gradient[index].z = dk[k];
+							gradient[index] = nv::normalize(gradient[index]);
+						}
+					}
+				}
+			}
 		}
+
+		pack_gradient(gradient_data, count, gradient);
+	}
+
+	/// gradient estimation by derivatives of a Gaussian of standard deviation sigma, for noisy data.
+	/// The recursive filters cost the same for any sigma, the components are ordered like the Sobel estimation.
+	void estimate_gradient_gaussian(unsigned short *gradient_data, const int *sizes, const unsigned int count, const vector<float> &scalar_value, const float sigma, vector<nv::vec3f> &gradient)
+	{
+		vector<float> dk(count), dj(count), di(count);
+		gaussian_utility::gradient(&scalar_value[0], sizes, sigma, &dk[0], &dj[0], &di[0]);
+
+		const int n = static_cast<int>(count);
+		int i;
+#pragma omp parallel for
+		for (i=0; i<n; i++)
+		{
+			nv::vec3f g(di[i], dj[i], dk[i]);
+			const float l = nv::length(g);
+			gradient[i] = l > 0 ? g / l : g;
+		}
+
+		pack_gradient(gradient_data, count, gradient);
 	}
 }
 